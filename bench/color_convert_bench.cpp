@@ -0,0 +1,272 @@
+// Throughput and correctness check for the color conversion kernels.
+//
+// For every packed source format and 4:2:0 destination this converts a
+// synthetic frame with each instruction set the CPU supports and with
+// swscale, then reports megapixels per second and the speedup over the
+// scalar kernel. It also checks that:
+//   - every instruction set produces output identical to the scalar kernel,
+//     at the requested size and at an odd size one pixel smaller;
+//   - the kernels stay within one code value of an accurately rounded
+//     BT.709 sws_scale conversion of a smooth gradient.
+// Exits non-zero if any check fails.
+
+#include "color_convert.h"
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+using namespace playrec;
+
+namespace {
+
+struct Image {
+    int width = 0;
+    int height = 0;
+    VideoFormat format = VideoFormat::YUV420P;
+    std::vector<uint8_t> planes[3];
+    int stride[3] = {0, 0, 0};
+
+    Image(VideoFormat dst_format, int w, int h) : width(w), height(h), format(dst_format) {
+        int chroma_width = (w + 1) / 2;
+        int chroma_height = (h + 1) / 2;
+        stride[0] = w;
+        stride[1] = format == VideoFormat::NV12 ? chroma_width * 2 : chroma_width;
+        stride[2] = format == VideoFormat::NV12 ? 0 : chroma_width;
+        planes[0].assign(static_cast<size_t>(stride[0]) * h, 0);
+        planes[1].assign(static_cast<size_t>(stride[1]) * chroma_height, 0);
+        planes[2].assign(static_cast<size_t>(stride[2]) * chroma_height, 0);
+    }
+
+    uint8_t* const* data() {
+        pointers[0] = planes[0].data();
+        pointers[1] = planes[1].data();
+        pointers[2] = planes[2].empty() ? nullptr : planes[2].data();
+        return pointers;
+    }
+
+    uint8_t* pointers[3] = {nullptr, nullptr, nullptr};
+};
+
+AVPixelFormat to_av(VideoFormat format) {
+    switch (format) {
+        case VideoFormat::RGB24:   return AV_PIX_FMT_RGB24;
+        case VideoFormat::RGBA32:  return AV_PIX_FMT_RGBA;
+        case VideoFormat::BGR24:   return AV_PIX_FMT_BGR24;
+        case VideoFormat::BGRA32:  return AV_PIX_FMT_BGRA;
+        case VideoFormat::YUV420P: return AV_PIX_FMT_YUV420P;
+        case VideoFormat::NV12:    return AV_PIX_FMT_NV12;
+    }
+    return AV_PIX_FMT_NONE;
+}
+
+int bytes_per_pixel(VideoFormat format) {
+    return format == VideoFormat::RGB24 || format == VideoFormat::BGR24 ? 3 : 4;
+}
+
+// Diagonal color ramps with a little noise, like a game frame without
+// hard edges; noise keeps the vector paths honest about every lane
+std::vector<uint8_t> make_source(VideoFormat format, int width, int height, bool noise) {
+    int bpp = bytes_per_pixel(format);
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * bpp * height);
+    uint32_t seed = 12345;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            uint8_t* p = &pixels[(static_cast<size_t>(y) * width + x) * bpp];
+            int jitter = 0;
+            if (noise) {
+                seed = seed * 1664525u + 1013904223u;
+                jitter = static_cast<int>(seed >> 28) - 8;
+            }
+            for (int c = 0; c < bpp; ++c) {
+                int ramp = (x * (c + 1) * 255 / width + y * (3 - c) * 255 / height) & 0x1ff;
+                int value = (ramp > 255 ? 511 - ramp : ramp) + jitter;
+                p[c] = static_cast<uint8_t>(value < 0 ? 0 : value > 255 ? 255 : value);
+            }
+        }
+    }
+    return pixels;
+}
+
+int max_difference(Image& a, Image& b) {
+    int worst = 0;
+    for (int plane = 0; plane < 3; ++plane) {
+        for (size_t i = 0; i < a.planes[plane].size(); ++i) {
+            int diff = std::abs(a.planes[plane][i] - b.planes[plane][i]);
+            worst = diff > worst ? diff : worst;
+        }
+    }
+    return worst;
+}
+
+template <typename Fn>
+double megapixels_per_second(int width, int height, int iterations, Fn&& convert) {
+    convert();  // Warm caches and page in the destination
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        convert();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return seconds > 0.0 ? static_cast<double>(width) * height * iterations / seconds / 1e6 : 0.0;
+}
+
+SwsContext* make_sws(VideoFormat src, VideoFormat dst, int width, int height, int flags) {
+    SwsContext* context = sws_getContext(width, height, to_av(src), width, height, to_av(dst),
+                                         flags, nullptr, nullptr, nullptr);
+    if (context) {
+        const int* bt709 = sws_getCoefficients(SWS_CS_ITU709);
+        sws_setColorspaceDetails(context, bt709, 1, bt709, 0, 0, 1 << 16, 1 << 16);
+    }
+    return context;
+}
+
+bool run_sws(SwsContext* context, const std::vector<uint8_t>& source, int src_stride, int height, Image& out) {
+    const uint8_t* src_data[4] = {source.data(), nullptr, nullptr, nullptr};
+    int src_linesize[4] = {src_stride, 0, 0, 0};
+    return sws_scale(context, src_data, src_linesize, 0, height, out.data(), out.stride) == height;
+}
+
+// Every ISA must match the scalar kernel byte for byte
+bool verify_isas(VideoFormat src, VideoFormat dst, int width, int height,
+                 const std::vector<ColorKernelIsa>& isas) {
+    auto source = make_source(src, width, height, true);
+    int src_stride = width * bytes_per_pixel(src);
+    Image reference(dst, width, height);
+    get_color_kernel(src, dst, ColorKernelIsa::SCALAR)(source.data(), src_stride, width, height,
+                                                       reference.data(), reference.stride);
+    bool ok = true;
+    for (auto isa : isas) {
+        Image out(dst, width, height);
+        get_color_kernel(src, dst, isa)(source.data(), src_stride, width, height, out.data(), out.stride);
+        int diff = max_difference(out, reference);
+        if (diff != 0) {
+            std::cerr << "FAIL: " << color_kernel_isa_name(isa) << " differs from scalar by up to "
+                      << diff << " at " << width << "x" << height << "\n";
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// Accuracy against swscale with exact rounding on smooth content. Even
+// sizes only: swscale sites the chroma of a trailing odd column and row
+// differently from the kernels, which replicate the edge pixel.
+bool check_against_sws(VideoFormat src, VideoFormat dst, int width, int height) {
+    auto source = make_source(src, width, height, false);
+    int src_stride = width * bytes_per_pixel(src);
+    Image expected(dst, width, height);
+    SwsContext* exact = make_sws(src, dst, width, height, SWS_BILINEAR | SWS_ACCURATE_RND | SWS_BITEXACT);
+    bool converted = exact && run_sws(exact, source, src_stride, height, expected);
+    sws_freeContext(exact);
+    if (!converted) {
+        std::cerr << "FAIL: sws_scale reference conversion\n";
+        return false;
+    }
+
+    Image out(dst, width, height);
+    get_color_kernel(src, dst, ColorKernelIsa::SCALAR)(source.data(), src_stride, width, height,
+                                                       out.data(), out.stride);
+    int diff = max_difference(out, expected);
+    std::cout << "  max difference vs sws_scale: " << diff << "\n";
+    if (diff > 1) {
+        std::cerr << "FAIL: kernels deviate from sws_scale by " << diff << "\n";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int width = 2560;
+    int height = 1440;
+    int iterations = 50;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--size" && i + 1 < argc) {
+            std::string size = argv[++i];
+            auto x = size.find('x');
+            if (x != std::string::npos) {
+                width = std::stoi(size.substr(0, x));
+                height = std::stoi(size.substr(x + 1));
+            }
+        } else if (arg == "--iterations" && i + 1 < argc) {
+            iterations = std::stoi(argv[++i]);
+        } else if (arg == "--help" || arg == "-h") {
+            std::cout << "Usage: " << argv[0] << " [options]\n\n";
+            std::cout << "Options:\n";
+            std::cout << "  --size <WxH>        Frame size (default: 2560x1440)\n";
+            std::cout << "  --iterations <n>    Conversions timed per kernel (default: 50)\n";
+            return 0;
+        }
+    }
+    if (width < 2 || height < 2 || iterations < 1) {
+        std::cerr << "Invalid size or iteration count\n";
+        return 1;
+    }
+
+    std::vector<ColorKernelIsa> isas;
+    for (auto isa : {ColorKernelIsa::SSE41, ColorKernelIsa::AVX2, ColorKernelIsa::AVX512}) {
+        if (get_color_kernel(VideoFormat::BGRA32, VideoFormat::YUV420P, isa)) {
+            isas.push_back(isa);
+        }
+    }
+
+    std::cout << "Color conversion at " << width << "x" << height << ", " << iterations
+              << " iterations (best: " << color_kernel_isa_name(detect_color_kernel_isa()) << ")\n\n";
+
+    bool ok = true;
+    for (auto src : {VideoFormat::BGRA32, VideoFormat::RGBA32, VideoFormat::RGB24, VideoFormat::BGR24}) {
+        for (auto dst : {VideoFormat::YUV420P, VideoFormat::NV12}) {
+            std::cout << av_get_pix_fmt_name(to_av(src)) << " -> " << av_get_pix_fmt_name(to_av(dst)) << "\n";
+
+            ok = verify_isas(src, dst, width, height, isas) && ok;
+            ok = verify_isas(src, dst, width - 1, height - 1, isas) && ok;
+            ok = check_against_sws(src, dst, width & ~1, height & ~1) && ok;
+
+            auto source = make_source(src, width, height, false);
+            int src_stride = width * bytes_per_pixel(src);
+            Image out(dst, width, height);
+
+            // Throughput, with swscale set up the way VideoConverter uses it
+            SwsContext* fast = make_sws(src, dst, width, height, SWS_FAST_BILINEAR);
+            double sws_rate = fast ? megapixels_per_second(width, height, iterations, [&] {
+                run_sws(fast, source, src_stride, height, out);
+            }) : 0.0;
+            sws_freeContext(fast);
+
+            double scalar_rate = 0.0;
+            std::vector<ColorKernelIsa> all = {ColorKernelIsa::SCALAR};
+            all.insert(all.end(), isas.begin(), isas.end());
+            std::cout << std::fixed << std::setprecision(1);
+            std::cout << "  " << std::left << std::setw(10) << "swscale" << std::right << std::setw(9)
+                      << sws_rate << " MPix/s\n";
+            for (auto isa : all) {
+                ColorKernel kernel = get_color_kernel(src, dst, isa);
+                double rate = megapixels_per_second(width, height, iterations, [&] {
+                    kernel(source.data(), src_stride, width, height, out.data(), out.stride);
+                });
+                if (isa == ColorKernelIsa::SCALAR) {
+                    scalar_rate = rate;
+                }
+                std::cout << "  " << std::left << std::setw(10) << color_kernel_isa_name(isa) << std::right
+                          << std::setw(9) << rate << " MPix/s  " << std::setprecision(2)
+                          << (scalar_rate > 0.0 ? rate / scalar_rate : 0.0) << "x scalar, "
+                          << (sws_rate > 0.0 ? rate / sws_rate : 0.0) << "x swscale\n"
+                          << std::setprecision(1);
+            }
+            std::cout << "\n";
+        }
+    }
+
+    std::cout << (ok ? "All checks passed\n" : "Checks FAILED\n");
+    return ok ? 0 : 1;
+}
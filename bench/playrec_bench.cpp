@@ -0,0 +1,297 @@
+// End-to-end throughput benchmark.
+//
+// Drives the real CaptureEngine (convert, encode and mux stages, the chosen
+// video encoder backend and the MP4 writer) from the in-memory synthetic source
+// as fast as the pipeline accepts frames, at each requested resolution.
+// Needs no display or audio device. Reports as JSON, per resolution:
+//   - frames per second sustained, and as a multiple of the target rate;
+//   - per-stage service time (average, p50/p95/p99, max), queue high
+//     water, time blocked on the next stage and CPU time of its thread;
+//   - CPU time of the whole process;
+//   - peak resident set size of the process so far;
+//   - output size and bitrate over the recorded media time.
+// Exits non-zero if any run fails or loses frames.
+
+#include "capture_engine.h"
+#include "synthetic_capture.h"
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+
+using namespace playrec;
+
+namespace {
+
+struct Resolution {
+    const char* name;
+    int width;
+    int height;
+};
+
+const Resolution kResolutions[] = {
+    {"720p", 1280, 720},
+    {"1080p", 1920, 1080},
+    {"1440p", 2560, 1440},
+    {"4k", 3840, 2160},
+};
+
+struct Options {
+    std::vector<Resolution> resolutions;
+    uint64_t frames = 600;
+    int fps = 60;
+    std::string codec = "h264";
+    bool audio = true;
+    bool simd_color_convert = true;
+    std::string output_dir = ".";
+    std::string json_path;   // Empty = stdout
+    bool keep_files = false;
+    bool verbose = false;
+};
+
+struct RunResult {
+    Resolution resolution{};
+    bool ok = false;
+    double wall_seconds = 0.0;
+    CaptureEngine::Stats stats;
+    uint64_t file_bytes = 0;
+    long peak_rss_kb = 0;
+};
+
+// Swallows the engine's progress output so it cannot corrupt the JSON
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+long peak_rss_kb() {
+    struct rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;  // Kilobytes on Linux
+}
+
+RunResult run_one(const Options& options, const Resolution& resolution) {
+    RunResult result;
+    result.resolution = resolution;
+
+    CaptureSettings settings;
+    settings.width = resolution.width;
+    settings.height = resolution.height;
+    settings.frameRate = options.fps;
+    settings.target_fps = options.fps;
+    settings.codec = options.codec;
+    settings.capture_audio = options.audio;
+    settings.simd_color_convert = options.simd_color_convert;
+    settings.drop_policy = DropPolicy::BLOCK;  // Measure throughput, never drop
+    settings.output_path = options.output_dir + "/playrec_bench_" + resolution.name + ".mp4";
+
+    auto video = std::make_unique<SyntheticVideoCapture>(options.frames);
+    SyntheticVideoCapture* source = video.get();
+    std::unique_ptr<AudioCapture> audio;
+    if (options.audio) {
+        audio = std::make_unique<SyntheticAudioCapture>(source);
+    }
+
+    CaptureEngine engine;
+    if (!engine.initialize(settings, std::move(video), std::move(audio))) {
+        std::cerr << "playrec_bench: " << resolution.name << ": failed to initialize\n";
+        return result;
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+    if (!engine.start_capture()) {
+        std::cerr << "playrec_bench: " << resolution.name << ": failed to start\n";
+        return result;
+    }
+    while (!source->finished()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    engine.stop_capture();  // Drains every stage and flushes the encoder
+    result.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    result.stats = engine.get_stats();
+    result.peak_rss_kb = peak_rss_kb();
+
+    std::error_code error;
+    result.file_bytes = std::filesystem::file_size(settings.output_path, error);
+    if (error) {
+        result.file_bytes = 0;
+    }
+    if (!options.keep_files) {
+        std::filesystem::remove(settings.output_path, error);
+    }
+
+    result.ok = result.stats.frames_captured == options.frames && result.stats.frames_dropped == 0;
+    if (!result.ok) {
+        std::cerr << "playrec_bench: " << resolution.name << ": wrote " << result.stats.frames_captured
+                  << " of " << options.frames << " frames\n";
+    }
+    return result;
+}
+
+void write_json(std::ostream& out, const Options& options, const std::vector<RunResult>& results) {
+    out << std::fixed << std::setprecision(3);
+    out << "{\n";
+    out << "  \"codec\": \"" << options.codec << "\",\n";
+    out << "  \"frames_per_run\": " << options.frames << ",\n";
+    out << "  \"target_fps\": " << options.fps << ",\n";
+    out << "  \"audio\": " << (options.audio ? "true" : "false") << ",\n";
+    out << "  \"runs\": [";
+
+    for (size_t r = 0; r < results.size(); ++r) {
+        const RunResult& run = results[r];
+        const auto& stats = run.stats;
+        double fps = run.wall_seconds > 0 ? stats.frames_captured / run.wall_seconds : 0.0;
+        double media_seconds = static_cast<double>(stats.frames_captured) / options.fps;
+        double bitrate_kbps = media_seconds > 0 ? run.file_bytes * 8.0 / media_seconds / 1000.0 : 0.0;
+
+        out << (r ? ",\n" : "\n") << "    {\n";
+        out << "      \"resolution\": \"" << run.resolution.name << "\",\n";
+        out << "      \"width\": " << run.resolution.width << ",\n";
+        out << "      \"height\": " << run.resolution.height << ",\n";
+        out << "      \"ok\": " << (run.ok ? "true" : "false") << ",\n";
+        out << "      \"frames\": " << stats.frames_captured << ",\n";
+        out << "      \"frames_dropped\": " << stats.frames_dropped << ",\n";
+        out << "      \"wall_seconds\": " << run.wall_seconds << ",\n";
+        out << "      \"fps\": " << fps << ",\n";
+        out << "      \"realtime_factor\": " << fps / options.fps << ",\n";
+        out << "      \"convert_backend\": \"" << stats.convert_backend << "\",\n";
+        out << "      \"encoder_threading\": \"" << stats.encoder_threading << "\",\n";
+        out << "      \"encode_latency_p50_ms\": " << stats.encode_latency_p50_ms << ",\n";
+        out << "      \"encode_latency_p95_ms\": " << stats.encode_latency_p95_ms << ",\n";
+        out << "      \"speed_adjustments\": " << stats.speed_adjustments.size() << ",\n";
+        out << "      \"cpu_seconds\": " << stats.cpu_seconds << ",\n";
+        out << "      \"peak_rss_kb\": " << run.peak_rss_kb << ",\n";
+        out << "      \"file_bytes\": " << run.file_bytes << ",\n";
+        out << "      \"media_seconds\": " << media_seconds << ",\n";
+        out << "      \"bitrate_kbps\": " << bitrate_kbps << ",\n";
+        out << "      \"stages\": [";
+        for (size_t s = 0; s < stats.stages.size(); ++s) {
+            const StageStats& stage = stats.stages[s];
+            out << (s ? ",\n" : "\n") << "        {"
+                << "\"name\": \"" << stage.name << "\", "
+                << "\"items\": " << stage.items << ", "
+                << "\"avg_ms\": " << stage.average_service_ms << ", "
+                << "\"p50_ms\": " << stage.p50_service_ms << ", "
+                << "\"p95_ms\": " << stage.p95_service_ms << ", "
+                << "\"p99_ms\": " << stage.p99_service_ms << ", "
+                << "\"max_ms\": " << stage.max_service_ms << ", "
+                << "\"blocked_ms\": " << stage.blocked_ms << ", "
+                << "\"cpu_ms\": " << stage.cpu_ms << ", "
+                << "\"queue_capacity\": " << stage.queue_capacity << ", "
+                << "\"queue_high_water\": " << stage.queue_high_water << "}";
+        }
+        out << "\n      ]\n";
+        out << "    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+bool parse_resolutions(const std::string& list, std::vector<Resolution>& resolutions) {
+    std::stringstream stream(list);
+    std::string name;
+    while (std::getline(stream, name, ',')) {
+        bool found = false;
+        for (const auto& resolution : kResolutions) {
+            if (name == resolution.name) {
+                resolutions.push_back(resolution);
+                found = true;
+            }
+        }
+        if (!found) {
+            std::cerr << "Unknown resolution: " << name << "\n";
+            return false;
+        }
+    }
+    return !resolutions.empty();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    std::string resolution_list = "720p,1080p,1440p,4k";
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--resolutions" && i + 1 < argc) {
+            resolution_list = argv[++i];
+        } else if (arg == "--frames" && i + 1 < argc) {
+            options.frames = std::stoull(argv[++i]);
+        } else if (arg == "--fps" && i + 1 < argc) {
+            options.fps = std::stoi(argv[++i]);
+        } else if (arg == "--codec" && i + 1 < argc) {
+            options.codec = argv[++i];
+        } else if (arg == "--convert" && i + 1 < argc) {
+            options.simd_color_convert = std::string(argv[++i]) != "swscale";
+        } else if (arg == "--no-audio") {
+            options.audio = false;
+        } else if (arg == "--output-dir" && i + 1 < argc) {
+            options.output_dir = argv[++i];
+        } else if (arg == "--json" && i + 1 < argc) {
+            options.json_path = argv[++i];
+        } else if (arg == "--keep") {
+            options.keep_files = true;
+        } else if (arg == "--verbose") {
+            options.verbose = true;
+        } else if (arg == "--help" || arg == "-h") {
+            std::cout << "Usage: " << argv[0] << " [options]\n\n";
+            std::cout << "Options:\n";
+            std::cout << "  --resolutions <l>   Comma-separated: 720p,1080p,1440p,4k (default: all)\n";
+            std::cout << "  --frames <n>        Frames recorded per resolution (default: 600)\n";
+            std::cout << "  --fps <number>      Frame rate the output is stamped at (default: 60)\n";
+            std::cout << "  --codec <codec>     Video encoder: h264|h265|av1|vp9|openh264 (default: h264)\n";
+            std::cout << "  --convert <path>    Color conversion: simd|swscale (default: simd)\n";
+            std::cout << "  --no-audio          Record video only\n";
+            std::cout << "  --output-dir <dir>  Where the recordings go (default: .)\n";
+            std::cout << "  --json <file>       Write the report here (default: stdout)\n";
+            std::cout << "  --keep              Keep the recordings\n";
+            std::cout << "  --verbose           Show the engine's own output\n";
+            return 0;
+        }
+    }
+    if (options.frames < 1 || options.fps < 1 || !parse_resolutions(resolution_list, options.resolutions)) {
+        std::cerr << "Invalid frame count, rate or resolution list\n";
+        return 1;
+    }
+
+    NullBuffer null_buffer;
+    std::vector<RunResult> results;
+    bool ok = true;
+    for (const auto& resolution : options.resolutions) {
+        std::streambuf* saved = nullptr;
+        if (!options.verbose) {
+            saved = std::cout.rdbuf(&null_buffer);
+        }
+        RunResult result = run_one(options, resolution);
+        if (saved) {
+            std::cout.rdbuf(saved);
+        }
+
+        double fps = result.wall_seconds > 0 ? result.stats.frames_captured / result.wall_seconds : 0.0;
+        std::cerr << "playrec_bench: " << resolution.name << " " << std::fixed << std::setprecision(1)
+                  << fps << " fps (" << fps / options.fps << "x realtime)\n";
+        ok = ok && result.ok;
+        results.push_back(std::move(result));
+    }
+
+    if (options.json_path.empty()) {
+        write_json(std::cout, options, results);
+    } else {
+        std::ofstream file(options.json_path);
+        write_json(file, options, results);
+        if (!file) {
+            std::cerr << "Failed to write " << options.json_path << "\n";
+            return 1;
+        }
+    }
+
+    return ok ? 0 : 1;
+}
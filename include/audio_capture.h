@@ -1,7 +1,10 @@
 #pragma once
 
 #include "common.h"
+#include "ring_queue.h"
+#include <condition_variable>
 #include <functional>
+#include <mutex>
 #include <thread>
 #include <atomic>
 
@@ -32,11 +35,32 @@ public:
     // Check if capture is active
     virtual bool is_active() const = 0;
 
+    // Capture health, as far as the platform reports it
+    struct Stats {
+        uint64_t chunks_captured = 0;
+        uint64_t xruns = 0;             // Device overruns: audio lost before it was read
+        uint64_t chunks_dropped = 0;    // Read but discarded because delivery fell behind
+        double average_latency_ms = 0.0;    // Sound reaching the device to delivery
+        double max_latency_ms = 0.0;
+    };
+
+    Stats get_capture_stats() const;
+
 protected:
     void emit_sample(const AudioSample& sample);
+    void record_xrun();
+    void record_dropped_chunk();
+    void record_capture_latency(TimeDuration latency);
 
 private:
     std::function<void(const AudioSample&)> m_sample_callback;
+
+    std::atomic<uint64_t> m_chunks_captured{0};
+    std::atomic<uint64_t> m_xruns{0};
+    std::atomic<uint64_t> m_chunks_dropped{0};
+    std::atomic<uint64_t> m_latency_samples{0};
+    std::atomic<uint64_t> m_total_latency_us{0};
+    std::atomic<uint64_t> m_max_latency_us{0};
 };
 
 // Platform-specific implementations
@@ -89,8 +113,15 @@ private:
 #endif
 
 #ifdef __linux__
+// ALSA capture. A read thread pulls one period at a time from the device
+// into a ring of preallocated chunks; a delivery thread hands them to the
+// sample callback, so a slow consumer cannot stall the device read and no
+// chunk buffer is allocated while capturing.
 class LinuxAudioCapture : public AudioCapture {
 public:
+    LinuxAudioCapture();
+    ~LinuxAudioCapture() override;
+
     bool initialize(const CaptureSettings& settings) override;
     bool start() override;
     void stop() override;
@@ -99,12 +130,36 @@ public:
     int get_channels() const override;
     bool is_active() const override;
 
+    // Negotiated with the device; may differ from what was asked for
+    int period_frames() const { return m_period_frames; }
+    int buffer_frames() const { return m_buffer_frames; }
+
 private:
-    // Linux-specific members (ALSA/PulseAudio)
-    bool m_is_active = false;
+    void read_loop();
+    void deliver_loop();
+
+    // Linux-specific members (ALSA)
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+    std::atomic<bool> m_is_active{false};
     AudioFormat m_format = AudioFormat::PCM_S16LE;
     int m_sample_rate = 44100;
     int m_channels = 2;
+    int m_period_frames = 0;
+    int m_buffer_frames = 0;
+
+    // Chunks cycle free -> ready -> delivered -> free by index
+    std::vector<AudioSample> m_chunks;
+    std::unique_ptr<RingQueue<size_t>> m_free_chunks;
+    std::unique_ptr<RingQueue<size_t>> m_ready_chunks;
+    std::mutex m_ready_mutex;
+    std::condition_variable m_ready_cv;
+
+    // Threading
+    std::thread m_read_thread;
+    std::thread m_deliver_thread;
+    std::atomic<bool> m_should_stop{false};
+    std::atomic<bool> m_reader_done{false};
 };
 #endif
 
@@ -1,13 +1,22 @@
 #pragma once
 
 #include "common.h"
+#include "cpu_time.h"
 #include "video_capture.h"
 #include "audio_capture.h"
 #include "encoder.h"
 #include "file_writer.h"
+#include "rate_controller.h"
+#include "replay_buffer.h"
+#include "segment_writer.h"
+#include "ring_queue.h"
+#include "stage_queue.h"
 #include <memory>
 #include <thread>
 #include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
 
 namespace playrec {
 
@@ -19,43 +28,166 @@ public:
     // Initialize the capture engine with settings
     bool initialize(const CaptureSettings& settings);
 
+    // Initialize with caller-provided sources instead of the platform ones
+    // (e.g. synthetic or file input). audio_capture may be null for video only.
+    bool initialize(const CaptureSettings& settings,
+                    std::unique_ptr<VideoCapture> video_capture,
+                    std::unique_ptr<AudioCapture> audio_capture);
+
     // Start capturing
     bool start_capture();
 
-    // Stop capturing
-    void stop_capture();
+    // Stop capturing. Returns false if the output could not be completely
+    // written (e.g. the disk filled up).
+    bool stop_capture();
 
     // Check if currently capturing
     bool is_capturing() const;
 
     // Get capture statistics
     struct Stats {
+        uint64_t sequence = 0;          // Increases with every get_stats() call
+        double elapsed_seconds = 0.0;   // Since start_capture()
         uint64_t frames_captured = 0;
         uint64_t frames_dropped = 0;
-        double average_fps = 0.0;
-        double cpu_usage = 0.0;
-        uint64_t file_size_bytes = 0;
+        double average_fps = 0.0;       // Over the whole recording
+        double current_fps = 0.0;       // Over the last second or so
+        double cpu_usage = 0.0;         // Process CPU over the same window, percent of all cores
+        double cpu_seconds = 0.0;       // Process CPU time since start_capture()
+        uint64_t file_size_bytes = 0;   // All output files, as written so far
+        uint64_t queue_depth = 0;       // Frames waiting for the encode thread
+        uint64_t queue_overflows = 0;   // Frames discarded because the queue was full
+        uint64_t pool_hits = 0;         // Frame buffers reused from the pool
+        uint64_t pool_misses = 0;       // Frame buffers that had to be allocated
+        uint64_t pool_high_water_bytes = 0;
+        double grab_latency_ms = 0.0;       // Average time spent in the platform grab call
+        double max_grab_latency_ms = 0.0;
+        uint64_t frames_unchanged = 0;              // Frames the source reported as repeats
+        uint64_t frames_skipped = 0;                // Repeats not re-encoded (VFR output)
+        uint64_t damaged_pixels_per_second = 0;
+        uint64_t unchanged_frames_per_second = 0;
+        uint64_t full_frame_copies = 0;         // Damaged ticks that copied the whole previous frame
+        uint64_t capture_ticks = 0;             // Wakeups of a self-paced source
+        uint64_t capture_ticks_missed = 0;      // Frame ticks a slow grab overran
+        double capture_late_p99_ms = 0.0;       // Wakeup past its deadline
+        double capture_jitter_ms = 0.0;         // Spread of that lateness, p99 - p50
+        uint64_t audio_xruns = 0;               // Device overruns reported by audio capture
+        uint64_t audio_chunks_dropped = 0;
+        double audio_latency_ms = 0.0;          // Average device-to-engine audio delay
+        double max_audio_latency_ms = 0.0;
+        double convert_ms = 0.0;        // Average color conversion time per frame
+        double last_convert_ms = 0.0;
+        const char* convert_backend = "none";  // swscale, copy or the kernel instruction set
+        std::string encoder_threading;  // Threading the video encoder chose
+        double encode_latency_p50_ms = 0.0;  // Frame submitted to packet received
+        double encode_latency_p95_ms = 0.0;
+        size_t replay_bytes = 0;        // Replay buffer mode: payload held in memory
+        double replay_seconds = 0.0;    // and the media time it covers
+        uint64_t replays_saved = 0;
+        uint64_t segments = 0;          // Output files started, 1 unless segmenting
+        uint64_t io_queued_bytes = 0;   // Output waiting for the disk
+        double io_bytes_per_second = 0.0;
+        double io_writes_per_second = 0.0;  // Write system calls
+        std::string segment_path;       // File being written now
+        int encoder_speed_level = 0;    // 0 = configured preset, higher = cheaper
+        std::vector<SpeedAdjustment> speed_adjustments;
+        std::vector<StageStats> stages; // Capture, convert, video encode, audio encode, mux, io
     };
     
+    // A snapshot built from the stages' own counters; safe from any thread
     Stats get_stats() const;
 
+    // Get the most recent captured frame for preview (shares its buffer)
+    bool get_preview_frame(Frame& frame) const;
+
+    // Replay buffer mode (settings.replay_buffer_seconds > 0) keeps recent
+    // packets in memory instead of writing settings.output_path. This
+    // writes the last `seconds` of it (0 = all it holds), from the nearest
+    // keyframe, to an MP4 on a background thread without re-encoding.
+    // Returns false if there is no buffer, nothing to save yet or a save is
+    // already running. done, if set, is called on that thread once the
+    // file is complete.
+    using ReplaySaved = std::function<void(bool ok, const std::string& path)>;
+    bool save_replay(const std::string& path, double seconds = 0.0, ReplaySaved done = nullptr);
+    bool is_saving_replay() const { return m_replay_saving; }
+
 private:
-    void capture_loop();
+    void start_stages();
+    void stop_stages();
+    void convert_loop();
+    void video_encode_loop();
+    void audio_encode_loop();
+    void mux_loop();
     void process_video_frame(const Frame& frame);
     void process_audio_sample(const AudioSample& sample);
+    void queue_encoded_packet(EncodedPacket& packet);
+    void write_encoded_packet(EncodedPacket& packet);
+    bool write_replay(const std::string& path, std::vector<EncodedPacket>& packets) const;
 
     CaptureSettings m_settings;
     std::unique_ptr<VideoCapture> m_video_capture;
     std::unique_ptr<AudioCapture> m_audio_capture;
-    std::unique_ptr<Encoder> m_encoder;
-    std::unique_ptr<FileWriter> m_file_writer;
-    std::unique_ptr<MP4Writer> m_mp4_writer;
+    std::unique_ptr<VideoEncoder> m_video_encoder;
+    std::unique_ptr<AudioEncoder> m_audio_encoder;  // Null without audio capture
+    std::unique_ptr<SegmentWriter> m_segment_writer;  // Null in replay buffer mode
+    std::unique_ptr<ReplayBuffer> m_replay_buffer;
+    VideoStreamInfo m_video_stream_info;
+    int m_audio_sample_rate = 44100;
+    int m_audio_channels = 2;
 
-    std::thread m_capture_thread;
     std::atomic<bool> m_is_capturing{false};
     std::atomic<bool> m_should_stop{false};
 
-    mutable Stats m_stats;
+    // Stages, each on its own thread with a bounded input queue:
+    //   source -> convert -> video encode -> mux
+    //   source ------------> audio encode -> mux
+    std::unique_ptr<StageQueue<Frame>> m_video_queue;
+    std::unique_ptr<StageQueue<ConvertedFrame>> m_picture_queue;
+    std::unique_ptr<RingQueue<ConvertedFrame>> m_picture_pool;  // Encoded pictures handed back for reuse
+    std::unique_ptr<StageQueue<AudioSample>> m_audio_queue;
+    std::unique_ptr<StageQueue<EncodedPacket>> m_mux_queue;
+    std::thread m_convert_thread;
+    std::thread m_video_encode_thread;
+    std::thread m_audio_encode_thread;
+    std::thread m_mux_thread;
+    StageMeter m_convert_meter;
+    StageMeter m_video_encode_meter;
+    StageMeter m_audio_encode_meter;
+    StageMeter m_mux_meter;
+    RateController m_rate_controller;
+    bool m_adaptive_speed = false;
+
+    std::atomic<uint64_t> m_frames_received{0};  // Frames delivered by the source
+    std::atomic<uint64_t> m_frames_written{0};
+    std::atomic<uint64_t> m_frames_failed{0};    // Frames lost to conversion, encode or mux errors
+    std::atomic<uint64_t> m_queue_overflows{0};
+    std::atomic<uint64_t> m_frames_skipped{0};
+    std::atomic<bool> m_tail_skipped{false};  // Last frame seen was a repeat that was not encoded
+    mutable std::mutex m_preview_mutex;
+    Frame m_preview_frame{};
+    uint64_t m_audio_frame_count = 0;  // Audio packets written
+
+    std::mutex m_replay_mutex;
+    std::thread m_replay_thread;
+    std::atomic<bool> m_replay_saving{false};
+    std::atomic<uint64_t> m_replays_saved{0};
+
+    // The window current_fps and cpu_usage are measured over
+    struct StatsWindow {
+        std::chrono::steady_clock::time_point time;
+        uint64_t frames = 0;
+        double cpu_seconds = 0.0;
+        double fps = 0.0;
+        double cpu_usage = 0.0;
+    };
+
+    // Serializes get_stats() and guards what it keeps between calls
+    mutable std::mutex m_stats_mutex;
+    mutable StatsWindow m_stats_window;
+    mutable uint64_t m_stats_sequence = 0;
+    double m_start_cpu_seconds = 0.0;
+    ThreadCpuClock m_capture_cpu;  // The source's thread, bound on its first frame
+
     TimeStamp m_start_time;
 };
 
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "common.h"
+#include <cstdint>
+
+namespace playrec {
+
+// Packed RGB to 4:2:0 conversion kernels (BT.709, limited range).
+//
+// Every instruction set produces output identical to the scalar kernel:
+// luma and chroma use the same 8-bit fixed-point coefficients, and chroma
+// is taken from the rounded average of each 2x2 block. Odd widths and
+// heights replicate the last column and row.
+enum class ColorKernelIsa {
+    SCALAR,
+    SSE41,
+    AVX2,
+    AVX512
+};
+
+// Convert a packed RGB image. dst holds the Y, U and V planes for YUV420P,
+// or the Y and interleaved UV planes for NV12 (dst[2] is unused).
+using ColorKernel = void (*)(const uint8_t* src, int src_stride, int width, int height,
+                             uint8_t* const dst[3], const int dst_stride[3]);
+
+// Fastest instruction set supported by this CPU and build
+ColorKernelIsa detect_color_kernel_isa();
+
+// Kernel for src -> dst with the given instruction set, or the best one the
+// CPU supports if isa is omitted. Returns nullptr if the pair has no kernel
+// or the instruction set is not available.
+ColorKernel get_color_kernel(VideoFormat src, VideoFormat dst);
+ColorKernel get_color_kernel(VideoFormat src, VideoFormat dst, ColorKernelIsa isa);
+
+const char* color_kernel_isa_name(ColorKernelIsa isa);
+
+} // namespace playrec
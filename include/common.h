@@ -4,6 +4,8 @@
 #include <memory>
 #include <vector>
 #include <chrono>
+#include <cstdint>
+#include <cstddef>
 
 namespace playrec {
 
@@ -17,7 +19,8 @@ enum class VideoFormat {
     RGBA32,
     BGR24,
     BGRA32,
-    YUV420P
+    YUV420P,
+    NV12          // Y plane followed by interleaved UV
 };
 
 // Audio format
@@ -28,6 +31,14 @@ enum class AudioFormat {
     PCM_F32LE
 };
 
+// Compressed video formats the encoders can produce
+enum class VideoCodec {
+    H264,
+    HEVC,
+    AV1,
+    VP9
+};
+
 // Capture quality settings
 enum class Quality {
     LOW,
@@ -36,13 +47,62 @@ enum class Quality {
     ULTRA
 };
 
+// What to discard when a bounded frame queue is full
+enum class DropPolicy {
+    DROP_OLDEST,
+    DROP_NEWEST,
+    BLOCK         // Make the source wait instead (offline input, benchmarks)
+};
+
+// Reference-counted, 64-byte aligned pixel buffer.
+// Copies share the same storage, so a frame can be handed from capture to
+// encode to preview without copying pixels. Storage handed out by a
+// FramePool returns to it when the last reference goes away.
+class FrameBuffer {
+public:
+    struct Storage {
+        uint8_t* data = nullptr;
+        size_t capacity = 0;
+    };
+
+    FrameBuffer() = default;
+    explicit FrameBuffer(size_t size);
+    FrameBuffer(std::shared_ptr<Storage> storage, size_t size)
+        : m_storage(std::move(storage)), m_size(size) {}
+
+    uint8_t* data() { return m_storage ? m_storage->data : nullptr; }
+    const uint8_t* data() const { return m_storage ? m_storage->data : nullptr; }
+    size_t size() const { return m_size; }
+    size_t capacity() const { return m_storage ? m_storage->capacity : 0; }
+    bool empty() const { return m_size == 0; }
+
+    // Grow or shrink the visible size. Reallocates (keeping the contents)
+    // only when the capacity is too small or the storage is shared.
+    void resize(size_t size);
+
+    // Drop this reference to the storage
+    void reset() { m_storage.reset(); m_size = 0; }
+
+    // Number of buffers sharing this storage
+    long use_count() const { return m_storage.use_count(); }
+
+    uint8_t& operator[](size_t index) { return m_storage->data[index]; }
+    const uint8_t& operator[](size_t index) const { return m_storage->data[index]; }
+
+private:
+    std::shared_ptr<Storage> m_storage;
+    size_t m_size = 0;
+};
+
 // Frame data structure
 struct Frame {
-    std::vector<uint8_t> data;
+    FrameBuffer data;
     int width;
     int height;
+    int stride = 0;       // Bytes per row of the first plane (0 = tightly packed)
     VideoFormat format;
     TimeStamp timestamp;
+    bool repeat = false;  // Content is identical to the previous frame
 };
 
 // Audio sample structure
@@ -64,6 +124,7 @@ struct CaptureSettings {
     std::string videoCodec = "H.264";
     Quality quality = Quality::HIGH;
     bool capture_cursor = true;
+    unsigned long capture_window = 0;  // X11 window to capture (0 = whole screen)
     
     // Audio settings
     bool capture_audio = true;
@@ -71,15 +132,36 @@ struct CaptureSettings {
     int audioBitrate = 128000; // in bps
     int channels = 2;
     int audioQuality = 80;
+    std::string audio_device = "default";   // ALSA PCM name, e.g. hw:Loopback,1
+    int audio_period_frames = 480;          // Device read size (10 ms at 48 kHz)
     
     // Output settings
     std::string outputDirectory = ".";
     std::string filenameFormat = "PlayRec_%Y%m%d_%H%M%S";
     std::string output_path = "capture.mp4";
     
+    // Pipeline settings
+    int frame_queue_depth = 8;  // Frames buffered between capture and encode
+    DropPolicy drop_policy = DropPolicy::DROP_OLDEST;
+    bool simd_color_convert = true;  // Vectorized RGB->YUV kernels instead of swscale
+    bool variable_frame_rate = true; // Stamp from the capture clock and skip unchanged frames
+    int encoder_threads = 0;         // 0 = chosen from the core count and resolution
+    double replay_buffer_seconds = 0.0;  // Keep this much in memory instead of recording (0 = record to output_path)
+    int replay_buffer_mb = 512;          // Memory the replay buffer may hold
+    double segment_minutes = 0.0;        // Start a new file after this long (0 = one file)
+    int segment_mb = 0;                  // or after this much encoded data
+    double fragment_seconds = 0.0;       // Fragmented MP4 with fragments this long (0 = classic MP4)
+    int io_buffer_kb = 256;              // Muxer's AVIO buffer
+    int write_behind_mb = 64;            // Output queued for the disk before muxing waits
+    bool direct_io = false;              // O_DIRECT output (Linux)
+    int preallocate_mb = 0;              // Disk space reserved per output file
+    bool adaptive_encoder_speed = true;  // Step to cheaper presets when encoding falls behind
+    std::string trace_path;              // Chrome trace of per-frame pipeline spans, written on stop (empty = off)
+    double encode_latency_target_ms = 250.0;  // Encoder delay allowed before frame threading gives way to slices
+    
     // Legacy compatibility - synchronized with encoder
     int target_fps = 30;  // Match encoder framerate setting
-    std::string codec = "h264";
+    std::string codec = "h264";  // Encoder backend name, see encoder_backends()
 };
 
 } // namespace playrec
\ No newline at end of file
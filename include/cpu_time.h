@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <time.h>
+#endif
+
+namespace playrec {
+
+// CPU time used by one thread, readable from any other.
+//
+// The thread binds itself once; readers then sample its CPU clock. The
+// last reading is kept, so the total survives the thread exiting. Reports
+// 0 where per-thread clocks are not available (everywhere but Linux).
+class ThreadCpuClock {
+public:
+    // Call on the thread to be measured
+    void bind_current_thread() {
+#ifdef __linux__
+        clockid_t clock;
+        if (pthread_getcpuclockid(pthread_self(), &clock) == 0) {
+            m_clock.store(static_cast<int64_t>(clock), std::memory_order_release);
+            m_bound.store(true, std::memory_order_release);
+        }
+#endif
+    }
+
+    // Call on the same thread as it finishes
+    void unbind() {
+        cpu_ms();
+        m_bound.store(false, std::memory_order_release);
+    }
+
+    bool bound() const { return m_bound.load(std::memory_order_acquire); }
+
+    double cpu_ms() const {
+#ifdef __linux__
+        if (m_bound.load(std::memory_order_acquire)) {
+            struct timespec now {};
+            auto clock = static_cast<clockid_t>(m_clock.load(std::memory_order_acquire));
+            if (clock_gettime(clock, &now) == 0) {
+                m_last_ns.store(static_cast<uint64_t>(now.tv_sec) * 1000000000ull + now.tv_nsec,
+                                std::memory_order_relaxed);
+            }
+        }
+#endif
+        return m_last_ns.load(std::memory_order_relaxed) / 1e6;
+    }
+
+    void reset() {
+        m_bound.store(false, std::memory_order_release);
+        m_last_ns.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<bool> m_bound{false};
+    std::atomic<int64_t> m_clock{0};
+    mutable std::atomic<uint64_t> m_last_ns{0};
+};
+
+} // namespace playrec
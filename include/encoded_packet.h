@@ -0,0 +1,74 @@
+#pragma once
+
+#include "common.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+struct AVPacket;
+
+namespace playrec {
+
+enum class StreamType {
+    VIDEO,
+    AUDIO
+};
+
+// What a container needs to know about an encoded video stream
+struct VideoStreamInfo {
+    VideoCodec codec = VideoCodec::H264;
+    int width = 0;
+    int height = 0;
+    int64_t bit_rate = 0;
+    std::vector<uint8_t> extradata;  // Codec global header (parameter sets, sequence header)
+    bool parameter_sets_in_band = false;  // They may change mid-stream, so samples repeat them
+};
+
+// Owning, move-only handle to a refcounted AVPacket straight from the
+// encoder. The packet keeps the codec's pts/dts, duration, key flag and
+// time base (AVPacket::time_base), and its payload is never copied: the
+// muxer writes it by reference, and a consumer that needs to hold on to
+// it (a queue, a replay buffer) moves the handle out.
+class EncodedPacket {
+public:
+    EncodedPacket() = default;
+    explicit EncodedPacket(AVPacket* packet);  // Takes ownership
+    ~EncodedPacket();
+
+    EncodedPacket(EncodedPacket&& other) noexcept;
+    EncodedPacket& operator=(EncodedPacket&& other) noexcept;
+    EncodedPacket(const EncodedPacket&) = delete;
+    EncodedPacket& operator=(const EncodedPacket&) = delete;
+
+    // New empty packet, or an empty handle if allocation fails
+    static EncodedPacket allocate();
+
+    // New reference to the same payload (no copy of the data)
+    EncodedPacket ref() const;
+
+    AVPacket* get() const { return m_packet; }
+    explicit operator bool() const { return m_packet != nullptr; }
+
+    // Give up ownership without freeing
+    AVPacket* release();
+
+    // Payload accessors; zero/false for an empty handle
+    const uint8_t* data() const;
+    size_t size() const;
+    int64_t pts() const;
+    int64_t dts() const;
+    bool is_keyframe() const;
+
+    StreamType stream = StreamType::VIDEO;
+
+private:
+    AVPacket* m_packet = nullptr;
+};
+
+// Receives each packet as it leaves the encoder. The packet may be
+// consumed in place or moved out; whatever is left is released after the
+// call returns.
+using PacketCallback = std::function<void(EncodedPacket& packet)>;
+
+} // namespace playrec
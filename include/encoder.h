@@ -1,79 +1,223 @@
 #pragma once
 
 #include "common.h"
+#include "video_converter.h"
+#include "encoded_packet.h"
+#include <memory>
+#include <string>
 #include <vector>
 
 namespace playrec {
 
+// What the video and audio encoders share: where packets go and the
+// capture clock they stamp against. Each encoder owns its codec context,
+// frame and packet, so the two can run on different threads.
 class Encoder {
 public:
     Encoder();
     virtual ~Encoder();
 
-    // Initialize encoder with settings
-    virtual bool initialize(const CaptureSettings& settings, 
-                          int video_width, int video_height,
-                          AudioFormat audio_format, int sample_rate, int channels) = 0;
-
-    // Encode a video frame
-    virtual std::vector<uint8_t> encode_video_frame(const Frame& frame) = 0;
+    // Where encoded packets go; set before the first encode call
+    void set_packet_callback(PacketCallback callback);
 
-    // Encode an audio sample
-    virtual std::vector<uint8_t> encode_audio_sample(const AudioSample& sample) = 0;
+    // Capture-clock instant that maps to PTS 0. Frame and sample timestamps
+    // are stamped relative to it; if unset, the first one seen is used, so
+    // give the video and audio encoders the same origin before encoding.
+    void set_time_origin(TimeStamp origin);
 
-    // Finalize encoding (flush remaining data)
-    virtual std::vector<uint8_t> finalize() = 0;
+    // Finalize encoding (flush remaining packets)
+    virtual bool finalize() = 0;
 
     // Get encoder info
     virtual std::string get_codec_name() const = 0;
+
+protected:
+    // Whole ticks of 1/rate seconds from the time origin to t, never negative
+    int64_t clock_ticks(TimeStamp t, int64_t rate);
+
+    PacketCallback m_packet_callback;
+    TimeStamp m_time_origin{};
+};
+
+// How an encoder spreads its work over threads
+enum class EncoderThreading {
+    NONE,
+    FRAME,      // Several frames in flight (x264, x265)
+    SLICE,      // Slices of one frame in parallel (OpenH264)
+    INTERNAL    // The library runs its own pool (SVT-AV1, libvpx row-mt)
+};
+
+// Threading a video encoder is opened with
+struct EncoderThreadingPlan {
+    EncoderThreading mode = EncoderThreading::NONE;
+    int threads = 1;
+    int frames_in_flight = 1;       // Frames held back by frame threading
+    int slices = 0;                 // Slices per frame (slice mode)
+    double latency_target_ms = 0.0;
+    bool automatic = true;          // Thread count chosen from the core count
+};
+
+// One step along the encoder speed ladder, taken while recording
+struct SpeedAdjustment {
+    uint64_t frame = 0;         // Frames submitted before the change
+    int from_level = 0;
+    int to_level = 0;
+    std::string setting;        // New preset and CRF, e.g. "veryfast crf 28"
+    bool swapped = false;       // A new encoder instance rather than reconfiguration
+    std::string reason;
+};
+
+class VideoEncoder : public Encoder {
+public:
+    // Threading in use, and the delay from submitting a frame to receiving
+    // its packet
+    struct EncodeStats {
+        EncoderThreadingPlan threading;
+        uint64_t frames = 0;
+        double p50_latency_ms = 0.0;
+        double p95_latency_ms = 0.0;
+        double p99_latency_ms = 0.0;
+        int speed_level = 0;
+        std::vector<SpeedAdjustment> adjustments;
+    };
+
+    // Initialize encoder with settings
+    virtual bool initialize(const CaptureSettings& settings, int video_width, int video_height) = 0;
+
+    // Encode a video frame, emitting any finished packets
+    virtual bool encode_video_frame(const Frame& frame) = 0;
+
+    // The same in two steps, so conversion and encoding can run on separate
+    // threads. convert_video_frame fills (or allocates) converted, which is
+    // then handed to encode_converted_frame and may be reused afterwards.
+    virtual bool convert_video_frame(const Frame& frame, ConvertedFrame& converted) = 0;
+    virtual bool encode_converted_frame(ConvertedFrame& converted) = 0;
+
     virtual bool supports_hardware_acceleration() const = 0;
+
+    // Codec and global header for the container; valid after initialize
+    virtual VideoStreamInfo stream_info() const = 0;
+
+    // Get color conversion timing
+    virtual VideoConverter::Stats get_convert_stats() const = 0;
+
+    // Speed ladder: level 0 is the configured preset and higher levels
+    // are cheaper. A requested level takes effect at the next GOP boundary,
+    // by reconfiguring the encoder where the library allows it and by
+    // flushing it and opening a new one where it does not. Request from
+    // the thread that encodes. The requested level falls back to the
+    // current one when a change fails.
+    virtual int speed_levels() const = 0;
+    virtual int speed_level() const = 0;
+    virtual int requested_speed_level() const = 0;
+    virtual void request_speed_level(int level, const std::string& reason) = 0;
+
+    // Make the next frame submitted an IDR frame. Safe to call from any
+    // thread, e.g. the muxer starting a new file.
+    virtual void request_keyframe() = 0;
+
+    virtual EncodeStats get_encode_stats() const = 0;
 };
 
-// H.264 encoder implementation
-class H264Encoder : public Encoder {
+// AAC encoder for captured 16-bit PCM
+class AudioEncoder : public Encoder {
 public:
-    H264Encoder();
-    ~H264Encoder() override;
+    AudioEncoder();
+    ~AudioEncoder() override;
 
-    bool initialize(const CaptureSettings& settings,
-                   int video_width, int video_height,
-                   AudioFormat audio_format, int sample_rate, int channels) override;
+    bool initialize(const CaptureSettings& settings, AudioFormat audio_format, int sample_rate, int channels);
 
-    std::vector<uint8_t> encode_video_frame(const Frame& frame) override;
-    std::vector<uint8_t> encode_audio_sample(const AudioSample& sample) override;
-    std::vector<uint8_t> finalize() override;
+    // Encode an audio sample, emitting any finished packets
+    bool encode_audio_sample(const AudioSample& sample);
+    bool finalize() override;
 
-    std::string get_codec_name() const override { return "H.264"; }
-    bool supports_hardware_acceleration() const override;
+    std::string get_codec_name() const override { return "AAC"; }
 
 private:
+    // Pad a hole in the input with silence, if it is too long to be jitter
+    bool fill_gap(int64_t gap, int chunk_samples);
+
     struct Impl;
     std::unique_ptr<Impl> m_impl;
 };
 
-// H.265/HEVC encoder implementation
-class H265Encoder : public Encoder {
+// A video encoder library reached through FFmpeg. The build may or may not
+// include it; probe_encoder_backend() says which.
+struct EncoderBackend {
+    std::string name;           // --codec / CaptureSettings::codec value
+    std::string display_name;
+    VideoCodec codec;
+    std::string library;        // FFmpeg encoder name
+    std::string realtime_preset;  // Preset used for live capture, empty if none
+};
+
+// What the linked FFmpeg reports for a backend
+struct EncoderCapabilities {
+    bool available = false;
+    std::vector<std::string> pixel_formats;  // Input formats it accepts
+    EncoderThreading threading = EncoderThreading::NONE;
+    bool hardware_variant = false;           // A GPU encoder for the same codec exists
+};
+
+// Every known backend in the order they are offered, available or not
+const std::vector<EncoderBackend>& encoder_backends();
+
+// Backend for a codec name (or one of its aliases), or nullptr
+const EncoderBackend* find_encoder_backend(const std::string& name);
+
+EncoderCapabilities probe_encoder_backend(const EncoderBackend& backend);
+
+const char* encoder_threading_name(EncoderThreading threading);
+
+// Threading for a backend at a frame size and rate. Frame threading keeps
+// the most cores busy but delays output by the frames in flight; when that
+// delay would exceed settings.encode_latency_target_ms the plan uses slices,
+// or the library's own intra-frame threading, instead. settings
+// .encoder_threads overrides the thread count; cores = 0 asks the system.
+EncoderThreadingPlan plan_encoder_threading(const EncoderBackend& backend, const CaptureSettings& settings,
+                                            int height, unsigned cores = 0);
+
+// e.g. "frame, 8 threads, 7 frames in flight"
+std::string describe_threading(const EncoderThreadingPlan& plan);
+
+// Video encoder for any registered backend. Output is YUV420P from the
+// capture converter; backend-specific options are mapped from the settings.
+class FFmpegVideoEncoder : public VideoEncoder {
 public:
-    H265Encoder();
-    ~H265Encoder() override;
+    explicit FFmpegVideoEncoder(const EncoderBackend& backend);
+    ~FFmpegVideoEncoder() override;
 
-    bool initialize(const CaptureSettings& settings,
-                   int video_width, int video_height,
-                   AudioFormat audio_format, int sample_rate, int channels) override;
+    bool initialize(const CaptureSettings& settings, int video_width, int video_height) override;
 
-    std::vector<uint8_t> encode_video_frame(const Frame& frame) override;
-    std::vector<uint8_t> encode_audio_sample(const AudioSample& sample) override;
-    std::vector<uint8_t> finalize() override;
+    bool encode_video_frame(const Frame& frame) override;
+    bool convert_video_frame(const Frame& frame, ConvertedFrame& converted) override;
+    bool encode_converted_frame(ConvertedFrame& converted) override;
+    bool finalize() override;
 
-    std::string get_codec_name() const override { return "H.265/HEVC"; }
+    std::string get_codec_name() const override;
     bool supports_hardware_acceleration() const override;
+    VideoStreamInfo stream_info() const override;
+    VideoConverter::Stats get_convert_stats() const override;
+    int speed_levels() const override;
+    int speed_level() const override;
+    int requested_speed_level() const override;
+    void request_speed_level(int level, const std::string& reason) override;
+    void request_keyframe() override;
+    EncodeStats get_encode_stats() const override;
 
 private:
+    // Move to the pending speed level; called at a GOP boundary
+    bool change_speed_level();
+
+    // Packet callback that records each frame's encode latency on the way
+    PacketCallback timed_callback();
+
     struct Impl;
     std::unique_ptr<Impl> m_impl;
 };
 
-// Factory function
-std::unique_ptr<Encoder> create_encoder(const std::string& codec_name = "h264");
+// Factory functions. An unknown codec name falls back to H.264.
+std::unique_ptr<VideoEncoder> create_video_encoder(const std::string& codec_name = "h264");
+std::unique_ptr<AudioEncoder> create_audio_encoder();
 
 } // namespace playrec
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "video_capture.h"
+#include <cstdio>
+#include <memory>
+#include <string>
+
+namespace playrec {
+
+// Describes headerless video input; .y4m files carry their own
+struct RawVideoFormat {
+    VideoFormat format = VideoFormat::BGRA32;
+    int width = 0;
+    int height = 0;
+    int fps_num = 30;
+    int fps_den = 1;
+};
+
+// Replays raw video from a file through the capture pipeline, for offline
+// encoding and for reproducing problems with recorded footage.
+//
+// Reads YUV4MPEG2 (.y4m, 4:2:0 only) or headerless raw frames of a given
+// format, size and rate. Regular files are memory-mapped and each frame is
+// handed on as a view of the mapping, without a copy; inputs that cannot
+// be mapped (pipes) are read sequentially in frame-sized blocks instead.
+// Frames are stamped at the file's rate, starting when capture starts, and
+// go out either paced to that rate or as fast as the consumer takes them
+// (pair with DropPolicy::BLOCK). The source goes inactive at end of file.
+class FileVideoCapture : public VideoCapture {
+public:
+    explicit FileVideoCapture(std::string path, RawVideoFormat raw = RawVideoFormat{}, bool realtime = false);
+    ~FileVideoCapture() override;
+
+    // Open the file and read its format; initialize() calls this if needed
+    bool open();
+
+    bool initialize(const CaptureSettings& settings) override;
+    bool start() override;
+    void stop() override;
+    std::pair<int, int> get_resolution() const override;
+    bool is_active() const override;
+
+    double frame_rate() const;
+    VideoFormat format() const { return m_format.format; }
+
+    // Whole frames in the file, or 0 when unknown (pipes)
+    uint64_t frame_count() const { return m_frame_count; }
+    uint64_t frames_emitted() const { return m_frames_emitted; }
+
+private:
+    struct Mapping;
+
+    bool parse_y4m_header(const std::string& header);
+    bool next_frame(Frame& frame);
+    void replay_loop();
+
+    std::string m_path;
+    RawVideoFormat m_format;
+    bool m_realtime = false;
+    bool m_is_y4m = false;
+    bool m_opened = false;
+    size_t m_frame_size = 0;
+    uint64_t m_frame_count = 0;
+
+    // Mapped input, or a buffered stream when mapping is not possible
+    std::shared_ptr<Mapping> m_mapping;
+    size_t m_offset = 0;
+    FILE* m_stream = nullptr;
+
+    TimeStamp m_start_time{};
+    std::thread m_thread;
+    std::atomic<bool> m_should_stop{false};
+    std::atomic<bool> m_is_active{false};
+    std::atomic<uint64_t> m_frames_emitted{0};
+};
+
+} // namespace playrec
@@ -1,40 +1,101 @@
 #pragma once
 
+#include "encoded_packet.h"
+#include "stage_queue.h"
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
-#include <fstream>
 
 namespace playrec {
 
+// Buffering and disk options for FileWriter
+struct FileWriterOptions {
+    size_t chunk_bytes = 4 << 20;           // Rounded up to the direct I/O alignment
+    size_t memory_cap_bytes = 64 << 20;     // Queued chunks at which write() waits
+    bool direct_io = false;                 // Linux only; ignored where unsupported
+    uint64_t preallocate_bytes = 0;         // Reserve disk space up front (Linux)
+};
+
+// Write-behind file output.
+//
+// write() copies into large aligned chunks and hands each full chunk to a
+// dedicated I/O thread, which writes it at its file offset. A slow disk or
+// a writeback storm therefore stalls only that thread; callers block only
+// once the chunks waiting for the disk reach the memory cap. With
+// direct_io, whole aligned chunks bypass the page cache (O_DIRECT) and
+// anything unaligned goes through it as usual. Write from one thread;
+// stats may be read from any.
 class FileWriter {
 public:
+    struct Stats {
+        uint64_t bytes_written = 0;     // Handed to the OS
+        uint64_t bytes_queued = 0;      // Accepted, not yet written
+        uint64_t writes = 0;            // Write calls made by the I/O thread
+        uint64_t direct_writes = 0;     // Of those, through O_DIRECT
+        double bytes_per_second = 0.0;  // Since open
+        double writes_per_second = 0.0;
+        StageStats io;                  // Per-chunk write time; blocked_ms is time callers waited at the cap
+    };
+
     FileWriter();
     ~FileWriter();
 
     // Open file for writing
-    bool open(const std::string& filename);
+    bool open(const std::string& filename, const FileWriterOptions& options = FileWriterOptions{});
 
-    // Close file
-    void close();
+    // Write out everything accepted and close the file. Returns false if
+    // any of it failed to reach the file.
+    bool close();
 
     // Write data to file
     bool write(const std::vector<uint8_t>& data);
 
-    // Write raw data
+    // Write raw data. Returns false once an earlier write has failed.
     bool write(const uint8_t* data, size_t size);
 
-    // Get current file size
+    // Move the write position, e.g. to patch a header written earlier
+    bool seek(uint64_t offset);
+    uint64_t tell() const;
+
+    // Get current file size (bytes accepted so far). Safe from any thread.
     uint64_t get_file_size() const;
 
     // Check if file is open
     bool is_open() const;
 
-    // Flush data to disk
+    // Hand over the partly filled chunk and wait until everything accepted
+    // so far has reached the OS
     void flush();
 
+    // Hand over the partly filled chunk without waiting for the write
+    void submit();
+
+    Stats get_stats() const;
+
 private:
-    std::ofstream m_file;
-    uint64_t m_bytes_written = 0;
+    struct Chunk;
+    struct IoState;
+
+    // Queue the chunk being filled for the I/O thread
+    void submit_chunk();
+
+    std::unique_ptr<IoState> m_io;
+};
+
+// How MP4Writer lays out the file
+struct MP4Options {
+    // Fragmented MP4 (fMP4/CMAF style): an empty moov up front, then a
+    // self-contained moof + mdat per fragment, each starting at the first
+    // keyframe after this many seconds. Muxer memory stays bounded, every
+    // finished fragment survives a crash and finalize has nothing left to
+    // index. 0 = classic MP4 with the index written at the end.
+    double fragment_seconds = 0.0;
+
+    // The muxer writes through an AVIO buffer of this size into a
+    // FileWriter opened with these options
+    size_t io_buffer_bytes = 256 << 10;
+    FileWriterOptions file;
 };
 
 // MP4 container writer
@@ -43,16 +104,16 @@ public:
     MP4Writer();
     ~MP4Writer();
 
-    // Initialize MP4 container with video/audio parameters
+    // Initialize MP4 container with video/audio parameters. The video
+    // track takes its codec and global header from the encoder.
     bool initialize(const std::string& filename,
-                   int video_width, int video_height, int fps,
-                   int audio_sample_rate, int audio_channels);
-
-    // Write video packet
-    bool write_video_packet(const std::vector<uint8_t>& packet, uint64_t timestamp_ms);
+                   const VideoStreamInfo& video, int fps,
+                   int audio_sample_rate, int audio_channels,
+                   const MP4Options& options = MP4Options{});
 
-    // Write audio packet  
-    bool write_audio_packet(const std::vector<uint8_t>& packet, uint64_t timestamp_ms);
+    // Write an encoded packet to its stream. The payload is passed to the
+    // muxer by reference and the packet is left empty on success.
+    bool write_packet(EncodedPacket& packet);
 
     // Finalize and close MP4 file
     bool finalize();
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "latency_histogram.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace playrec {
+
+// Wakes a periodic loop once per tick, on a fixed grid of absolute
+// deadlines (origin + n * period).
+//
+// Each deadline is computed from the tick number rather than from the
+// previous wakeup, so late wakeups never push later ones back and the
+// loop cannot drift. On Linux the sleep is clock_nanosleep(TIMER_ABSTIME)
+// on CLOCK_MONOTONIC; elsewhere sleep_until() on the steady clock. How
+// late each wakeup is gets recorded, and get_stats() may be called from
+// any thread. Everything else belongs to the thread running the loop.
+class FramePacer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        uint64_t ticks = 0;
+        uint64_t missed = 0;            // Ticks skipped because the loop overran them
+        double late_p50_ms = 0.0;       // Wakeup past its deadline
+        double late_p99_ms = 0.0;
+        double max_late_ms = 0.0;
+        double jitter_ms = 0.0;         // Spread of the lateness, p99 - p50
+        double drift_ms = 0.0;          // Latest wakeup against its place on the grid
+    };
+
+    FramePacer() = default;
+    explicit FramePacer(double rate_hz) { set_rate(rate_hz); }
+
+    // Take effect at the next start()
+    void set_rate(double rate_hz);
+    void set_period(std::chrono::nanoseconds period);
+    std::chrono::nanoseconds period() const { return m_period; }
+
+    // Restart the grid with tick 0 due now, and clear the stats
+    void start();
+
+    // Sleep until the next tick and return its number. When the loop has
+    // fallen a whole period or more behind, the ticks it missed are
+    // skipped rather than run back to back.
+    uint64_t wait();
+
+    // Sleep until the given tick, however late that already is; for
+    // sources that must produce every tick (file and synthetic input)
+    void wait_for(uint64_t tick);
+
+    Clock::time_point deadline(uint64_t tick) const { return m_origin + m_period * tick; }
+
+    Stats get_stats() const;
+
+private:
+    void sleep_until(Clock::time_point deadline);
+    void record_wakeup(Clock::time_point deadline, Clock::time_point woke);
+
+    std::chrono::nanoseconds m_period{std::chrono::nanoseconds(1000000000) / 30};
+    Clock::time_point m_origin{};
+    uint64_t m_next_tick = 0;
+
+    std::atomic<uint64_t> m_ticks{0};
+    std::atomic<uint64_t> m_missed{0};
+    std::atomic<uint64_t> m_max_late_us{0};
+    std::atomic<int64_t> m_drift_us{0};
+    LatencyHistogram m_lateness;
+};
+
+} // namespace playrec
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "common.h"
+#include <memory>
+
+namespace playrec {
+
+// Recycling allocator for frame buffers.
+//
+// acquire() hands out a FrameBuffer backed by a recycled aligned block when
+// one large enough is free (a hit) and allocates a new block otherwise (a
+// miss). Blocks come back automatically when the last FrameBuffer sharing
+// them is released, from any thread. Once the pool is warm, a capture loop
+// that keeps its frame count within the reserved buffers allocates nothing.
+class FramePool {
+public:
+    struct Stats {
+        uint64_t hits = 0;              // acquire() served from the free list
+        uint64_t misses = 0;            // acquire() that had to allocate
+        uint64_t buffers_allocated = 0; // Blocks currently owned by the pool
+        uint64_t buffers_in_use = 0;    // Blocks currently handed out
+        uint64_t bytes_allocated = 0;   // Bytes currently owned by the pool
+        uint64_t high_water_bytes = 0;  // Peak of bytes_allocated
+    };
+
+    FramePool();
+    ~FramePool();
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    // Size the pool for frames produced with these settings: one buffer per
+    // queued frame plus the ones held by capture, encode and preview.
+    void reserve(const CaptureSettings& settings, size_t buffer_size);
+
+    // Keep up to max_buffers blocks of at least buffer_size bytes ready
+    void reserve(size_t buffer_size, size_t max_buffers);
+
+    // Get a buffer of the requested size (contents are not cleared)
+    FrameBuffer acquire(size_t size);
+
+    Stats get_stats() const;
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> m_impl;
+};
+
+} // namespace playrec
@@ -5,12 +5,7 @@
 #include <QtCore/QWaitCondition>
 #include <QtGui/QImage>
 #include <memory>
-
-namespace playrec {
-    class CaptureEngine;
-    struct CaptureSettings;
-    struct Frame;
-}
+#include "capture_engine.h"
 
 class CaptureThread : public QThread
 {
@@ -25,6 +20,9 @@ public:
     void pauseCapture();
     void resumeCapture();
     
+    // Replay buffer mode: save what the buffer holds to path in the background
+    void saveReplay(const QString& path);
+    
     bool isCapturing() const;
     bool isPaused() const;
 
@@ -33,7 +31,8 @@ signals:
     void captureStopped();
     void captureError(const QString& error);
     void frameReady(const QImage& frame);
-    void statsUpdated(int fps, int frames, int dropped, qint64 fileSize);
+    void statsUpdated(const playrec::CaptureEngine::Stats& stats);
+    void replaySaved(const QString& path, bool ok);
 
 protected:
     void run() override;
@@ -52,9 +51,12 @@ private:
     bool m_capturing;
     bool m_paused;
     bool m_shouldStop;
+    QString m_replayPath;  // Save requested, picked up by the capture loop
     
     // Statistics
     int m_frameCount;
     int m_droppedFrames;
     qint64 m_startTime;
-};
\ No newline at end of file
+};
+
+Q_DECLARE_METATYPE(playrec::CaptureEngine::Stats)
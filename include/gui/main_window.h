@@ -20,17 +20,13 @@
 #include <QtMultimedia/QMediaPlayer>
 #include <QtMultimediaWidgets/QVideoWidget>
 #include <memory>
+#include "capture_engine.h"
 
 // Forward declarations
 class PreviewWidget;
 class SettingsDialog;
 class CaptureThread;
 
-namespace playrec {
-    class CaptureEngine;
-    struct CaptureSettings;
-}
-
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
@@ -47,10 +43,13 @@ private slots:
     void onSelectOutputFile();
     void onPreviewToggle(bool enabled);
     void onUpdateStats();
+    void onStatsUpdated(const playrec::CaptureEngine::Stats& stats);
     void onCaptureStarted();
     void onCaptureStopped();
     void onCaptureError(const QString& error);
     void onFrameCaptured(const QImage& frame);
+    void onSaveReplay();
+    void onReplaySaved(const QString& path, bool ok);
     
     // Replay functionality
     void onPlayRecording();
@@ -99,6 +98,7 @@ private:
     QPushButton* m_startButton;
     QPushButton* m_stopButton;
     QPushButton* m_pauseButton;
+    QPushButton* m_saveReplayButton;
     QPushButton* m_settingsButton;
     QPushButton* m_outputButton;
     QLabel* m_outputLabel;
@@ -110,6 +110,8 @@ private:
     QSpinBox* m_fpsSpinBox;
     QComboBox* m_qualityCombo;
     QCheckBox* m_audioCheckBox;
+    QCheckBox* m_replayBufferCheckBox;
+    QSpinBox* m_replaySecondsSpinBox;
     
     // Statistics
     QGroupBox* m_statsGroup;
@@ -120,6 +122,7 @@ private:
     QLabel* m_sizeLabel;
     QLabel* m_durationLabel;
     QProgressBar* m_cpuProgressBar;
+    QLabel* m_stagesLabel;
     
     // Log
     QGroupBox* m_logGroup;
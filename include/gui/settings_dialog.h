@@ -73,6 +73,7 @@ private:
     QCheckBox* m_cursorCheckBox;
     QSpinBox* m_bufferSizeSpinBox;
     QSpinBox* m_threadCountSpinBox;
+    QSpinBox* m_encodeLatencySpinBox;
     QLineEdit* m_customArgsLineEdit;
     
     // Buttons
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace playrec {
+
+// Lock-free latency histogram with log-spaced buckets.
+//
+// Values are microseconds. Below 16 us every value has its own bucket;
+// above that each power of two is split into 8 buckets, so any reported
+// percentile is within about 6% of the true value. record() may be called
+// from several threads while another reads percentiles.
+class LatencyHistogram {
+public:
+    void record(std::chrono::nanoseconds latency) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+        record_us(us > 0 ? static_cast<uint64_t>(us) : 0);
+    }
+
+    void record_us(uint64_t us) {
+        m_buckets[bucket_index(us)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+
+    // Value at or below which the given fraction (0..1) of samples fall, in
+    // milliseconds, reported as the midpoint of the bucket it lands in
+    double percentile_ms(double fraction) const {
+        uint64_t total = count();
+        if (total == 0) {
+            return 0.0;
+        }
+
+        auto rank = static_cast<uint64_t>(fraction * static_cast<double>(total - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            seen += m_buckets[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                return (bucket_low(i) + bucket_high(i)) / 2.0 / 1000.0;
+            }
+        }
+        return bucket_high(kBucketCount - 1) / 1000.0;
+    }
+
+    void reset() {
+        for (auto& bucket : m_buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        m_count.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr int kLinearLimit = 16;     // Values below this get one bucket each
+    static constexpr int kSubBucketBits = 3;    // 8 buckets per power of two above it
+    static constexpr int kMaxExponent = 40;     // ~12 days in microseconds
+    static constexpr size_t kBucketCount =
+        kLinearLimit + (kMaxExponent - 4 + 1) * (size_t{1} << kSubBucketBits);
+
+    static size_t bucket_index(uint64_t us) {
+        if (us < kLinearLimit) {
+            return static_cast<size_t>(us);
+        }
+        int exponent = 63 - __builtin_clzll(us);
+        if (exponent > kMaxExponent) {
+            return kBucketCount - 1;
+        }
+        auto sub = static_cast<size_t>((us >> (exponent - kSubBucketBits)) & ((1u << kSubBucketBits) - 1));
+        return kLinearLimit + static_cast<size_t>(exponent - 4) * (size_t{1} << kSubBucketBits) + sub;
+    }
+
+    static double bucket_low(size_t index) {
+        if (index < kLinearLimit) {
+            return static_cast<double>(index);
+        }
+        size_t offset = index - kLinearLimit;
+        int exponent = static_cast<int>(offset >> kSubBucketBits) + 4;
+        size_t sub = offset & ((size_t{1} << kSubBucketBits) - 1);
+        return static_cast<double>((uint64_t{1} << exponent) + (sub << (exponent - kSubBucketBits)));
+    }
+
+    static double bucket_high(size_t index) {
+        if (index < kLinearLimit) {
+            return static_cast<double>(index);
+        }
+        size_t offset = index - kLinearLimit;
+        int exponent = static_cast<int>(offset >> kSubBucketBits) + 4;
+        return bucket_low(index) + static_cast<double>(uint64_t{1} << (exponent - kSubBucketBits)) - 1.0;
+    }
+
+    std::array<std::atomic<uint64_t>, kBucketCount> m_buckets{};
+    std::atomic<uint64_t> m_count{0};
+};
+
+} // namespace playrec
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace playrec {
+
+// Closed-loop speed control for a realtime video encoder.
+//
+// Watches how long each frame takes to encode against the frame interval,
+// and how far the encoder's input queue backs up, and picks a level on the
+// encoder's speed ladder (0 = the configured preset, higher = cheaper).
+// Decisions are made once per window of frames; the encoder then applies
+// them at its next GOP boundary. It steps cheaper as soon as a window runs
+// over budget or the queue fills past half, but steps back up only after
+// several windows with ample headroom, and skips the window right after a
+// change while the encoder settles, so that it does not oscillate between
+// two levels.
+class RateController {
+public:
+    void configure(double frame_budget_ms, int window_frames, int levels, size_t queue_capacity);
+
+    // Record one encoded frame. Returns the level to move to, or -1 to
+    // stay where it is.
+    int on_frame(double encode_ms, size_t queue_depth);
+
+    int level() const { return m_level; }
+
+    // Adopt the level the encoder is really headed for, after it failed
+    // to apply the last one. A cheaper level it could not reach is not
+    // tried again.
+    void sync_level(int level);
+
+    // Why the last change was made, e.g. "encode 18.2 ms / 16.7 ms budget"
+    const char* last_reason() const { return m_reason; }
+
+private:
+    double m_budget_ms = 0.0;
+    int m_window_frames = 1;
+    int m_levels = 1;
+    size_t m_queue_capacity = 0;
+
+    int m_level = 0;
+    double m_average_ms = 0.0;      // Exponentially weighted encode time
+    bool m_primed = false;
+    int m_frames_in_window = 0;
+    size_t m_queue_high = 0;        // Deepest the queue got this window
+    int m_quiet_windows = 0;        // Consecutive windows with headroom to spare
+    bool m_settling = false;
+    char m_reason[96] = "";
+};
+
+} // namespace playrec
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "encoded_packet.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace playrec {
+
+// In-memory ring of the most recent encoded packets, for "save the last
+// N seconds" without recording to disk.
+//
+// Video and audio packets are held by reference (the payload is never
+// copied) in the order the muxer would have written them, with an index of
+// where each video keyframe sits. Whole GOPs are evicted from the front
+// once the second-oldest keyframe is already far enough back to cover the
+// window, or whenever the payload exceeds the memory budget. add() is
+// called from the mux stage; snapshot() may be called from any thread.
+class ReplayBuffer {
+public:
+    struct Stats {
+        size_t packets = 0;
+        size_t bytes = 0;               // Payload held
+        size_t keyframes = 0;
+        double seconds = 0.0;           // From the oldest keyframe to the newest video packet
+        uint64_t packets_evicted = 0;
+    };
+
+    ReplayBuffer(double window_seconds, size_t memory_budget_bytes);
+
+    // Take the packet (the handle is left empty)
+    void add(EncodedPacket& packet);
+
+    // New references to the last `seconds` of media (0 = all of it),
+    // starting at the keyframe at or just before that point. Timestamps are
+    // rebased so that keyframe is at 0; audio from before it is left out.
+    // Empty until the first keyframe arrives.
+    std::vector<EncodedPacket> snapshot(double seconds) const;
+
+    Stats get_stats() const;
+
+    double window_seconds() const { return m_window_seconds; }
+
+private:
+    struct Keyframe {
+        uint64_t sequence;  // Position in arrival order
+        double time;        // Seconds on the encoder clock
+    };
+
+    void evict_before(uint64_t sequence);
+
+    double m_window_seconds;
+    size_t m_budget_bytes;
+
+    mutable std::mutex m_mutex;
+    std::deque<EncodedPacket> m_packets;
+    std::deque<Keyframe> m_keyframes;
+    uint64_t m_front_sequence = 0;  // Sequence number of m_packets.front()
+    size_t m_bytes = 0;
+    double m_newest_time = 0.0;
+    uint64_t m_packets_evicted = 0;
+};
+
+} // namespace playrec
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace playrec {
+
+// Bounded lock-free ring buffer.
+//
+// Designed for one producer (a capture callback) and one consumer (an
+// encode thread). Every slot carries its own sequence number and both
+// indices advance by CAS, so the producer may also pop to evict the oldest
+// entry when the ring is full without racing the consumer, and several
+// producers may share one ring.
+template <typename T>
+class RingQueue {
+public:
+    explicit RingQueue(size_t capacity)
+        : m_capacity(capacity > 0 ? capacity : 1),
+          m_slots(std::make_unique<Slot[]>(m_capacity)) {
+        for (size_t i = 0; i < m_capacity; ++i) {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    RingQueue(const RingQueue&) = delete;
+    RingQueue& operator=(const RingQueue&) = delete;
+
+    // Push an item, returns false if the ring is full
+    bool try_push(T&& item) {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = m_slots[pos % m_capacity];
+            size_t seq = slot.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.value = std::move(item);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Pop the oldest item, returns false if the ring is empty
+    bool try_pop(T& item) {
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = m_slots[pos % m_capacity];
+            size_t seq = slot.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    item = std::move(slot.value);
+                    slot.value = T{};
+                    slot.sequence.store(pos + m_capacity, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Approximate number of queued items
+    size_t size() const {
+        size_t tail = m_tail.load(std::memory_order_acquire);
+        size_t head = m_head.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return m_capacity; }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence{0};
+        T value{};
+    };
+
+    size_t m_capacity;
+    std::unique_ptr<Slot[]> m_slots;
+
+    // Keep producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<size_t> m_head{0};
+    alignas(64) std::atomic<size_t> m_tail{0};
+};
+
+} // namespace playrec
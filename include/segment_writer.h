@@ -0,0 +1,108 @@
+#pragma once
+
+#include "file_writer.h"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace playrec {
+
+// When a recording moves on to a new file; 0 means no limit
+struct SegmentPolicy {
+    double max_seconds = 0.0;
+    uint64_t max_bytes = 0;     // Encoded payload, not counting the index
+
+    bool enabled() const { return max_seconds > 0.0 || max_bytes > 0; }
+};
+
+// MP4 output split into files that each play on their own.
+//
+// The first segment is written to the path given to initialize(); later
+// ones are named from a strftime() pattern (CaptureSettings::filenameFormat)
+// in the same directory. When the current segment reaches a limit the
+// writer asks for a keyframe and cuts at the next video keyframe it sees,
+// so every segment starts on an IDR frame while the encoder keeps running.
+// Timestamps are rebased to start each segment at 0. Audio encoded ahead of
+// the cut is held until it happens, and late audio from before the cut
+// still goes to the previous segment, which is then finalized on a
+// background thread. Write from one thread (the mux stage).
+class SegmentWriter {
+public:
+    // Asked for on the writing thread when a cut is due
+    using KeyframeRequest = std::function<void()>;
+
+    struct Stats {
+        uint64_t segments = 0;      // Started so far
+        uint64_t bytes = 0;         // Payload written across all segments
+        uint64_t file_bytes = 0;    // Size of all segment files, container included
+        uint64_t segments_failed = 0;   // Finalized with data missing (e.g. disk full)
+        std::string current_path;
+        FileWriter::Stats io;       // Output of the current segment
+    };
+
+    SegmentWriter(SegmentPolicy policy, std::string filename_format);
+    ~SegmentWriter();
+
+    bool initialize(const std::string& path, const VideoStreamInfo& video, int fps,
+                    int audio_sample_rate, int audio_channels, bool has_audio,
+                    const MP4Options& options = MP4Options{});
+
+    void set_keyframe_request(KeyframeRequest request);
+
+    // Takes the packet; held audio counts as written
+    bool write_packet(EncodedPacket& packet);
+
+    // Finish the current segment and wait for earlier ones
+    bool finalize();
+
+    Stats get_stats() const;
+
+private:
+    struct Segment {
+        std::unique_ptr<MP4Writer> writer;
+        std::string path;
+        int64_t start_us = 0;   // Encoder clock at its first keyframe
+        uint64_t bytes = 0;
+    };
+
+    bool open_segment(Segment& segment, const std::string& path, int64_t start_us);
+    bool write_to(Segment& segment, EncodedPacket& packet);
+    bool cut(int64_t cut_us);
+    void check_limits();
+    void finish_closing();
+    std::string next_path();
+
+    SegmentPolicy m_policy;
+    std::string m_filename_format;
+    std::string m_directory;
+    std::string m_last_name;
+    int m_name_repeats = 0;
+
+    VideoStreamInfo m_video;
+    int m_fps = 30;
+    int m_audio_sample_rate = 44100;
+    int m_audio_channels = 2;
+    bool m_has_audio = false;
+    MP4Options m_options;
+    KeyframeRequest m_keyframe_request;
+
+    Segment m_current;
+    Segment m_closing;              // Previous segment, still taking audio from before the cut
+    int64_t m_cut_us = 0;
+    int64_t m_newest_us = 0;        // Latest video timestamp written
+    bool m_cut_pending = false;     // Keyframe requested, waiting for it to arrive
+    const char* m_cut_reason = "";
+    std::deque<EncodedPacket> m_held_audio;
+    std::thread m_finalize_thread;
+
+    // Guards m_stats and swapping the segments' writers, which get_stats reads
+    mutable std::mutex m_stats_mutex;
+    Stats m_stats;
+    uint64_t m_finished_file_bytes = 0;     // Segments no longer written by this thread
+};
+
+} // namespace playrec
@@ -0,0 +1,217 @@
+#pragma once
+
+#include "cpu_time.h"
+#include "latency_histogram.h"
+#include "ring_queue.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+
+namespace playrec {
+
+// Occupancy and timing for one pipeline stage
+struct StageStats {
+    const char* name = "";
+    uint64_t items = 0;              // Items the stage has finished
+    double average_service_ms = 0.0; // Work per item, not counting waits on a full downstream queue
+    double p50_service_ms = 0.0;
+    double p95_service_ms = 0.0;
+    double p99_service_ms = 0.0;
+    double max_service_ms = 0.0;
+    double blocked_ms = 0.0;         // Total time spent waiting on a full downstream queue
+    double cpu_ms = 0.0;             // CPU time of the stage's thread (0 if not measured)
+    size_t queue_depth = 0;          // Items waiting in the stage's input queue
+    size_t queue_capacity = 0;
+    size_t queue_high_water = 0;
+};
+
+// Bounded queue feeding one pipeline stage.
+//
+// Producers at the head of the pipeline use try_push and apply their own
+// drop policy, since a capture source must never stall. Stages inside the
+// pipeline use push, which waits for room: a slow stage therefore fills
+// its input queue and holds up the stage before it, and the backpressure
+// ends at the head as drops. pop waits for work until the queue is closed
+// and drained. The ring itself is lock-free; the mutex only parks threads.
+template <typename T>
+class StageQueue {
+public:
+    explicit StageQueue(size_t capacity) : m_ring(capacity) {}
+
+    StageQueue(const StageQueue&) = delete;
+    StageQueue& operator=(const StageQueue&) = delete;
+
+    // Push without waiting, returns false if the queue is full or closed
+    bool try_push(T&& item) {
+        if (m_closed.load(std::memory_order_acquire) || !m_ring.try_push(std::move(item))) {
+            return false;
+        }
+        on_pushed();
+        return true;
+    }
+
+    // Wait for room, returns false if the queue was closed first
+    bool push(T&& item) {
+        if (try_push(std::move(item))) {
+            return true;
+        }
+
+        bool pushed = false;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_not_full.wait(lock, [&] {
+                if (m_closed.load(std::memory_order_acquire)) {
+                    return true;
+                }
+                pushed = m_ring.try_push(std::move(item));
+                return pushed;
+            });
+        }
+        if (!pushed) {
+            return false;
+        }
+        on_pushed();
+        return true;
+    }
+
+    // Pop without waiting, returns false if the queue is empty
+    bool try_pop(T& item) {
+        if (!m_ring.try_pop(item)) {
+            return false;
+        }
+        notify(m_not_full);
+        return true;
+    }
+
+    // Wait for an item, returns false once the queue is closed and empty
+    bool pop(T& item) {
+        for (;;) {
+            if (try_pop(item)) {
+                return true;
+            }
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_not_empty.wait(lock, [this] {
+                return m_closed.load(std::memory_order_acquire) || !m_ring.empty();
+            });
+            if (m_ring.empty()) {
+                return false;
+            }
+        }
+    }
+
+    // Refuse further pushes and wake every waiter. Items already queued can
+    // still be popped.
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed.store(true, std::memory_order_release);
+        }
+        m_not_full.notify_all();
+        m_not_empty.notify_all();
+    }
+
+    size_t size() const { return m_ring.size(); }
+    size_t capacity() const { return m_ring.capacity(); }
+    size_t high_water() const { return m_high_water.load(std::memory_order_relaxed); }
+
+private:
+    void on_pushed() {
+        size_t depth = m_ring.size();
+        size_t peak = m_high_water.load(std::memory_order_relaxed);
+        while (depth > peak && !m_high_water.compare_exchange_weak(peak, depth, std::memory_order_relaxed)) {
+        }
+        notify(m_not_empty);
+    }
+
+    void notify(std::condition_variable& condition) {
+        // Taking the lock orders the notify after the waiter's predicate check
+        { std::lock_guard<std::mutex> lock(m_mutex); }
+        condition.notify_all();
+    }
+
+    RingQueue<T> m_ring;
+    std::mutex m_mutex;
+    std::condition_variable m_not_full;
+    std::condition_variable m_not_empty;
+    std::atomic<bool> m_closed{false};
+    std::atomic<size_t> m_high_water{0};
+};
+
+// Service-time counters for a stage's worker thread. Written by that
+// thread (and by whoever pushes on its behalf), read by the stats path.
+class StageMeter {
+public:
+    void record(std::chrono::nanoseconds service) {
+        auto us = static_cast<uint64_t>(std::max<int64_t>(0,
+            std::chrono::duration_cast<std::chrono::microseconds>(service).count()));
+        m_items.fetch_add(1, std::memory_order_relaxed);
+        m_total_us.fetch_add(us, std::memory_order_relaxed);
+        m_histogram.record_us(us);
+        uint64_t peak = m_max_us.load(std::memory_order_relaxed);
+        while (us > peak && !m_max_us.compare_exchange_weak(peak, us, std::memory_order_relaxed)) {
+        }
+    }
+
+    void add_blocked(std::chrono::nanoseconds blocked) {
+        m_blocked_ns.fetch_add(static_cast<uint64_t>(std::max<int64_t>(0, blocked.count())),
+                               std::memory_order_relaxed);
+    }
+
+    // The stage's worker thread calls these as it starts and finishes
+    void bind_thread() { m_cpu.bind_current_thread(); }
+    void unbind_thread() { m_cpu.unbind(); }
+
+    std::chrono::nanoseconds blocked() const {
+        return std::chrono::nanoseconds(m_blocked_ns.load(std::memory_order_relaxed));
+    }
+
+    void reset() {
+        m_items = 0;
+        m_total_us = 0;
+        m_max_us = 0;
+        m_blocked_ns = 0;
+        m_histogram.reset();
+        m_cpu.reset();
+    }
+
+    StageStats snapshot(const char* name) const {
+        StageStats stats;
+        stats.name = name;
+        stats.items = m_items.load(std::memory_order_relaxed);
+        stats.p50_service_ms = m_histogram.percentile_ms(0.50);
+        stats.p95_service_ms = m_histogram.percentile_ms(0.95);
+        stats.p99_service_ms = m_histogram.percentile_ms(0.99);
+        stats.max_service_ms = m_max_us.load(std::memory_order_relaxed) / 1000.0;
+        stats.blocked_ms = m_blocked_ns.load(std::memory_order_relaxed) / 1e6;
+        stats.cpu_ms = m_cpu.cpu_ms();
+        if (stats.items > 0) {
+            stats.average_service_ms = m_total_us.load(std::memory_order_relaxed) / 1000.0 / stats.items;
+        }
+        return stats;
+    }
+
+    template <typename T>
+    StageStats snapshot(const char* name, const StageQueue<T>& queue) const {
+        StageStats stats = snapshot(name);
+        stats.queue_depth = queue.size();
+        stats.queue_capacity = queue.capacity();
+        stats.queue_high_water = queue.high_water();
+        return stats;
+    }
+
+private:
+    std::atomic<uint64_t> m_items{0};
+    std::atomic<uint64_t> m_total_us{0};
+    std::atomic<uint64_t> m_max_us{0};
+    std::atomic<uint64_t> m_blocked_ns{0};
+    LatencyHistogram m_histogram;
+    ThreadCpuClock m_cpu;
+};
+
+} // namespace playrec
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "video_capture.h"
+#include "audio_capture.h"
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace playrec {
+
+// In-memory video source for benchmarks and headless runs.
+//
+// Emits BGRA frames at settings.width x settings.height whose content
+// scrolls every frame, so the encoder does representative work. Frames are
+// stamped on a virtual clock at settings.target_fps. In realtime mode they
+// are paced to that clock; otherwise they go out as fast as the consumer
+// takes them (pair with DropPolicy::BLOCK to measure throughput).
+class SyntheticVideoCapture : public VideoCapture {
+public:
+    // frame_limit = 0 runs until stop()
+    explicit SyntheticVideoCapture(uint64_t frame_limit = 0, bool realtime = false);
+    ~SyntheticVideoCapture() override;
+
+    bool initialize(const CaptureSettings& settings) override;
+    bool start() override;
+    void stop() override;
+    std::pair<int, int> get_resolution() const override;
+    bool is_active() const override;
+
+    uint64_t frames_emitted() const { return m_frames_emitted; }
+
+    // True once frame_limit frames have been emitted
+    bool finished() const { return m_finished; }
+
+    // Virtual-clock time of frame 0, and media time reached so far
+    TimeStamp start_time() const { return m_start_time; }
+    TimeDuration media_time() const;
+
+    // Block until media_time() reaches media, or the source finishes or is
+    // stopped, or cancel is set; false unless media was reached. Whoever
+    // sets cancel calls wake() afterwards.
+    bool wait_for_media_time(TimeDuration media, const std::atomic<bool>& cancel) const;
+    void wake() const;
+
+private:
+    void generate_loop();
+
+    int m_width = 0, m_height = 0;
+    int m_fps = 30;
+    uint64_t m_frame_limit = 0;
+    bool m_realtime = false;
+    std::vector<uint8_t> m_pattern;  // Twice the frame height, scrolled through
+    TimeStamp m_start_time{};
+
+    std::thread m_thread;
+    std::atomic<bool> m_should_stop{false};
+    std::atomic<bool> m_is_active{false};
+    std::atomic<bool> m_finished{false};
+    std::atomic<uint64_t> m_frames_emitted{0};
+
+    // Signalled on every frame, so a paced audio source sleeps in between
+    mutable std::mutex m_progress_mutex;
+    mutable std::condition_variable m_progress;
+};
+
+// In-memory 16-bit PCM tone on the same virtual clock. When paced by a
+// synthetic video source it stays just ahead of that source's media time
+// (and stops where it stops); otherwise it runs in real time.
+class SyntheticAudioCapture : public AudioCapture {
+public:
+    explicit SyntheticAudioCapture(const SyntheticVideoCapture* pace = nullptr);
+    ~SyntheticAudioCapture() override;
+
+    bool initialize(const CaptureSettings& settings) override;
+    bool start() override;
+    void stop() override;
+    AudioFormat get_format() const override { return AudioFormat::PCM_S16LE; }
+    int get_sample_rate() const override { return m_sample_rate; }
+    int get_channels() const override { return m_channels; }
+    bool is_active() const override;
+
+private:
+    void generate_loop();
+
+    const SyntheticVideoCapture* m_pace;
+    int m_sample_rate = 48000;
+    int m_channels = 2;
+
+    std::thread m_thread;
+    std::atomic<bool> m_should_stop{false};
+    std::atomic<bool> m_is_active{false};
+};
+
+} // namespace playrec
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "common.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace playrec {
+namespace trace {
+
+// Opt-in timeline of what each pipeline thread did to which frame, written
+// as Chrome trace-event JSON (open it in Perfetto or chrome://tracing).
+//
+// Each thread records into a ring of its own, so recording takes no lock;
+// once it wraps, the oldest spans go. With tracing off a span costs one
+// load of a flag. start() and stop() must not race traced work: the
+// engine calls them before its threads start and after they have all been
+// joined. Span and thread names must be string literals, since only the
+// pointer is kept.
+
+constexpr uint64_t kNoFrame = ~0ull;
+constexpr size_t kDefaultEventsPerThread = 1 << 16;
+
+namespace detail {
+extern std::atomic<bool> g_enabled;
+extern TimeStamp g_origin;
+}
+
+inline bool enabled() {
+    return detail::g_enabled.load(std::memory_order_acquire);
+}
+
+// Frame ids are 90 kHz ticks since origin, the clock the video encoder
+// stamps PTS with, so a frame keeps its id from capture to mux
+void start(TimeStamp origin, size_t events_per_thread = kDefaultEventsPerThread);
+void stop();
+
+// Write the last session's spans; false if the file could not be written
+bool write_json(const std::string& path);
+
+inline uint64_t frame_id(TimeStamp timestamp) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timestamp - detail::g_origin).count();
+    if (ns <= 0) {
+        return 0;
+    }
+    // Rounded to nearest, as av_rescale() does for the encoder
+    return static_cast<uint64_t>(ns / 1000000000 * 90000 + (ns % 1000000000 * 90000 + 500000000) / 1000000000);
+}
+
+// Name the calling thread in the trace
+void set_thread_name(const char* name);
+
+// Record a span that has already finished
+void complete(const char* name, uint64_t frame, TimeStamp begin, TimeStamp end);
+
+// Records from construction to destruction
+class Span {
+public:
+    explicit Span(const char* name, uint64_t frame = kNoFrame)
+        : m_name(enabled() ? name : nullptr), m_frame(frame) {
+        if (m_name) {
+            m_begin = std::chrono::high_resolution_clock::now();
+        }
+    }
+
+    ~Span() {
+        if (m_name) {
+            complete(m_name, m_frame, m_begin, std::chrono::high_resolution_clock::now());
+        }
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+    // For a frame only known once the work is under way
+    void set_frame(uint64_t frame) { m_frame = frame; }
+
+private:
+    const char* m_name;
+    uint64_t m_frame;
+    TimeStamp m_begin{};
+};
+
+} // namespace trace
+} // namespace playrec
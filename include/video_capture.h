@@ -1,6 +1,9 @@
 #pragma once
 
 #include "common.h"
+#include "frame_pacer.h"
+#include "frame_pool.h"
+#include "latency_histogram.h"
 #include <functional>
 #include <thread>
 #include <atomic>
@@ -30,11 +33,60 @@ public:
     // Check if capture is active
     virtual bool is_active() const = 0;
 
+    // Get frame buffer pool statistics
+    FramePool::Stats get_pool_stats() const;
+
+    // Grab timing statistics
+    struct Stats {
+        uint64_t frames_grabbed = 0;
+        double average_grab_ms = 0.0;
+        double p50_grab_ms = 0.0;
+        double p95_grab_ms = 0.0;
+        double p99_grab_ms = 0.0;
+        double max_grab_ms = 0.0;
+        uint64_t frames_unchanged = 0;              // Ticks with no damage (emitted as repeats)
+        uint64_t damaged_pixels_per_second = 0;     // Over the last full second
+        uint64_t unchanged_frames_per_second = 0;   // Over the last full second
+        uint64_t full_frame_copies = 0;             // Damaged ticks that copied the whole previous frame
+        FramePacer::Stats pacing;                   // Capture ticks, for sources that pace themselves
+    };
+
+    Stats get_capture_stats() const;
+
 protected:
     void emit_frame(const Frame& frame);
 
+    // Record how long one grab from the platform API took
+    void record_grab_latency(TimeDuration duration);
+
+    // Record change detection results for one capture tick
+    void record_damage(uint64_t damaged_pixels);
+    void record_unchanged_frame();
+    void record_full_frame_copy() { m_full_frame_copies++; }
+
+    // Recycled buffers for emitted frames
+    FramePool m_frame_pool;
+
+    // Schedules the capture loop of sources that poll at the frame rate
+    FramePacer m_pacer;
+
 private:
     std::function<void(const Frame&)> m_frame_callback;
+
+    std::atomic<uint64_t> m_frames_grabbed{0};
+    std::atomic<uint64_t> m_total_grab_us{0};
+    std::atomic<uint64_t> m_max_grab_us{0};
+    LatencyHistogram m_grab_histogram;
+
+    // Change detection counters, rolled over once per second
+    void roll_damage_window();
+    std::atomic<uint64_t> m_frames_unchanged{0};
+    std::atomic<uint64_t> m_full_frame_copies{0};
+    std::atomic<uint64_t> m_damaged_pixels_per_second{0};
+    std::atomic<uint64_t> m_unchanged_per_second{0};
+    uint64_t m_window_damaged_pixels = 0;
+    uint64_t m_window_unchanged = 0;
+    TimeStamp m_window_start{};
 };
 
 // Platform-specific implementations
@@ -82,6 +134,9 @@ private:
 #ifdef __linux__
 class LinuxVideoCapture : public VideoCapture {
 public:
+    LinuxVideoCapture();
+    ~LinuxVideoCapture() override;
+
     bool initialize(const CaptureSettings& settings) override;
     bool start() override;
     void stop() override;
@@ -89,9 +144,21 @@ public:
     bool is_active() const override;
 
 private:
-    // Linux-specific members (X11, V4L2)
+    void capture_loop();
+    void capture_frame();
+    
+    bool capture_damaged_frame(Frame& frame);
+
+    // Linux-specific members (X11 + MIT-SHM + XDamage)
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
     bool m_is_active = false;
     int m_width = 0, m_height = 0;
+    CaptureSettings m_settings;
+    
+    // Threading
+    std::thread m_capture_thread;
+    std::atomic<bool> m_should_stop{false};
 };
 #endif
 
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "common.h"
+#include <memory>
+
+struct AVFrame;
+
+namespace playrec {
+
+// Owning, move-only handle to an encoder input frame (AVFrame) holding a
+// converted picture, stamped with its source frame's capture time. Lets
+// conversion and encoding run on different threads.
+class ConvertedFrame {
+public:
+    ConvertedFrame() = default;
+    ~ConvertedFrame();
+
+    ConvertedFrame(ConvertedFrame&& other) noexcept;
+    ConvertedFrame& operator=(ConvertedFrame&& other) noexcept;
+    ConvertedFrame(const ConvertedFrame&) = delete;
+    ConvertedFrame& operator=(const ConvertedFrame&) = delete;
+
+    // Frame with buffers for the given AVPixelFormat and size, or an empty
+    // handle if allocation fails
+    static ConvertedFrame allocate(int av_format, int width, int height);
+
+    AVFrame* get() const { return m_frame; }
+    explicit operator bool() const { return m_frame != nullptr; }
+
+    // Make the buffers safe to overwrite (copies them if the encoder still
+    // references the previous picture)
+    bool make_writable();
+
+    TimeStamp timestamp{};
+
+private:
+    AVFrame* m_frame = nullptr;
+};
+
+// Color conversion from captured frames into an encoder's input frame.
+//
+// Same-size conversion from packed RGB to YUV420P or NV12 runs on the
+// vectorized kernels from color_convert.h. YUV input already in the
+// output format and size is copied plane by plane. Everything else (and
+// all conversions when kernels are disabled) goes through swscale, set up
+// for the same BT.709 limited-range output, treating RGB input as full
+// range and YUV input as limited range. The chosen path is cached per
+// (source format, width, height, stride, destination format and size) and
+// rebuilt lazily when an incoming frame no longer matches, e.g. after a
+// window resize.
+class VideoConverter {
+public:
+    struct Stats {
+        uint64_t frames_converted = 0;
+        uint64_t context_rebuilds = 0;
+        double last_convert_ms = 0.0;
+        double average_convert_ms = 0.0;
+        const char* backend = "none";  // "swscale", "copy" or the kernel's instruction set
+    };
+
+    VideoConverter();
+    ~VideoConverter();
+
+    VideoConverter(const VideoConverter&) = delete;
+    VideoConverter& operator=(const VideoConverter&) = delete;
+
+    // Prefer the built-in kernels over swscale where they apply (default on)
+    void set_kernels_enabled(bool enabled);
+
+    // Convert frame into dst, using dst's format, size and planes
+    bool convert(const Frame& frame, AVFrame* dst);
+
+    Stats get_stats() const;
+
+    // Bytes per row for a tightly packed frame of this format
+    static int default_stride(VideoFormat format, int width);
+
+    // Minimum buffer size for a frame of this format and stride
+    static size_t required_size(VideoFormat format, int stride, int height);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
+
+} // namespace playrec
@@ -1,9 +1,16 @@
 #include "audio_capture.h"
+#include "frame_pacer.h"
 #include <iostream>
+#include <algorithm>
 #include <thread>
 #include <chrono>
 #include <cmath>
 
+#if defined(__linux__) && defined(PLAYREC_HAVE_ALSA)
+#include <alsa/asoundlib.h>
+#include <cerrno>
+#endif
+
 namespace playrec {
 
 // Base AudioCapture implementation
@@ -15,11 +22,43 @@ void AudioCapture::set_sample_callback(std::function<void(const AudioSample&)> c
 }
 
 void AudioCapture::emit_sample(const AudioSample& sample) {
+    m_chunks_captured++;
     if (m_sample_callback) {
         m_sample_callback(sample);
     }
 }
 
+AudioCapture::Stats AudioCapture::get_capture_stats() const {
+    Stats stats;
+    stats.chunks_captured = m_chunks_captured;
+    stats.xruns = m_xruns;
+    stats.chunks_dropped = m_chunks_dropped;
+    uint64_t latency_samples = m_latency_samples;
+    if (latency_samples > 0) {
+        stats.average_latency_ms = m_total_latency_us / 1000.0 / latency_samples;
+    }
+    stats.max_latency_ms = m_max_latency_us / 1000.0;
+    return stats;
+}
+
+void AudioCapture::record_xrun() {
+    m_xruns++;
+}
+
+void AudioCapture::record_dropped_chunk() {
+    m_chunks_dropped++;
+}
+
+void AudioCapture::record_capture_latency(TimeDuration latency) {
+    auto latency_us = static_cast<uint64_t>(std::max(0.0, latency.count() * 1000000.0));
+    m_latency_samples++;
+    m_total_latency_us += latency_us;
+
+    uint64_t previous_max = m_max_latency_us;
+    while (latency_us > previous_max && !m_max_latency_us.compare_exchange_weak(previous_max, latency_us)) {
+    }
+}
+
 // Platform-specific implementations
 
 #ifdef _WIN32
@@ -150,19 +189,17 @@ void MacOSAudioCapture::capture_loop() {
     int bytes_per_sample = 2; // 16-bit samples
     int bytes_per_chunk = samples_per_chunk * m_channels * bytes_per_sample;
     
-    auto chunk_duration = std::chrono::milliseconds(10);
-    auto last_capture_time = std::chrono::high_resolution_clock::now();
+    // Every chunk is produced, so a late wakeup is made up rather than skipped
+    FramePacer pacer;
+    pacer.set_period(std::chrono::milliseconds(10));
+    pacer.start();
     
-    while (!m_should_stop) {
-        auto current_time = std::chrono::high_resolution_clock::now();
-        auto elapsed = current_time - last_capture_time;
-        
-        if (elapsed >= chunk_duration) {
-            generate_audio_sample(samples_per_chunk);
-            last_capture_time = current_time;
+    for (uint64_t chunk = 1; !m_should_stop; ++chunk) {
+        pacer.wait_for(chunk);
+        if (m_should_stop) {
+            break;
         }
-        
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        generate_audio_sample(samples_per_chunk);
     }
 }
 
@@ -204,35 +241,265 @@ void MacOSAudioCapture::generate_audio_sample(int sample_count) {
 #endif
 
 #ifdef __linux__
-// Linux implementation using ALSA or PulseAudio
+namespace {
+
+constexpr int kPeriodsPerBuffer = 4;     // Device buffer, in periods
+constexpr size_t kChunkRingDepth = 32;   // Periods that can wait for delivery
+constexpr int kWaitTimeoutMs = 100;      // Bounds how long stop() waits on a silent device
+
+} // namespace
+
+// Linux implementation using ALSA
+struct LinuxAudioCapture::Impl {
+#ifdef PLAYREC_HAVE_ALSA
+    snd_pcm_t* pcm = nullptr;
+
+    ~Impl() {
+        if (pcm) {
+            snd_pcm_close(pcm);
+        }
+    }
+#endif
+};
+
+LinuxAudioCapture::LinuxAudioCapture() : m_impl(std::make_unique<Impl>()) {}
+
+LinuxAudioCapture::~LinuxAudioCapture() {
+    stop();
+}
+
 bool LinuxAudioCapture::initialize(const CaptureSettings& settings) {
-    // TODO: Implement Linux audio capture:
-    // Option 1: ALSA (snd_pcm_*)
-    // Option 2: PulseAudio (pa_simple_* or pa_stream_*)
-    // 1. Open audio device
-    // 2. Set hardware parameters (sample rate, format, channels)
-    // 3. Prepare for capture
-    
-    std::cout << "Linux audio capture initialized (placeholder)\n";
     m_format = AudioFormat::PCM_S16LE;
-    m_sample_rate = 44100;
-    m_channels = 2;
+    m_sample_rate = settings.sampleRate > 0 ? settings.sampleRate : 48000;
+    m_channels = settings.channels > 0 ? settings.channels : 2;
+
+#ifdef PLAYREC_HAVE_ALSA
+    const std::string device = settings.audio_device.empty() ? "default" : settings.audio_device;
+    int err = snd_pcm_open(&m_impl->pcm, device.c_str(), SND_PCM_STREAM_CAPTURE, 0);
+    if (err < 0) {
+        std::cerr << "Failed to open ALSA capture device " << device << ": " << snd_strerror(err) << "\n";
+        m_impl->pcm = nullptr;
+        return false;
+    }
+    snd_pcm_t* pcm = m_impl->pcm;
+
+    // The encoder takes interleaved 16-bit PCM; plug devices convert to it
+    unsigned int rate = static_cast<unsigned int>(m_sample_rate);
+    unsigned int channels = static_cast<unsigned int>(m_channels);
+    snd_pcm_uframes_t period = settings.audio_period_frames > 0 ? settings.audio_period_frames : 480;
+    snd_pcm_uframes_t buffer = period * kPeriodsPerBuffer;
+
+    snd_pcm_hw_params_t* hw_params = nullptr;
+    snd_pcm_hw_params_alloca(&hw_params);
+    if ((err = snd_pcm_hw_params_any(pcm, hw_params)) < 0 ||
+        (err = snd_pcm_hw_params_set_access(pcm, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0 ||
+        (err = snd_pcm_hw_params_set_format(pcm, hw_params, SND_PCM_FORMAT_S16_LE)) < 0 ||
+        (err = snd_pcm_hw_params_set_channels_near(pcm, hw_params, &channels)) < 0 ||
+        (err = snd_pcm_hw_params_set_rate_near(pcm, hw_params, &rate, nullptr)) < 0 ||
+        (err = snd_pcm_hw_params_set_period_size_near(pcm, hw_params, &period, nullptr)) < 0 ||
+        (err = snd_pcm_hw_params_set_buffer_size_near(pcm, hw_params, &buffer)) < 0 ||
+        (err = snd_pcm_hw_params(pcm, hw_params)) < 0) {
+        std::cerr << "Failed to configure ALSA capture device " << device << ": " << snd_strerror(err) << "\n";
+        m_impl = std::make_unique<Impl>();
+        return false;
+    }
+    snd_pcm_hw_params_get_period_size(hw_params, &period, nullptr);
+    snd_pcm_hw_params_get_buffer_size(hw_params, &buffer);
+
+    // Wake the reader once a whole period is available
+    snd_pcm_sw_params_t* sw_params = nullptr;
+    snd_pcm_sw_params_alloca(&sw_params);
+    if ((err = snd_pcm_sw_params_current(pcm, sw_params)) < 0 ||
+        (err = snd_pcm_sw_params_set_avail_min(pcm, sw_params, period)) < 0 ||
+        (err = snd_pcm_sw_params(pcm, sw_params)) < 0) {
+        std::cerr << "Failed to configure ALSA capture device " << device << ": " << snd_strerror(err) << "\n";
+        m_impl = std::make_unique<Impl>();
+        return false;
+    }
+
+    m_sample_rate = static_cast<int>(rate);
+    m_channels = static_cast<int>(channels);
+    m_period_frames = static_cast<int>(period);
+    m_buffer_frames = static_cast<int>(buffer);
+
+    // Every chunk is sized once here and reused for the whole capture
+    size_t chunk_bytes = static_cast<size_t>(m_period_frames) * m_channels * 2;
+    m_chunks.assign(kChunkRingDepth, AudioSample{});
+    m_free_chunks = std::make_unique<RingQueue<size_t>>(kChunkRingDepth);
+    m_ready_chunks = std::make_unique<RingQueue<size_t>>(kChunkRingDepth);
+    for (size_t i = 0; i < kChunkRingDepth; ++i) {
+        m_chunks[i].data.resize(chunk_bytes);
+        m_chunks[i].sample_rate = m_sample_rate;
+        m_chunks[i].channels = m_channels;
+        m_chunks[i].format = m_format;
+        size_t index = i;
+        m_free_chunks->try_push(std::move(index));
+    }
+
+    std::cout << "ALSA audio capture initialized: " << device << ", S16_LE, " << m_sample_rate << "Hz, "
+              << m_channels << " channels, period " << m_period_frames << " frames ("
+              << m_period_frames * 1000.0 / m_sample_rate << " ms), buffer " << m_buffer_frames << " frames\n";
     return true;
+#else
+    std::cout << "Linux audio capture unavailable (built without ALSA), no audio will be recorded\n";
+    return true;
+#endif
 }
 
 bool LinuxAudioCapture::start() {
-    // TODO: Start ALSA/PulseAudio capture thread
-    // Read samples and convert to AudioSample format
-    
+    if (m_is_active) {
+        return false;
+    }
+
+#ifdef PLAYREC_HAVE_ALSA
+    if (!m_impl->pcm) {
+        return false;
+    }
+    int err = snd_pcm_prepare(m_impl->pcm);
+    if (err >= 0) {
+        err = snd_pcm_start(m_impl->pcm);
+    }
+    if (err < 0) {
+        std::cerr << "Failed to start ALSA capture: " << snd_strerror(err) << "\n";
+        return false;
+    }
+
+    m_should_stop = false;
+    m_reader_done = false;
     m_is_active = true;
-    std::cout << "Linux audio capture started (placeholder)\n";
+    m_deliver_thread = std::thread(&LinuxAudioCapture::deliver_loop, this);
+    m_read_thread = std::thread(&LinuxAudioCapture::read_loop, this);
+#else
+    m_is_active = true;
+#endif
+    std::cout << "Linux audio capture started\n";
     return true;
 }
 
 void LinuxAudioCapture::stop() {
-    // TODO: Stop capture and close audio device
-    m_is_active = false;
-    std::cout << "Linux audio capture stopped\n";
+    m_should_stop = true;
+    if (m_read_thread.joinable()) {
+        m_read_thread.join();
+    }
+
+    // Delivery drains whatever the reader left behind, then exits
+    {
+        std::lock_guard<std::mutex> lock(m_ready_mutex);
+        m_reader_done = true;
+    }
+    m_ready_cv.notify_one();
+    if (m_deliver_thread.joinable()) {
+        m_deliver_thread.join();
+    }
+
+#ifdef PLAYREC_HAVE_ALSA
+    if (m_impl->pcm) {
+        snd_pcm_drop(m_impl->pcm);
+    }
+#endif
+
+    if (m_is_active.exchange(false)) {
+        auto stats = get_capture_stats();
+        std::cout << "Linux audio capture stopped (" << stats.chunks_captured << " chunks, " << stats.xruns
+                  << " xruns, " << stats.chunks_dropped << " dropped, avg latency "
+                  << stats.average_latency_ms << " ms)\n";
+    }
+}
+
+void LinuxAudioCapture::read_loop() {
+#ifdef PLAYREC_HAVE_ALSA
+    snd_pcm_t* pcm = m_impl->pcm;
+    const size_t frame_bytes = static_cast<size_t>(m_channels) * 2;
+    const auto period = static_cast<snd_pcm_uframes_t>(m_period_frames);
+
+    while (!m_should_stop) {
+        size_t index = 0;
+        if (!m_free_chunks->try_pop(index)) {
+            // Delivery is behind: give up the oldest waiting chunk rather
+            // than stop reading and let the device overrun
+            if (!m_ready_chunks->try_pop(index)) {
+                std::this_thread::yield();
+                continue;
+            }
+            record_dropped_chunk();
+        }
+
+        AudioSample& chunk = m_chunks[index];
+        snd_pcm_uframes_t filled = 0;
+        bool failed = false;
+        while (filled < period && !m_should_stop) {
+            int ready = snd_pcm_wait(pcm, kWaitTimeoutMs);
+            if (ready == 0) {
+                continue;
+            }
+            snd_pcm_sframes_t got = ready < 0 ? ready
+                : snd_pcm_readi(pcm, chunk.data.data() + filled * frame_bytes, period - filled);
+            if (got == -EAGAIN) {
+                continue;
+            }
+            if (got < 0) {
+                // An overrun leaves a gap, so the partial period is discarded
+                if (got == -EPIPE) {
+                    record_xrun();
+                }
+                int err = snd_pcm_recover(pcm, static_cast<int>(got), 1);
+                if (err >= 0) {
+                    err = snd_pcm_start(pcm);
+                }
+                if (err < 0) {
+                    std::cerr << "ALSA capture failed: " << snd_strerror(err) << "\n";
+                    failed = true;
+                    break;
+                }
+                filled = 0;
+                continue;
+            }
+            filled += static_cast<snd_pcm_uframes_t>(got);
+        }
+
+        if (filled < period) {
+            m_free_chunks->try_push(std::move(index));
+            if (failed) {
+                m_is_active = false;
+            }
+            break;
+        }
+
+        // Stamp the chunk's last sample: it reached the device as many
+        // frames ago as are still buffered behind it
+        snd_pcm_sframes_t delay = 0;
+        if (snd_pcm_delay(pcm, &delay) < 0 || delay < 0) {
+            delay = 0;
+        }
+        chunk.timestamp = std::chrono::high_resolution_clock::now() -
+            std::chrono::duration_cast<TimeStamp::duration>(TimeDuration(static_cast<double>(delay) / m_sample_rate));
+
+        m_ready_chunks->try_push(std::move(index));
+        {
+            std::lock_guard<std::mutex> lock(m_ready_mutex);
+        }
+        m_ready_cv.notify_one();
+    }
+#endif
+}
+
+void LinuxAudioCapture::deliver_loop() {
+    for (;;) {
+        size_t index = 0;
+        if (m_ready_chunks->try_pop(index)) {
+            const AudioSample& chunk = m_chunks[index];
+            emit_sample(chunk);
+            record_capture_latency(std::chrono::high_resolution_clock::now() - chunk.timestamp);
+            m_free_chunks->try_push(std::move(index));
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_ready_mutex);
+        if (m_reader_done && m_ready_chunks->empty()) {
+            break;
+        }
+        m_ready_cv.wait(lock, [this] { return m_reader_done || !m_ready_chunks->empty(); });
+    }
 }
 
 AudioFormat LinuxAudioCapture::get_format() const {
@@ -1,67 +1,161 @@
 #include "capture_engine.h"
+#include "trace.h"
 #include <iostream>
 #include <chrono>
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
 
 namespace playrec {
 
+namespace {
+
+constexpr size_t kPictureQueueDepth = 2;  // Converted frames waiting for the encoder
+constexpr size_t kAudioQueueDepth = 256;  // Audio chunks waiting for the encoder
+constexpr size_t kMuxQueueDepth = 128;    // Encoded packets waiting for the muxer
+constexpr double kStatsWindowSeconds = 1.0;  // Shortest span current_fps and cpu_usage cover
+
+const char* drop_policy_name(DropPolicy policy) {
+    switch (policy) {
+        case DropPolicy::DROP_OLDEST: return "drop oldest";
+        case DropPolicy::DROP_NEWEST: return "drop newest";
+        case DropPolicy::BLOCK:       return "block";
+    }
+    return "unknown";
+}
+
+// User plus system CPU time of the whole process
+double process_cpu_seconds() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        return 0.0;
+    }
+    auto ticks = [](const FILETIME& time) {
+        return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+    };
+    return (ticks(kernel) + ticks(user)) / 1e7;  // 100 ns units
+#else
+    struct rusage usage {};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0.0;
+    }
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#endif
+}
+
+} // namespace
+
 CaptureEngine::CaptureEngine() = default;
 
 CaptureEngine::~CaptureEngine() {
     if (m_is_capturing) {
         stop_capture();
     }
+    if (m_replay_thread.joinable()) {
+        m_replay_thread.join();
+    }
 }
 
 bool CaptureEngine::initialize(const CaptureSettings& settings) {
+    // Create platform-specific captures
+    return initialize(settings, create_video_capture(),
+                      settings.capture_audio ? create_audio_capture() : nullptr);
+}
+
+bool CaptureEngine::initialize(const CaptureSettings& settings,
+                               std::unique_ptr<VideoCapture> video_capture,
+                               std::unique_ptr<AudioCapture> audio_capture) {
     m_settings = settings;
+    m_settings.capture_audio = audio_capture != nullptr;
 
     try {
-        // Create platform-specific video capture
-        m_video_capture = create_video_capture();
+        m_video_capture = std::move(video_capture);
         if (!m_video_capture || !m_video_capture->initialize(settings)) {
             std::cerr << "Failed to initialize video capture\n";
             return false;
         }
 
-        // Create audio capture if enabled
-        if (settings.capture_audio) {
-            m_audio_capture = create_audio_capture();
-            if (!m_audio_capture || !m_audio_capture->initialize(settings)) {
-                std::cerr << "Failed to initialize audio capture\n";
-                return false;
-            }
+        m_audio_capture = std::move(audio_capture);
+        if (m_audio_capture && !m_audio_capture->initialize(settings)) {
+            std::cerr << "Failed to initialize audio capture\n";
+            return false;
         }
 
         // Get video resolution for encoder setup
         auto [width, height] = m_video_capture->get_resolution();
 
-        // Create encoder
-        m_encoder = create_encoder(settings.codec);
-        if (!m_encoder) {
-            std::cerr << "Failed to create encoder\n";
+        // Video and audio encode on separate threads, each with its own encoder
+        m_video_encoder = create_video_encoder(settings.codec);
+        if (!m_video_encoder || !m_video_encoder->initialize(settings, width, height)) {
+            std::cerr << "Failed to initialize video encoder\n";
             return false;
         }
 
-        // Initialize encoder
-        AudioFormat audio_format = AudioFormat::PCM_S16LE;
         int sample_rate = 44100, channels = 2;
         if (m_audio_capture) {
-            audio_format = m_audio_capture->get_format();
             sample_rate = m_audio_capture->get_sample_rate();
             channels = m_audio_capture->get_channels();
+            m_audio_encoder = create_audio_encoder();
+            if (!m_audio_encoder->initialize(settings, m_audio_capture->get_format(), sample_rate, channels)) {
+                std::cerr << "Failed to initialize audio encoder\n";
+                return false;
+            }
         }
 
-        if (!m_encoder->initialize(settings, width, height, audio_format, sample_rate, channels)) {
-            std::cerr << "Failed to initialize encoder\n";
-            return false;
+        // Only live capture has a deadline; with BLOCK the source waits instead
+        // of dropping, so there is nothing for the controller to protect
+        m_adaptive_speed = settings.adaptive_encoder_speed && settings.drop_policy != DropPolicy::BLOCK &&
+                           m_video_encoder->speed_levels() > 1;
+
+        // A speed change may open a new encoder, whose parameter sets differ
+        // from the global header and travel in-band
+        m_video_stream_info = m_video_encoder->stream_info();
+        m_video_stream_info.parameter_sets_in_band = m_adaptive_speed;
+        m_audio_sample_rate = sample_rate;
+        m_audio_channels = channels;
+
+        if (settings.replay_buffer_seconds > 0) {
+            // Nothing goes to disk until a replay is saved
+            m_replay_buffer = std::make_unique<ReplayBuffer>(
+                settings.replay_buffer_seconds, static_cast<size_t>(std::max(1, settings.replay_buffer_mb)) << 20);
+        } else {
+            // MP4 output, starting at output_path and optionally rotating
+            // to a new file at keyframes
+            SegmentPolicy policy;
+            policy.max_seconds = settings.segment_minutes * 60.0;
+            policy.max_bytes = static_cast<uint64_t>(std::max(0, settings.segment_mb)) << 20;
+            MP4Options layout;
+            layout.fragment_seconds = settings.fragment_seconds;
+            layout.io_buffer_bytes = static_cast<size_t>(std::max(4, settings.io_buffer_kb)) << 10;
+            layout.file.memory_cap_bytes = static_cast<size_t>(std::max(1, settings.write_behind_mb)) << 20;
+            layout.file.direct_io = settings.direct_io;
+            layout.file.preallocate_bytes = static_cast<uint64_t>(std::max(0, settings.preallocate_mb)) << 20;
+            m_segment_writer = std::make_unique<SegmentWriter>(policy, settings.filenameFormat);
+            if (!m_segment_writer->initialize(settings.output_path, m_video_stream_info, settings.target_fps,
+                                              sample_rate, channels, m_audio_encoder != nullptr, layout)) {
+                std::cerr << "Failed to initialize MP4 writer for: " << settings.output_path << "\n";
+                return false;
+            }
+            m_segment_writer->set_keyframe_request([this]() {
+                m_video_encoder->request_keyframe();
+            });
         }
 
-        // Create MP4 writer for proper container
-        m_mp4_writer = std::make_unique<MP4Writer>();
-        if (!m_mp4_writer->initialize(settings.output_path, width, height, settings.target_fps, 
-                                     sample_rate, channels)) {
-            std::cerr << "Failed to initialize MP4 writer for: " << settings.output_path << "\n";
-            return false;
+        // Encoded packets move by reference into the mux stage's queue
+        m_video_encoder->set_packet_callback([this](EncodedPacket& packet) {
+            queue_encoded_packet(packet);
+        });
+        if (m_audio_encoder) {
+            m_audio_encoder->set_packet_callback([this](EncodedPacket& packet) {
+                queue_encoded_packet(packet);
+            });
         }
 
         // Set up callbacks
@@ -77,9 +171,26 @@ bool CaptureEngine::initialize(const CaptureSettings& settings) {
 
         std::cout << "Capture engine initialized:\n";
         std::cout << "  Video: " << width << "x" << height << " @ " << settings.target_fps << " FPS\n";
-        std::cout << "  Audio: " << (settings.capture_audio ? "Enabled" : "Disabled") << "\n";
-        std::cout << "  Encoder: " << m_encoder->get_codec_name() << "\n";
-        std::cout << "  HW Acceleration: " << (m_encoder->supports_hardware_acceleration() ? "Yes" : "No") << "\n";
+        std::cout << "  Audio: " << (m_audio_capture ? "Enabled" : "Disabled") << "\n";
+        std::cout << "  Encoder: " << m_video_encoder->get_codec_name()
+                  << (m_audio_encoder ? " + " + m_audio_encoder->get_codec_name() : std::string()) << "\n";
+        std::cout << "  HW Acceleration: " << (m_video_encoder->supports_hardware_acceleration() ? "Yes" : "No") << "\n";
+        std::cout << "  Frame queue: " << std::max(1, settings.frame_queue_depth) << " frames, "
+                  << drop_policy_name(settings.drop_policy) << " when full\n";
+        std::cout << "  Pipeline: convert, video encode, audio encode and mux threads\n";
+        if (m_replay_buffer) {
+            std::cout << "  Replay buffer: last " << settings.replay_buffer_seconds << " s, up to "
+                      << settings.replay_buffer_mb << " MB\n";
+        } else if (settings.segment_minutes > 0 || settings.segment_mb > 0) {
+            std::cout << "  Segments: new file every";
+            if (settings.segment_minutes > 0) {
+                std::cout << " " << settings.segment_minutes << " min";
+            }
+            if (settings.segment_mb > 0) {
+                std::cout << (settings.segment_minutes > 0 ? " or " : " ") << settings.segment_mb << " MB";
+            }
+            std::cout << ", named " << settings.filenameFormat << "\n";
+        }
 
         return true;
     } catch (const std::exception& e) {
@@ -94,12 +205,39 @@ bool CaptureEngine::start_capture() {
     }
 
     m_should_stop = false;
-    m_stats = Stats{}; // Reset stats
-    m_start_time = std::chrono::high_resolution_clock::now();
+    m_frames_received = 0;
+    m_frames_written = 0;
+    m_frames_failed = 0;
+    m_queue_overflows = 0;
+    m_frames_skipped = 0;
+    m_tail_skipped = false;
+    m_audio_frame_count = 0;
+    m_capture_cpu.reset();
+    {
+        std::lock_guard<std::mutex> lock(m_stats_mutex);
+        m_start_time = std::chrono::high_resolution_clock::now();
+        m_start_cpu_seconds = process_cpu_seconds();
+        m_stats_window = StatsWindow{};
+        m_stats_window.time = std::chrono::steady_clock::now();
+        m_stats_window.cpu_seconds = m_start_cpu_seconds;
+    }
+    if (!m_settings.trace_path.empty()) {
+        trace::start(m_start_time);
+    }
+
+    // Capture timestamps become PTS relative to the start of the recording
+    m_video_encoder->set_time_origin(m_start_time);
+    if (m_audio_encoder) {
+        m_audio_encoder->set_time_origin(m_start_time);
+    }
+
+    // Every stage must be running before the sources start emitting
+    start_stages();
 
     // Start video capture
     if (!m_video_capture->start()) {
         std::cerr << "Failed to start video capture\n";
+        stop_stages();
         return false;
     }
 
@@ -107,23 +245,25 @@ bool CaptureEngine::start_capture() {
     if (m_audio_capture && !m_audio_capture->start()) {
         std::cerr << "Failed to start audio capture\n";
         m_video_capture->stop();
+        stop_stages();
         return false;
     }
 
-    // Start capture thread
-    m_capture_thread = std::thread(&CaptureEngine::capture_loop, this);
     m_is_capturing = true;
 
     return true;
 }
 
-void CaptureEngine::stop_capture() {
+bool CaptureEngine::stop_capture() {
     if (!m_is_capturing) {
-        return;
+        return true;
     }
 
     m_should_stop = true;
 
+    // Take the source thread's last CPU reading while it still exists
+    m_capture_cpu.unbind();
+
     // Stop captures
     if (m_video_capture) {
         m_video_capture->stop();
@@ -132,32 +272,50 @@ void CaptureEngine::stop_capture() {
         m_audio_capture->stop();
     }
 
-    // Wait for capture thread to finish
-    if (m_capture_thread.joinable()) {
-        m_capture_thread.join();
+    // A trailing static stretch was never encoded; stamp its last frame so
+    // the previous picture lasts until the end instead of stopping short
+    if (m_tail_skipped) {
+        Frame tail;
+        {
+            std::lock_guard<std::mutex> lock(m_preview_mutex);
+            tail = m_preview_frame;
+        }
+        if (!tail.data.empty()) {
+            tail.repeat = false;
+            m_video_queue->push(std::move(tail));
+        }
+    }
+
+    // Drain every stage in order and flush the encoder
+    stop_stages();
+
+    // Finalize MP4 container (and wait for earlier segments)
+    bool written = true;
+    if (m_segment_writer) {
+        written = m_segment_writer->finalize();
     }
 
-    // Finalize encoder and write remaining data
-    if (m_encoder) {
-        auto final_data = m_encoder->finalize();
-        if (!final_data.empty() && m_mp4_writer) {
-            // Write final frames with appropriate timestamps
-            uint64_t final_timestamp = m_stats.frames_captured * 1000 / m_settings.target_fps;
-            m_mp4_writer->write_video_packet(final_data, final_timestamp);
-        }
+    // A replay being saved holds its own references; let it finish
+    if (m_replay_thread.joinable()) {
+        m_replay_thread.join();
     }
 
-    // Finalize MP4 container
-    if (m_mp4_writer) {
-        m_mp4_writer->finalize();
+    // Every traced thread has finished
+    if (!m_settings.trace_path.empty()) {
+        trace::stop();
+        if (!trace::write_json(m_settings.trace_path)) {
+            std::cerr << "Failed to write trace to " << m_settings.trace_path << "\n";
+        }
     }
 
-    // Close file writer (if still used for other purposes)
-    if (m_file_writer) {
-        m_file_writer->close();
+    // Release the preview frame's buffer back to the pool
+    {
+        std::lock_guard<std::mutex> lock(m_preview_mutex);
+        m_preview_frame = Frame{};
     }
 
     m_is_capturing = false;
+    return written;
 }
 
 bool CaptureEngine::is_capturing() const {
@@ -165,82 +323,462 @@ bool CaptureEngine::is_capturing() const {
 }
 
 CaptureEngine::Stats CaptureEngine::get_stats() const {
+    // Every figure is read from the atomic or lock that owns it, so nothing
+    // here races the stages; the lock only keeps callers from sharing a window
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
     auto current_time = std::chrono::high_resolution_clock::now();
     auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(current_time - m_start_time);
-    
-    Stats stats = m_stats;
+    double cpu_seconds = process_cpu_seconds();
+
+    Stats stats;
+    StageStats capture;
+    stats.sequence = ++m_stats_sequence;
+    stats.elapsed_seconds = elapsed.count();
+    stats.cpu_seconds = cpu_seconds - m_start_cpu_seconds;
+    stats.frames_captured = m_frames_written;
+    stats.frames_dropped = m_frames_failed;
+    stats.queue_overflows = m_queue_overflows;
+    stats.frames_skipped = m_frames_skipped;
+    stats.frames_dropped += stats.queue_overflows;
+    if (m_video_queue) {
+        stats.queue_depth = m_video_queue->size();
+    }
+    if (m_video_capture) {
+        auto pool_stats = m_video_capture->get_pool_stats();
+        stats.pool_hits = pool_stats.hits;
+        stats.pool_misses = pool_stats.misses;
+        stats.pool_high_water_bytes = pool_stats.high_water_bytes;
+
+        auto capture_stats = m_video_capture->get_capture_stats();
+        stats.grab_latency_ms = capture_stats.average_grab_ms;
+        stats.max_grab_latency_ms = capture_stats.max_grab_ms;
+        stats.frames_unchanged = capture_stats.frames_unchanged;
+        stats.damaged_pixels_per_second = capture_stats.damaged_pixels_per_second;
+        stats.unchanged_frames_per_second = capture_stats.unchanged_frames_per_second;
+        stats.full_frame_copies = capture_stats.full_frame_copies;
+        stats.capture_ticks = capture_stats.pacing.ticks;
+        stats.capture_ticks_missed = capture_stats.pacing.missed;
+        stats.capture_late_p99_ms = capture_stats.pacing.late_p99_ms;
+        stats.capture_jitter_ms = capture_stats.pacing.jitter_ms;
+        capture.p50_service_ms = capture_stats.p50_grab_ms;
+        capture.p95_service_ms = capture_stats.p95_grab_ms;
+        capture.p99_service_ms = capture_stats.p99_grab_ms;
+    }
+    if (m_audio_capture) {
+        auto audio_stats = m_audio_capture->get_capture_stats();
+        stats.audio_xruns = audio_stats.xruns;
+        stats.audio_chunks_dropped = audio_stats.chunks_dropped;
+        stats.audio_latency_ms = audio_stats.average_latency_ms;
+        stats.max_audio_latency_ms = audio_stats.max_latency_ms;
+    }
     if (elapsed.count() > 0) {
         stats.average_fps = static_cast<double>(stats.frames_captured) / elapsed.count();
     }
+
+    // Rates over the last window, moved on once it is long enough; callers
+    // polling faster than that see the previous figures again
+    auto now = std::chrono::steady_clock::now();
+    double window = std::chrono::duration<double>(now - m_stats_window.time).count();
+    if (window >= kStatsWindowSeconds) {
+        unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        m_stats_window.fps = (stats.frames_captured - m_stats_window.frames) / window;
+        m_stats_window.cpu_usage = 100.0 * (cpu_seconds - m_stats_window.cpu_seconds) / (window * cores);
+        m_stats_window.time = now;
+        m_stats_window.frames = stats.frames_captured;
+        m_stats_window.cpu_seconds = cpu_seconds;
+    }
+    stats.current_fps = m_stats_window.fps;
+    stats.cpu_usage = m_stats_window.cpu_usage;
     
-    if (m_file_writer) {
-        stats.file_size_bytes = m_file_writer->get_file_size();
+    if (m_video_encoder) {
+        auto convert_stats = m_video_encoder->get_convert_stats();
+        stats.convert_ms = convert_stats.average_convert_ms;
+        stats.last_convert_ms = convert_stats.last_convert_ms;
+        stats.convert_backend = convert_stats.backend;
+        
+        auto encode_stats = m_video_encoder->get_encode_stats();
+        stats.encoder_threading = describe_threading(encode_stats.threading);
+        stats.encode_latency_p50_ms = encode_stats.p50_latency_ms;
+        stats.encode_latency_p95_ms = encode_stats.p95_latency_ms;
+        stats.encoder_speed_level = encode_stats.speed_level;
+        stats.speed_adjustments = std::move(encode_stats.adjustments);
+    }
+    
+    StageStats io;
+    if (m_segment_writer) {
+        auto segment_stats = m_segment_writer->get_stats();
+        stats.file_size_bytes = segment_stats.file_bytes;
+        stats.segments = segment_stats.segments;
+        stats.segment_path = segment_stats.current_path;
+        stats.io_queued_bytes = segment_stats.io.bytes_queued;
+        stats.io_bytes_per_second = segment_stats.io.bytes_per_second;
+        stats.io_writes_per_second = segment_stats.io.writes_per_second;
+        io = segment_stats.io.io;
+    }
+    if (m_replay_buffer) {
+        auto replay_stats = m_replay_buffer->get_stats();
+        stats.replay_bytes = replay_stats.bytes;
+        stats.replay_seconds = replay_stats.seconds;
+    }
+    stats.replays_saved = m_replays_saved;
+
+    // The capture stage is the source's own thread; its service time is the grab
+    capture.name = "capture";
+    capture.items = m_frames_received;
+    capture.average_service_ms = stats.grab_latency_ms;
+    capture.max_service_ms = stats.max_grab_latency_ms;
+    capture.cpu_ms = m_capture_cpu.cpu_ms();
+    stats.stages.push_back(capture);
+    if (m_video_queue) {
+        stats.stages.push_back(m_convert_meter.snapshot("convert", *m_video_queue));
+        stats.stages.push_back(m_video_encode_meter.snapshot("video encode", *m_picture_queue));
+        stats.stages.push_back(m_audio_encode_meter.snapshot("audio encode", *m_audio_queue));
+        stats.stages.push_back(m_mux_meter.snapshot("mux", *m_mux_queue));
+    }
+    if (m_segment_writer) {
+        stats.stages.push_back(io);  // Writes to the file being recorded now
     }
     
     return stats;
 }
 
-void CaptureEngine::capture_loop() {
-    auto target_frame_duration = std::chrono::microseconds(1000000 / m_settings.target_fps);
-    auto last_frame_time = std::chrono::high_resolution_clock::now();
+bool CaptureEngine::get_preview_frame(Frame& frame) const {
+    std::lock_guard<std::mutex> lock(m_preview_mutex);
+    if (m_preview_frame.data.empty()) {
+        return false;
+    }
+    frame = m_preview_frame;
+    return true;
+}
+
+void CaptureEngine::start_stages() {
+    // Captured frames queue up to frame_queue_depth; past that the head
+    // applies the drop policy. Converted pictures are large and the encoder
+    // only needs the next one, so that queue is short. Audio chunks and
+    // packets are small and must not be lost, so those queues are deep.
+    // get_stats() reads the queues under the stats mutex, from any thread.
+    {
+        std::lock_guard<std::mutex> lock(m_stats_mutex);
+        m_video_queue = std::make_unique<StageQueue<Frame>>(
+            static_cast<size_t>(std::max(1, m_settings.frame_queue_depth)));
+        m_picture_queue = std::make_unique<StageQueue<ConvertedFrame>>(kPictureQueueDepth);
+        m_picture_pool = std::make_unique<RingQueue<ConvertedFrame>>(kPictureQueueDepth + 2);
+        m_audio_queue = std::make_unique<StageQueue<AudioSample>>(kAudioQueueDepth);
+        m_mux_queue = std::make_unique<StageQueue<EncodedPacket>>(kMuxQueueDepth);
+    }
+
+    m_convert_meter.reset();
+    m_video_encode_meter.reset();
+    m_audio_encode_meter.reset();
+    m_mux_meter.reset();
+
+    if (m_adaptive_speed) {
+        m_rate_controller.configure(1000.0 / std::max(1, m_settings.target_fps), std::max(1, m_settings.target_fps),
+                                    m_video_encoder->speed_levels(),
+                                    m_video_queue->capacity() + m_picture_queue->capacity());
+    }
+
+    m_mux_thread = std::thread(&CaptureEngine::mux_loop, this);
+    m_video_encode_thread = std::thread(&CaptureEngine::video_encode_loop, this);
+    m_audio_encode_thread = std::thread(&CaptureEngine::audio_encode_loop, this);
+    m_convert_thread = std::thread(&CaptureEngine::convert_loop, this);
+}
+
+void CaptureEngine::stop_stages() {
+    // Close each queue only once everything upstream of it has finished, so
+    // every item already accepted makes it into the file
+    m_video_queue->close();
+    m_audio_queue->close();
+    if (m_convert_thread.joinable()) {
+        m_convert_thread.join();
+    }
+
+    // Each encode stage flushes its own encoder on the way out
+    m_picture_queue->close();
+    if (m_video_encode_thread.joinable()) {
+        m_video_encode_thread.join();
+    }
+    if (m_audio_encode_thread.joinable()) {
+        m_audio_encode_thread.join();
+    }
+
+    m_mux_queue->close();
+    if (m_mux_thread.joinable()) {
+        m_mux_thread.join();
+    }
+}
+
+void CaptureEngine::convert_loop() {
+    m_convert_meter.bind_thread();
+    trace::set_thread_name("convert");
+    Frame frame;
+    ConvertedFrame picture;
+
+    while (m_video_queue->pop(frame)) {
+        auto start_time = std::chrono::steady_clock::now();
+        trace::Span span("convert", trace::frame_id(frame.timestamp));
+
+        // Reuse a picture the encode stage has finished with
+        m_picture_pool->try_pop(picture);
+
+        bool converted = false;
+        try {
+            converted = m_video_encoder->convert_video_frame(frame, picture);
+        } catch (const std::exception& e) {
+            std::cerr << "Error converting video frame: " << e.what() << "\n";
+        }
+
+        // Hand the capture buffer back to its pool before waiting downstream
+        frame = Frame{};
+        auto converted_time = std::chrono::steady_clock::now();
+
+        if (!converted) {
+            m_frames_failed++;
+        } else if (!m_picture_queue->push(std::move(picture))) {
+            break;
+        }
+
+        auto end_time = std::chrono::steady_clock::now();
+        m_convert_meter.add_blocked(end_time - converted_time);
+        m_convert_meter.record(converted_time - start_time);
+    }
+    m_convert_meter.unbind_thread();
+}
+
+void CaptureEngine::video_encode_loop() {
+    m_video_encode_meter.bind_thread();
+    trace::set_thread_name("video encode");
+    ConvertedFrame picture;
+
+    while (m_picture_queue->pop(picture)) {
+        auto start_time = std::chrono::steady_clock::now();
+        trace::Span span("encode", trace::frame_id(picture.timestamp));
+        auto blocked_before = m_video_encode_meter.blocked();
+
+        try {
+            if (!m_video_encoder->encode_converted_frame(picture)) {
+                m_frames_failed++;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Error processing video frame: " << e.what() << "\n";
+            m_frames_failed++;
+        }
+
+        // The convert stage fills it again; if the pool is full it is freed
+        m_picture_pool->try_push(std::move(picture));
+
+        auto elapsed = std::chrono::steady_clock::now() - start_time;
+        auto service = elapsed - (m_video_encode_meter.blocked() - blocked_before);
+        m_video_encode_meter.record(service);
+
+        // Frames waiting anywhere ahead of the encoder count as backlog
+        if (m_adaptive_speed) {
+            double service_ms = std::chrono::duration<double, std::milli>(service).count();
+            int level = m_rate_controller.on_frame(service_ms, m_video_queue->size() + m_picture_queue->size());
+            if (level >= 0) {
+                m_video_encoder->request_speed_level(level, m_rate_controller.last_reason());
+            }
+            // A change the encoder could not make, or a clamped request
+            m_rate_controller.sync_level(m_video_encoder->requested_speed_level());
+        }
+    }
+
+    // Flush while the mux stage is still taking packets
+    m_video_encoder->finalize();
+    m_video_encode_meter.unbind_thread();
+}
+
+void CaptureEngine::audio_encode_loop() {
+    m_audio_encode_meter.bind_thread();
+    trace::set_thread_name("audio encode");
+    AudioSample sample;
 
-    while (!m_should_stop) {
-        auto current_time = std::chrono::high_resolution_clock::now();
-        auto elapsed = current_time - last_frame_time;
+    while (m_audio_queue->pop(sample)) {
+        auto start_time = std::chrono::steady_clock::now();
+        trace::Span span("audio encode");
+        auto blocked_before = m_audio_encode_meter.blocked();
 
-        if (elapsed >= target_frame_duration) {
-            // Frame timing is handled by the capture callbacks
-            last_frame_time = current_time;
+        try {
+            m_audio_encoder->encode_audio_sample(sample);
+        } catch (const std::exception& e) {
+            std::cerr << "Error processing audio sample: " << e.what() << "\n";
         }
 
-        // Small sleep to prevent busy waiting
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        auto elapsed = std::chrono::steady_clock::now() - start_time;
+        m_audio_encode_meter.record(elapsed - (m_audio_encode_meter.blocked() - blocked_before));
+    }
+
+    // Flushed here, so the audio tail never waits behind the video flush
+    if (m_audio_encoder) {
+        m_audio_encoder->finalize();
     }
+    m_audio_encode_meter.unbind_thread();
+}
+
+void CaptureEngine::mux_loop() {
+    m_mux_meter.bind_thread();
+    trace::set_thread_name("mux");
+    EncodedPacket packet;
+
+    // av_interleaved_write_frame orders video and audio by timestamp
+    while (m_mux_queue->pop(packet)) {
+        auto start_time = std::chrono::steady_clock::now();
+        bool is_video = packet.stream == StreamType::VIDEO;
+        trace::Span span("mux", is_video ? static_cast<uint64_t>(packet.pts()) : trace::kNoFrame);
+        if (m_replay_buffer) {
+            if (is_video) {
+                m_frames_written++;
+            }
+            m_replay_buffer->add(packet);
+        } else {
+            write_encoded_packet(packet);
+        }
+        packet = EncodedPacket{};
+        m_mux_meter.record(std::chrono::steady_clock::now() - start_time);
+    }
+    m_mux_meter.unbind_thread();
 }
 
 void CaptureEngine::process_video_frame(const Frame& frame) {
-    if (!m_encoder || !m_mp4_writer) {
+    if (!m_video_queue) {
         return;
     }
+    if (!m_capture_cpu.bound() && !m_should_stop) {
+        m_capture_cpu.bind_current_thread();
+    }
+    m_frames_received++;
+    trace::Span span("queue frame", trace::frame_id(frame.timestamp));
 
-    try {
-        auto encoded_data = m_encoder->encode_video_frame(frame);
-        if (!encoded_data.empty()) {
-            // Calculate timestamp in milliseconds
-            uint64_t timestamp_ms = m_stats.frames_captured * 1000 / m_settings.target_fps;
-            
-            if (m_mp4_writer->write_video_packet(encoded_data, timestamp_ms)) {
-                m_stats.frames_captured++;
-            } else {
-                m_stats.frames_dropped++;
-            }
+    // Copies of a Frame share its pooled buffer, so queueing is cheap
+    {
+        std::lock_guard<std::mutex> lock(m_preview_mutex);
+        m_preview_frame = frame;
+    }
+
+    // With VFR output an unchanged frame only extends the display time of
+    // the one before it, so it never costs an encode
+    if (frame.repeat && m_settings.variable_frame_rate) {
+        m_frames_skipped++;
+        m_tail_skipped = true;
+        return;
+    }
+    m_tail_skipped = false;
+
+    Frame item = frame;
+    if (m_settings.drop_policy == DropPolicy::BLOCK) {
+        // The source waits for the pipeline, so nothing is ever dropped
+        m_video_queue->push(std::move(item));
+    } else if (!m_video_queue->try_push(std::move(item))) {
+        m_queue_overflows++;
+
+        if (m_settings.drop_policy == DropPolicy::DROP_OLDEST) {
+            // Evict the oldest queued frame to make room for this one
+            Frame oldest;
+            m_video_queue->try_pop(oldest);
+            m_video_queue->try_push(std::move(item));
         }
-    } catch (const std::exception& e) {
-        std::cerr << "Error processing video frame: " << e.what() << "\n";
-        m_stats.frames_dropped++;
     }
 }
 
 void CaptureEngine::process_audio_sample(const AudioSample& sample) {
-    if (!m_encoder || !m_mp4_writer) {
+    if (!m_audio_queue) {
         return;
     }
 
-    try {
-        auto encoded_data = m_encoder->encode_audio_sample(sample);
-        if (!encoded_data.empty()) {
-            // Calculate timestamp based on audio sample count
-            // Assuming 1024 samples per AAC frame at the sample rate
-            static uint64_t audio_frame_count = 0;
-            uint64_t timestamp_ms = (audio_frame_count * 1024 * 1000) / sample.sample_rate;
-            
-            if (m_mp4_writer->write_audio_packet(encoded_data, timestamp_ms)) {
-                audio_frame_count++;
-            }
+    AudioSample item = sample;
+    if (m_settings.drop_policy == DropPolicy::BLOCK) {
+        m_audio_queue->push(std::move(item));
+    } else if (!m_audio_queue->try_push(std::move(item))) {
+        std::cerr << "Audio queue full, dropping audio chunk\n";
+    }
+}
+
+void CaptureEngine::queue_encoded_packet(EncodedPacket& packet) {
+    // Runs on whichever encode stage produced the packet
+    StageMeter& meter = packet.stream == StreamType::VIDEO ? m_video_encode_meter : m_audio_encode_meter;
+    auto start_time = std::chrono::steady_clock::now();
+    bool is_video = packet.stream == StreamType::VIDEO;
+    trace::Span span("queue packet", is_video ? static_cast<uint64_t>(packet.pts()) : trace::kNoFrame);
+    if (!m_mux_queue->push(std::move(packet)) && is_video) {
+        m_frames_failed++;
+    }
+    meter.add_blocked(std::chrono::steady_clock::now() - start_time);
+}
+
+void CaptureEngine::write_encoded_packet(EncodedPacket& packet) {
+    if (!m_segment_writer) {
+        return;
+    }
+
+    bool is_video = packet.stream == StreamType::VIDEO;
+    if (m_segment_writer->write_packet(packet)) {
+        if (is_video) {
+            m_frames_written++;
+        } else {
+            m_audio_frame_count++;
         }
-    } catch (const std::exception& e) {
-        std::cerr << "Error processing audio sample: " << e.what() << "\n";
+    } else if (is_video) {
+        m_frames_failed++;
+    }
+}
+
+bool CaptureEngine::save_replay(const std::string& path, double seconds, ReplaySaved done) {
+    if (!m_replay_buffer) {
+        std::cerr << "Replay buffer is not enabled\n";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_replay_mutex);
+    if (m_replay_saving) {
+        std::cerr << "A replay is already being saved\n";
+        return false;
+    }
+    if (m_replay_thread.joinable()) {
+        m_replay_thread.join();  // Finished; only its thread is left
+    }
+
+    // References only, so the live pipeline keeps filling the ring
+    std::vector<EncodedPacket> packets = m_replay_buffer->snapshot(seconds);
+    if (packets.empty()) {
+        std::cerr << "Replay buffer has no keyframe yet\n";
+        return false;
+    }
+
+    m_replay_saving = true;
+    m_replay_thread = std::thread([this, path, packets = std::move(packets), done = std::move(done)]() mutable {
+        trace::set_thread_name("replay save");
+        trace::Span span("save replay");
+        bool ok = write_replay(path, packets);
+        if (ok) {
+            m_replays_saved++;
+        }
+        m_replay_saving = false;
+        if (done) {
+            done(ok, path);
+        }
+    });
+    return true;
+}
+
+bool CaptureEngine::write_replay(const std::string& path, std::vector<EncodedPacket>& packets) const {
+    MP4Writer writer;
+    if (!writer.initialize(path, m_video_stream_info, m_settings.target_fps, m_audio_sample_rate, m_audio_channels)) {
+        std::cerr << "Failed to open replay file: " << path << "\n";
+        return false;
+    }
+
+    size_t written = 0;
+    for (auto& packet : packets) {
+        if (writer.write_packet(packet)) {
+            written++;
+        }
+    }
+    if (!writer.finalize()) {
+        std::cerr << "Failed to save replay: " << path << "\n";
+        return false;
     }
+    std::cout << "Replay saved: " << path << " (" << written << " of " << packets.size() << " packets)\n";
+    return written > 0;
 }
 
-} // namespace playrec
\ No newline at end of file
+} // namespace playrec
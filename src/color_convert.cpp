@@ -0,0 +1,83 @@
+#include "color_convert.h"
+#include "color_convert_kernels.h"
+
+namespace playrec {
+
+namespace {
+
+struct ScalarBlock {
+    static constexpr bool kVector = false;
+    static constexpr int kStep = 2;
+
+    template <int BPP>
+    static constexpr int reach() { return kStep; }
+
+    template <int BPP, bool RGB_ORDER, bool NV12>
+    static void convert(const uint8_t*, const uint8_t*, uint8_t*, uint8_t*, uint8_t*, uint8_t*, int) {}
+};
+
+bool isa_supported(ColorKernelIsa isa) {
+    switch (isa) {
+        case ColorKernelIsa::SCALAR:
+            return true;
+#if defined(PLAYREC_HAVE_X86_KERNELS)
+        case ColorKernelIsa::SSE41:
+            return __builtin_cpu_supports("sse4.1");
+        case ColorKernelIsa::AVX2:
+            return __builtin_cpu_supports("avx2");
+        case ColorKernelIsa::AVX512:
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+        default:
+            return false;
+    }
+}
+
+} // namespace
+
+ColorKernelIsa detect_color_kernel_isa() {
+    static const ColorKernelIsa best = [] {
+        for (auto isa : {ColorKernelIsa::AVX512, ColorKernelIsa::AVX2, ColorKernelIsa::SSE41}) {
+            if (isa_supported(isa)) {
+                return isa;
+            }
+        }
+        return ColorKernelIsa::SCALAR;
+    }();
+    return best;
+}
+
+ColorKernel get_color_kernel(VideoFormat src, VideoFormat dst) {
+    return get_color_kernel(src, dst, detect_color_kernel_isa());
+}
+
+ColorKernel get_color_kernel(VideoFormat src, VideoFormat dst, ColorKernelIsa isa) {
+    if (!isa_supported(isa)) {
+        return nullptr;
+    }
+
+    switch (isa) {
+#if defined(PLAYREC_HAVE_X86_KERNELS)
+        case ColorKernelIsa::SSE41:
+            return get_color_kernel_sse41(src, dst);
+        case ColorKernelIsa::AVX2:
+            return get_color_kernel_avx2(src, dst);
+        case ColorKernelIsa::AVX512:
+            return get_color_kernel_avx512(src, dst);
+#endif
+        default:
+            return select_kernel<ScalarBlock>(src, dst);
+    }
+}
+
+const char* color_kernel_isa_name(ColorKernelIsa isa) {
+    switch (isa) {
+        case ColorKernelIsa::SCALAR: return "scalar";
+        case ColorKernelIsa::SSE41:  return "SSE4.1";
+        case ColorKernelIsa::AVX2:   return "AVX2";
+        case ColorKernelIsa::AVX512: return "AVX-512";
+    }
+    return "unknown";
+}
+
+} // namespace playrec
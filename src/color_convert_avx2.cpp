@@ -0,0 +1,104 @@
+// Compiled with -mavx2; only reached after the CPU check in color_convert.cpp
+#include "color_convert_kernels.h"
+#include <immintrin.h>
+
+namespace playrec {
+
+namespace {
+
+// 16 pixels of a row pair per step, as two vectors of eight 32-bit pixels.
+// Packs and horizontal adds work per 128-bit lane, so results are put back
+// in order with a 64-bit permute (0xD8 swaps the middle quarters).
+struct Avx2Block {
+    static constexpr bool kVector = true;
+    static constexpr int kStep = 16;
+
+    // RGB24 loads 16 bytes at pixel x + 12, i.e. 52 bytes past x
+    template <int BPP>
+    static constexpr int reach() { return BPP == 4 ? 16 : 18; }
+
+    template <int BPP>
+    static __m256i load8(const uint8_t* p) {
+        if (BPP == 4) {
+            return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        }
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 12));
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kRgb24Shuffle));
+        return _mm256_shuffle_epi8(v, _mm256_broadcastsi128_si256(mask));
+    }
+
+    static __m256i even_bytes(__m256i px) {
+        return _mm256_and_si256(px, _mm256_set1_epi32(0x00ff00ff));
+    }
+    static __m256i odd_bytes(__m256i px) {
+        return _mm256_and_si256(_mm256_srli_epi32(px, 8), _mm256_set1_epi32(0x00ff00ff));
+    }
+
+    static __m256i weigh(__m256i even, __m256i odd, int32_t even_coeff, int32_t odd_coeff, int offset) {
+        __m256i sum = _mm256_add_epi32(_mm256_madd_epi16(even, _mm256_set1_epi32(even_coeff)),
+                                       _mm256_madd_epi16(odd, _mm256_set1_epi32(odd_coeff)));
+        sum = _mm256_srai_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(128)), 8);
+        return _mm256_add_epi32(sum, _mm256_set1_epi32(offset));
+    }
+
+    // Narrow two vectors of eight 32-bit values to 16 bytes in order
+    static __m128i pack_bytes(__m256i a, __m256i b) {
+        __m256i words = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+        __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0xD8);
+        return _mm256_castsi256_si128(bytes);
+    }
+
+    template <bool RGB_ORDER>
+    static void store_luma(uint8_t* dst, __m256i a, __m256i b) {
+        using C = PixelCoeffs<RGB_ORDER>;
+        __m256i ya = weigh(even_bytes(a), odd_bytes(a), C::y_even, C::y_odd, 16);
+        __m256i yb = weigh(even_bytes(b), odd_bytes(b), C::y_even, C::y_odd, 16);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), pack_bytes(ya, yb));
+    }
+
+    template <int BPP, bool RGB_ORDER, bool NV12>
+    static void convert(const uint8_t* row0, const uint8_t* row1,
+                        uint8_t* luma0, uint8_t* luma1,
+                        uint8_t* chroma_u, uint8_t* chroma_v, int x) {
+        using C = PixelCoeffs<RGB_ORDER>;
+        __m256i a0 = load8<BPP>(row0 + x * BPP);
+        __m256i b0 = load8<BPP>(row0 + (x + 8) * BPP);
+        __m256i a1 = load8<BPP>(row1 + x * BPP);
+        __m256i b1 = load8<BPP>(row1 + (x + 8) * BPP);
+
+        store_luma<RGB_ORDER>(luma0 + x, a0, b0);
+        store_luma<RGB_ORDER>(luma1 + x, a1, b1);
+
+        // Blocks come out as 0 1 4 5 | 2 3 6 7 and are reordered by the permute
+        __m256i even = _mm256_hadd_epi32(_mm256_add_epi16(even_bytes(a0), even_bytes(a1)),
+                                         _mm256_add_epi16(even_bytes(b0), even_bytes(b1)));
+        __m256i odd = _mm256_hadd_epi32(_mm256_add_epi16(odd_bytes(a0), odd_bytes(a1)),
+                                        _mm256_add_epi16(odd_bytes(b0), odd_bytes(b1)));
+        even = _mm256_permute4x64_epi64(even, 0xD8);
+        odd = _mm256_permute4x64_epi64(odd, 0xD8);
+        even = _mm256_srli_epi16(_mm256_add_epi16(even, _mm256_set1_epi16(2)), 2);
+        odd = _mm256_srli_epi16(_mm256_add_epi16(odd, _mm256_set1_epi16(2)), 2);
+
+        __m256i u = weigh(even, odd, C::u_even, C::u_odd, 128);
+        __m256i v = weigh(even, odd, C::v_even, C::v_odd, 128);
+        __m128i uv = pack_bytes(u, v);  // u0-7 v0-7
+
+        if (NV12) {
+            __m128i interleaved = _mm_unpacklo_epi8(uv, _mm_srli_si128(uv, 8));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(chroma_u + x), interleaved);
+        } else {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(chroma_u + x / 2), uv);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(chroma_v + x / 2), _mm_srli_si128(uv, 8));
+        }
+    }
+};
+
+} // namespace
+
+ColorKernel get_color_kernel_avx2(VideoFormat src, VideoFormat dst) {
+    return select_kernel<Avx2Block>(src, dst);
+}
+
+} // namespace playrec
@@ -0,0 +1,106 @@
+// Compiled with -mavx512f -mavx512bw; only reached after the CPU check in
+// color_convert.cpp
+#include "color_convert_kernels.h"
+#include <immintrin.h>
+
+// GCC 12 flags the _mm512_undefined_epi32() passthrough inside its own
+// shift intrinsics as maybe-uninitialized
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+namespace playrec {
+
+namespace {
+
+// 32 pixels of a row pair per step, as two vectors of sixteen 32-bit
+// pixels. vpmovdb narrows in order, so no lane fix-ups are needed.
+struct Avx512Block {
+    static constexpr bool kVector = true;
+    static constexpr int kStep = 32;
+
+    // RGB24 loads 16 bytes at pixel x + 28, i.e. 100 bytes past x
+    template <int BPP>
+    static constexpr int reach() { return BPP == 4 ? 32 : 34; }
+
+    template <int BPP>
+    static __m512i load16(const uint8_t* p) {
+        if (BPP == 4) {
+            return _mm512_loadu_si512(p);
+        }
+        __m512i v = _mm512_castsi128_si512(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+        v = _mm512_inserti32x4(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 12)), 1);
+        v = _mm512_inserti32x4(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 24)), 2);
+        v = _mm512_inserti32x4(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 36)), 3);
+        __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kRgb24Shuffle));
+        return _mm512_shuffle_epi8(v, _mm512_broadcast_i32x4(mask));
+    }
+
+    static __m512i even_bytes(__m512i px) {
+        return _mm512_and_si512(px, _mm512_set1_epi32(0x00ff00ff));
+    }
+    static __m512i odd_bytes(__m512i px) {
+        return _mm512_and_si512(_mm512_srli_epi32(px, 8), _mm512_set1_epi32(0x00ff00ff));
+    }
+
+    static __m512i weigh(__m512i even, __m512i odd, int32_t even_coeff, int32_t odd_coeff, int offset) {
+        __m512i sum = _mm512_add_epi32(_mm512_madd_epi16(even, _mm512_set1_epi32(even_coeff)),
+                                       _mm512_madd_epi16(odd, _mm512_set1_epi32(odd_coeff)));
+        sum = _mm512_srai_epi32(_mm512_add_epi32(sum, _mm512_set1_epi32(128)), 8);
+        return _mm512_add_epi32(sum, _mm512_set1_epi32(offset));
+    }
+
+    // Sum adjacent pixels of a row-summed vector into eight 2x2 block sums
+    static __m256i pair_sums(__m512i rows) {
+        return _mm512_cvtepi64_epi32(_mm512_add_epi32(rows, _mm512_srli_epi64(rows, 32)));
+    }
+
+    static __m512i block_average(__m512i a0, __m512i a1, __m512i b0, __m512i b1) {
+        __m512i sums = _mm512_inserti64x4(_mm512_castsi256_si512(pair_sums(_mm512_add_epi16(a0, a1))),
+                                          pair_sums(_mm512_add_epi16(b0, b1)), 1);
+        return _mm512_srli_epi16(_mm512_add_epi16(sums, _mm512_set1_epi16(2)), 2);
+    }
+
+    template <bool RGB_ORDER>
+    static __m128i luma(__m512i px) {
+        using C = PixelCoeffs<RGB_ORDER>;
+        return _mm512_cvtepi32_epi8(weigh(even_bytes(px), odd_bytes(px), C::y_even, C::y_odd, 16));
+    }
+
+    template <int BPP, bool RGB_ORDER, bool NV12>
+    static void convert(const uint8_t* row0, const uint8_t* row1,
+                        uint8_t* luma0, uint8_t* luma1,
+                        uint8_t* chroma_u, uint8_t* chroma_v, int x) {
+        using C = PixelCoeffs<RGB_ORDER>;
+        __m512i a0 = load16<BPP>(row0 + x * BPP);
+        __m512i b0 = load16<BPP>(row0 + (x + 16) * BPP);
+        __m512i a1 = load16<BPP>(row1 + x * BPP);
+        __m512i b1 = load16<BPP>(row1 + (x + 16) * BPP);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(luma0 + x), luma<RGB_ORDER>(a0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(luma0 + x + 16), luma<RGB_ORDER>(b0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(luma1 + x), luma<RGB_ORDER>(a1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(luma1 + x + 16), luma<RGB_ORDER>(b1));
+
+        __m512i even = block_average(even_bytes(a0), even_bytes(a1), even_bytes(b0), even_bytes(b1));
+        __m512i odd = block_average(odd_bytes(a0), odd_bytes(a1), odd_bytes(b0), odd_bytes(b1));
+        __m128i u = _mm512_cvtepi32_epi8(weigh(even, odd, C::u_even, C::u_odd, 128));
+        __m128i v = _mm512_cvtepi32_epi8(weigh(even, odd, C::v_even, C::v_odd, 128));
+
+        if (NV12) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(chroma_u + x), _mm_unpacklo_epi8(u, v));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(chroma_u + x + 16), _mm_unpackhi_epi8(u, v));
+        } else {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(chroma_u + x / 2), u);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(chroma_v + x / 2), v);
+        }
+    }
+};
+
+} // namespace
+
+ColorKernel get_color_kernel_avx512(VideoFormat src, VideoFormat dst) {
+    return select_kernel<Avx512Block>(src, dst);
+}
+
+} // namespace playrec
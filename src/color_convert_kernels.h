@@ -0,0 +1,156 @@
+#pragma once
+
+// Shared pieces of the color conversion kernels. Included by each
+// instruction-set specific translation unit, so everything here has
+// internal linkage: code compiled with -mavx2 must never be merged with
+// the copy another file compiled for the baseline target.
+
+#include "color_convert.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace playrec {
+
+// Per-ISA kernel lookup, defined only when the file is part of the build
+ColorKernel get_color_kernel_sse41(VideoFormat src, VideoFormat dst);
+ColorKernel get_color_kernel_avx2(VideoFormat src, VideoFormat dst);
+ColorKernel get_color_kernel_avx512(VideoFormat src, VideoFormat dst);
+
+namespace {
+
+// BT.709 limited range, 8-bit fixed point. Rows sum to 220/256 for luma
+// and to zero for chroma, so white maps to 235 and grays have no tint.
+constexpr int kYR = 47, kYG = 157, kYB = 16;
+constexpr int kUR = -26, kUG = -86, kUB = 112;
+constexpr int kVR = 112, kVG = -102, kVB = -10;
+
+inline uint8_t rgb_to_y(int r, int g, int b) {
+    return static_cast<uint8_t>(((kYR * r + kYG * g + kYB * b + 128) >> 8) + 16);
+}
+
+inline uint8_t rgb_to_u(int r, int g, int b) {
+    return static_cast<uint8_t>(((kUR * r + kUG * g + kUB * b + 128) >> 8) + 128);
+}
+
+inline uint8_t rgb_to_v(int r, int g, int b) {
+    return static_cast<uint8_t>(((kVR * r + kVG * g + kVB * b + 128) >> 8) + 128);
+}
+
+// Pack two signed 16-bit coefficients as they sit in a 32-bit lane: the
+// first multiplies byte 0 of a pixel, the second byte 2 (or byte 1 and 3)
+constexpr int32_t coeff_pair(int low, int high) {
+    return static_cast<int32_t>((static_cast<uint32_t>(static_cast<uint16_t>(high)) << 16) |
+                                static_cast<uint16_t>(low));
+}
+
+// Coefficients for the (byte 0, byte 2) and (byte 1, byte 3) halves of a
+// pixel, for RGB or BGR byte order. Byte 3 is alpha or padding.
+template <bool RGB_ORDER>
+struct PixelCoeffs {
+    static constexpr int32_t y_even = RGB_ORDER ? coeff_pair(kYR, kYB) : coeff_pair(kYB, kYR);
+    static constexpr int32_t u_even = RGB_ORDER ? coeff_pair(kUR, kUB) : coeff_pair(kUB, kUR);
+    static constexpr int32_t v_even = RGB_ORDER ? coeff_pair(kVR, kVB) : coeff_pair(kVB, kVR);
+    static constexpr int32_t y_odd = coeff_pair(kYG, 0);
+    static constexpr int32_t u_odd = coeff_pair(kUG, 0);
+    static constexpr int32_t v_odd = coeff_pair(kVG, 0);
+};
+
+// Expands 3-byte pixels to 4-byte lanes with a zero pad byte (pshufb mask)
+constexpr int8_t kRgb24Shuffle[16] = {0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1};
+
+template <int BPP, bool RGB_ORDER>
+inline void load_pixel(const uint8_t* p, int& r, int& g, int& b) {
+    r = RGB_ORDER ? p[0] : p[2];
+    g = p[1];
+    b = RGB_ORDER ? p[2] : p[0];
+}
+
+// Convert columns [x, width) of a row pair; x must be even. luma1 is null
+// when row0 is the last row of an odd-height image (row1 == row0 then).
+template <int BPP, bool RGB_ORDER, bool NV12>
+inline void convert_span_scalar(const uint8_t* row0, const uint8_t* row1,
+                                uint8_t* luma0, uint8_t* luma1,
+                                uint8_t* chroma_u, uint8_t* chroma_v,
+                                int x, int width) {
+    for (; x < width; x += 2) {
+        int x1 = x + 1 < width ? x + 1 : x;
+        int r[4], g[4], b[4];
+        load_pixel<BPP, RGB_ORDER>(row0 + x * BPP, r[0], g[0], b[0]);
+        load_pixel<BPP, RGB_ORDER>(row0 + x1 * BPP, r[1], g[1], b[1]);
+        load_pixel<BPP, RGB_ORDER>(row1 + x * BPP, r[2], g[2], b[2]);
+        load_pixel<BPP, RGB_ORDER>(row1 + x1 * BPP, r[3], g[3], b[3]);
+
+        luma0[x] = rgb_to_y(r[0], g[0], b[0]);
+        luma0[x1] = rgb_to_y(r[1], g[1], b[1]);
+        if (luma1) {
+            luma1[x] = rgb_to_y(r[2], g[2], b[2]);
+            luma1[x1] = rgb_to_y(r[3], g[3], b[3]);
+        }
+
+        int avg_r = (r[0] + r[1] + r[2] + r[3] + 2) >> 2;
+        int avg_g = (g[0] + g[1] + g[2] + g[3] + 2) >> 2;
+        int avg_b = (b[0] + b[1] + b[2] + b[3] + 2) >> 2;
+        if (NV12) {
+            chroma_u[x] = rgb_to_u(avg_r, avg_g, avg_b);
+            chroma_u[x + 1] = rgb_to_v(avg_r, avg_g, avg_b);
+        } else {
+            chroma_u[x / 2] = rgb_to_u(avg_r, avg_g, avg_b);
+            chroma_v[x / 2] = rgb_to_v(avg_r, avg_g, avg_b);
+        }
+    }
+}
+
+// Walks the image two rows at a time. Block converts Block::kStep pixels of
+// a row pair with vector code while Block::reach() pixels can be read
+// without leaving the row; the remainder goes through the scalar span.
+// A Block with kVector false leaves the whole row to the scalar span.
+template <typename Block, int BPP, bool RGB_ORDER, bool NV12>
+struct Kernel {
+    static void run(const uint8_t* src, int src_stride, int width, int height,
+                    uint8_t* const dst[3], const int dst_stride[3]) {
+        for (int y = 0; y < height; y += 2) {
+            bool pair = y + 1 < height;
+            const uint8_t* row0 = src + static_cast<size_t>(y) * src_stride;
+            const uint8_t* row1 = pair ? row0 + src_stride : row0;
+            uint8_t* luma0 = dst[0] + static_cast<size_t>(y) * dst_stride[0];
+            uint8_t* luma1 = pair ? luma0 + dst_stride[0] : nullptr;
+            uint8_t* chroma_u = dst[1] + static_cast<size_t>(y / 2) * dst_stride[1];
+            uint8_t* chroma_v = NV12 ? nullptr : dst[2] + static_cast<size_t>(y / 2) * dst_stride[2];
+
+            int x = 0;
+            if (Block::kVector && pair) {
+                for (; x + Block::template reach<BPP>() <= width; x += Block::kStep) {
+                    Block::template convert<BPP, RGB_ORDER, NV12>(row0, row1, luma0, luma1,
+                                                                  chroma_u, chroma_v, x);
+                }
+            }
+            convert_span_scalar<BPP, RGB_ORDER, NV12>(row0, row1, luma0, luma1,
+                                                      chroma_u, chroma_v, x, width);
+        }
+    }
+};
+
+// Pick the Kernel instantiation for a format pair
+template <typename Block>
+ColorKernel select_kernel(VideoFormat src, VideoFormat dst) {
+    if (dst != VideoFormat::YUV420P && dst != VideoFormat::NV12) {
+        return nullptr;
+    }
+    bool nv12 = dst == VideoFormat::NV12;
+    switch (src) {
+        case VideoFormat::BGRA32:
+            return nv12 ? &Kernel<Block, 4, false, true>::run : &Kernel<Block, 4, false, false>::run;
+        case VideoFormat::RGBA32:
+            return nv12 ? &Kernel<Block, 4, true, true>::run : &Kernel<Block, 4, true, false>::run;
+        case VideoFormat::BGR24:
+            return nv12 ? &Kernel<Block, 3, false, true>::run : &Kernel<Block, 3, false, false>::run;
+        case VideoFormat::RGB24:
+            return nv12 ? &Kernel<Block, 3, true, true>::run : &Kernel<Block, 3, true, false>::run;
+        default:
+            return nullptr;
+    }
+}
+
+} // namespace
+
+} // namespace playrec
@@ -0,0 +1,98 @@
+// Compiled with -msse4.1; only reached after the CPU check in color_convert.cpp
+#include "color_convert_kernels.h"
+#include <immintrin.h>
+#include <cstring>
+
+namespace playrec {
+
+namespace {
+
+// 8 pixels of a row pair per step, as two vectors of four 32-bit pixels
+struct Sse41Block {
+    static constexpr bool kVector = true;
+    static constexpr int kStep = 8;
+
+    // RGB24 loads 16 bytes at pixel x + 4, i.e. 28 bytes past x
+    template <int BPP>
+    static constexpr int reach() { return BPP == 4 ? 8 : 10; }
+
+    template <int BPP>
+    static __m128i load4(const uint8_t* p) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        if (BPP == 3) {
+            v = _mm_shuffle_epi8(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(kRgb24Shuffle)));
+        }
+        return v;
+    }
+
+    // Split pixels into the 16-bit (byte 0, byte 2) and (byte 1, byte 3) halves
+    static __m128i even_bytes(__m128i px) {
+        return _mm_and_si128(px, _mm_set1_epi32(0x00ff00ff));
+    }
+    static __m128i odd_bytes(__m128i px) {
+        return _mm_and_si128(_mm_srli_epi32(px, 8), _mm_set1_epi32(0x00ff00ff));
+    }
+
+    // Weighted sum of both halves, rounded and offset, as 32-bit lanes
+    static __m128i weigh(__m128i even, __m128i odd, int32_t even_coeff, int32_t odd_coeff, int offset) {
+        __m128i sum = _mm_add_epi32(_mm_madd_epi16(even, _mm_set1_epi32(even_coeff)),
+                                    _mm_madd_epi16(odd, _mm_set1_epi32(odd_coeff)));
+        sum = _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8);
+        return _mm_add_epi32(sum, _mm_set1_epi32(offset));
+    }
+
+    template <bool RGB_ORDER>
+    static void store_luma(uint8_t* dst, __m128i a, __m128i b) {
+        using C = PixelCoeffs<RGB_ORDER>;
+        __m128i ya = weigh(even_bytes(a), odd_bytes(a), C::y_even, C::y_odd, 16);
+        __m128i yb = weigh(even_bytes(b), odd_bytes(b), C::y_even, C::y_odd, 16);
+        __m128i y16 = _mm_packs_epi32(ya, yb);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), _mm_packus_epi16(y16, y16));
+    }
+
+    template <int BPP, bool RGB_ORDER, bool NV12>
+    static void convert(const uint8_t* row0, const uint8_t* row1,
+                        uint8_t* luma0, uint8_t* luma1,
+                        uint8_t* chroma_u, uint8_t* chroma_v, int x) {
+        using C = PixelCoeffs<RGB_ORDER>;
+        __m128i a0 = load4<BPP>(row0 + x * BPP);
+        __m128i b0 = load4<BPP>(row0 + (x + 4) * BPP);
+        __m128i a1 = load4<BPP>(row1 + x * BPP);
+        __m128i b1 = load4<BPP>(row1 + (x + 4) * BPP);
+
+        store_luma<RGB_ORDER>(luma0 + x, a0, b0);
+        store_luma<RGB_ORDER>(luma1 + x, a1, b1);
+
+        // Vertical sums per pixel, then horizontal pair sums per 2x2 block.
+        // 32-bit adds are safe on the packed 16-bit halves (at most 1020).
+        __m128i even = _mm_hadd_epi32(_mm_add_epi16(even_bytes(a0), even_bytes(a1)),
+                                      _mm_add_epi16(even_bytes(b0), even_bytes(b1)));
+        __m128i odd = _mm_hadd_epi32(_mm_add_epi16(odd_bytes(a0), odd_bytes(a1)),
+                                     _mm_add_epi16(odd_bytes(b0), odd_bytes(b1)));
+        even = _mm_srli_epi16(_mm_add_epi16(even, _mm_set1_epi16(2)), 2);
+        odd = _mm_srli_epi16(_mm_add_epi16(odd, _mm_set1_epi16(2)), 2);
+
+        __m128i u = weigh(even, odd, C::u_even, C::u_odd, 128);
+        __m128i v = weigh(even, odd, C::v_even, C::v_odd, 128);
+        __m128i uv16 = _mm_packs_epi32(u, v);
+        __m128i uv = _mm_packus_epi16(uv16, uv16);  // u0-3 v0-3
+
+        if (NV12) {
+            __m128i interleaved = _mm_unpacklo_epi8(uv, _mm_srli_si128(uv, 4));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(chroma_u + x), interleaved);
+        } else {
+            uint32_t u4 = static_cast<uint32_t>(_mm_cvtsi128_si32(uv));
+            uint32_t v4 = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(uv, 4)));
+            std::memcpy(chroma_u + x / 2, &u4, sizeof(u4));
+            std::memcpy(chroma_v + x / 2, &v4, sizeof(v4));
+        }
+    }
+};
+
+} // namespace
+
+ColorKernel get_color_kernel_sse41(VideoFormat src, VideoFormat dst) {
+    return select_kernel<Sse41Block>(src, dst);
+}
+
+} // namespace playrec
@@ -0,0 +1,70 @@
+#include "encoded_packet.h"
+#include <utility>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+namespace playrec {
+
+EncodedPacket::EncodedPacket(AVPacket* packet) : m_packet(packet) {}
+
+EncodedPacket::~EncodedPacket() {
+    if (m_packet) {
+        av_packet_free(&m_packet);
+    }
+}
+
+EncodedPacket::EncodedPacket(EncodedPacket&& other) noexcept
+    : stream(other.stream), m_packet(std::exchange(other.m_packet, nullptr)) {}
+
+EncodedPacket& EncodedPacket::operator=(EncodedPacket&& other) noexcept {
+    if (this != &other) {
+        if (m_packet) {
+            av_packet_free(&m_packet);
+        }
+        m_packet = std::exchange(other.m_packet, nullptr);
+        stream = other.stream;
+    }
+    return *this;
+}
+
+EncodedPacket EncodedPacket::allocate() {
+    return EncodedPacket(av_packet_alloc());
+}
+
+EncodedPacket EncodedPacket::ref() const {
+    EncodedPacket copy;
+    copy.stream = stream;
+    if (m_packet) {
+        // av_packet_clone only bumps the payload's refcount
+        copy.m_packet = av_packet_clone(m_packet);
+    }
+    return copy;
+}
+
+AVPacket* EncodedPacket::release() {
+    return std::exchange(m_packet, nullptr);
+}
+
+const uint8_t* EncodedPacket::data() const {
+    return m_packet ? m_packet->data : nullptr;
+}
+
+size_t EncodedPacket::size() const {
+    return m_packet && m_packet->size > 0 ? static_cast<size_t>(m_packet->size) : 0;
+}
+
+int64_t EncodedPacket::pts() const {
+    return m_packet ? m_packet->pts : 0;
+}
+
+int64_t EncodedPacket::dts() const {
+    return m_packet ? m_packet->dts : 0;
+}
+
+bool EncodedPacket::is_keyframe() const {
+    return m_packet && (m_packet->flags & AV_PKT_FLAG_KEY);
+}
+
+} // namespace playrec
@@ -1,732 +1,1150 @@
 #include "encoder.h"
+#include "latency_histogram.h"
+#include "trace.h"
 #include <iostream>
 #include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/opt.h>
 #include <libavutil/imgutils.h>
-#include <libswscale/swscale.h>
 #include <libswresample/swresample.h>
+#include <libavutil/audio_fifo.h>
 #include <libavutil/channel_layout.h>
 }
 
 namespace playrec {
 
-// Base Encoder implementation
-Encoder::Encoder() = default;
-Encoder::~Encoder() = default;
+namespace {
 
-// H.264 Encoder implementation
-struct H264Encoder::Impl {
-    AVCodecContext* video_codec_context = nullptr;
-    AVCodecContext* audio_codec_context = nullptr;
-    AVFrame* video_frame = nullptr;
-    AVFrame* audio_frame = nullptr;
-    AVPacket* packet = nullptr;
-    SwsContext* sws_context = nullptr;
+// Video is stamped on the 90 kHz MPEG clock: fine enough that capture-clock
+// jitter survives rounding at any frame rate, and the usual VFR track timescale
+constexpr int kVideoClockRate = 90000;
+
+// Hand every packet the codec has ready to the callback, in the codec's
+// time base. Returns 0 once the codec needs more input, or an AVERROR.
+int drain_packets(AVCodecContext* context, StreamType stream, EncodedPacket& packet,
+                  const PacketCallback& callback) {
+    for (;;) {
+        if (!packet) {
+            // The previous packet was kept by the consumer
+            packet = EncodedPacket::allocate();
+            if (!packet) {
+                return AVERROR(ENOMEM);
+            }
+        }
+
+        int ret = avcodec_receive_packet(context, packet.get());
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            return 0;
+        } else if (ret < 0) {
+            return ret;
+        }
+
+        packet.get()->time_base = context->time_base;
+        packet.stream = stream;
+        if (callback) {
+            callback(packet);
+        }
+        if (packet) {
+            av_packet_unref(packet.get());
+        }
+    }
+}
+
+// Converts captured interleaved S16 chunks to the codec's planar float and
+// re-cuts them into frames of exactly the codec's frame size, whatever the
+// capture chunk size, so AAC gets no padding and one call per frame.
+struct AudioFramer {
     SwrContext* swr_context = nullptr;
-    
-    bool initialized = false;
-    CaptureSettings settings;
-    int video_width = 0;
-    int video_height = 0;
-    AudioFormat audio_format = AudioFormat::PCM_S16LE;
-    int sample_rate = 44100;
-    int channels = 2;
-    int64_t video_pts = 0;
-    int64_t audio_pts = 0;
-    
-    ~Impl() {
+    AVAudioFifo* fifo = nullptr;
+    uint8_t** scratch = nullptr;  // Converted chunk on its way into the FIFO
+    int scratch_samples = 0;
+    int channels = 0;
+    int frame_size = 0;
+    bool small_last_frame = false;
+    AVSampleFormat sample_fmt = AV_SAMPLE_FMT_FLTP;
+
+    ~AudioFramer() {
         cleanup();
     }
-    
+
     void cleanup() {
-        if (sws_context) {
-            sws_freeContext(sws_context);
-            sws_context = nullptr;
-        }
         if (swr_context) {
             swr_free(&swr_context);
         }
-        if (packet) {
-            av_packet_free(&packet);
+        if (fifo) {
+            av_audio_fifo_free(fifo);
+            fifo = nullptr;
         }
-        if (video_frame) {
-            av_frame_free(&video_frame);
+        if (scratch) {
+            av_freep(&scratch[0]);
+            av_freep(&scratch);
         }
-        if (audio_frame) {
-            av_frame_free(&audio_frame);
+        scratch_samples = 0;
+    }
+
+    bool initialize(const AVCodecContext* context, int sample_rate, int input_channels) {
+        channels = context->ch_layout.nb_channels;
+        sample_fmt = context->sample_fmt;
+        // Codecs without a fixed frame size take whatever is buffered
+        frame_size = context->frame_size > 0 ? context->frame_size : 1024;
+        small_last_frame = (context->codec->capabilities & AV_CODEC_CAP_SMALL_LAST_FRAME) != 0;
+
+        swr_context = swr_alloc();
+        if (!swr_context) {
+            std::cerr << "Could not allocate audio resampling context" << std::endl;
+            return false;
         }
-        if (video_codec_context) {
-            avcodec_free_context(&video_codec_context);
+
+        AVChannelLayout in_ch_layout;
+        av_channel_layout_default(&in_ch_layout, input_channels);
+
+        av_opt_set_chlayout(swr_context, "in_chlayout", &in_ch_layout, 0);
+        av_opt_set_chlayout(swr_context, "out_chlayout", &context->ch_layout, 0);
+        av_opt_set_int(swr_context, "in_sample_rate", sample_rate, 0);
+        av_opt_set_int(swr_context, "out_sample_rate", sample_rate, 0);
+        av_opt_set_sample_fmt(swr_context, "in_sample_fmt", AV_SAMPLE_FMT_S16, 0);
+        av_opt_set_sample_fmt(swr_context, "out_sample_fmt", sample_fmt, 0);
+
+        if (swr_init(swr_context) < 0) {
+            std::cerr << "Could not initialize audio resampling context" << std::endl;
+            return false;
+        }
+
+        // Room for a few frames; the FIFO grows itself if capture bursts
+        fifo = av_audio_fifo_alloc(sample_fmt, channels, frame_size * 4);
+        if (!fifo) {
+            std::cerr << "Could not allocate audio FIFO" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Grow the conversion buffer to hold samples
+    bool reserve_scratch(int samples) {
+        if (samples > scratch_samples) {
+            if (scratch) {
+                av_freep(&scratch[0]);
+                av_freep(&scratch);
+            }
+            if (av_samples_alloc_array_and_samples(&scratch, nullptr, channels, samples, sample_fmt, 0) < 0) {
+                scratch = nullptr;
+                scratch_samples = 0;
+                return false;
+            }
+            scratch_samples = samples;
+        }
+        return true;
+    }
+
+    // Convert one interleaved S16 chunk and queue it behind what is buffered
+    bool push(const uint8_t* data, int samples) {
+        if (!reserve_scratch(samples)) {
+            return false;
+        }
+
+        const uint8_t* src_data[1] = {data};
+        int converted = swr_convert(swr_context, scratch, scratch_samples, src_data, samples);
+        if (converted < 0) {
+            return false;
         }
-        if (audio_codec_context) {
-            avcodec_free_context(&audio_codec_context);
+        return av_audio_fifo_write(fifo, reinterpret_cast<void**>(scratch), converted) == converted;
+    }
+
+    // Queue silence behind what is buffered, e.g. for audio capture lost
+    bool push_silence(int samples) {
+        if (!reserve_scratch(samples)) {
+            return false;
         }
+        av_samples_set_silence(scratch, 0, samples, channels, sample_fmt);
+        return av_audio_fifo_write(fifo, reinterpret_cast<void**>(scratch), samples) == samples;
+    }
+
+    int buffered() const {
+        return av_audio_fifo_size(fifo);
+    }
+
+    // Move the next whole frame into frame. When flushing, a final partial
+    // frame goes out short if the codec allows it, else padded with silence.
+    bool pop(AVFrame* frame, bool flush) {
+        int buffered = av_audio_fifo_size(fifo);
+        if (buffered <= 0 || (buffered < frame_size && !flush)) {
+            return false;
+        }
+        if (av_frame_make_writable(frame) < 0) {
+            return false;
+        }
+
+        int samples = std::min(buffered, frame_size);
+        if (av_audio_fifo_read(fifo, reinterpret_cast<void**>(frame->data), samples) != samples) {
+            return false;
+        }
+        frame->nb_samples = samples;
+        if (samples < frame_size && !small_last_frame) {
+            av_samples_set_silence(frame->data, samples, frame_size - samples, channels, sample_fmt);
+            frame->nb_samples = frame_size;
+        }
+        return true;
     }
 };
 
-H264Encoder::H264Encoder() : m_impl(std::make_unique<Impl>()) {}
-H264Encoder::~H264Encoder() = default;
+// Encode every whole frame the framer holds (and the remainder, when
+// flushing), numbering them by sample count from pts
+int encode_audio_frames(AVCodecContext* context, AudioFramer& framer, AVFrame* frame, int64_t& pts,
+                        bool flush, EncodedPacket& packet, const PacketCallback& callback) {
+    while (framer.pop(frame, flush)) {
+        frame->pts = pts;
+        pts += frame->nb_samples;
+
+        int ret = avcodec_send_frame(context, frame);
+        if (ret < 0) {
+            return ret;
+        }
+        ret = drain_packets(context, StreamType::AUDIO, packet, callback);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+// Base Encoder implementation
+Encoder::Encoder() = default;
+Encoder::~Encoder() = default;
+
+void Encoder::set_packet_callback(PacketCallback callback) {
+    m_packet_callback = std::move(callback);
+}
+
+void Encoder::set_time_origin(TimeStamp origin) {
+    m_time_origin = origin;
+}
 
-bool H264Encoder::initialize(const CaptureSettings& settings,
-                            int video_width, int video_height,
-                            AudioFormat audio_format, int sample_rate, int channels) {
+int64_t Encoder::clock_ticks(TimeStamp t, int64_t rate) {
+    if (m_time_origin == TimeStamp{}) {
+        m_time_origin = t;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(t - m_time_origin).count();
+    if (elapsed <= 0) {
+        return 0;
+    }
+    return av_rescale(elapsed, rate, 1000000000);
+}
+
+// AAC encoder implementation
+struct AudioEncoder::Impl {
+    AVCodecContext* codec_context = nullptr;
+    AVFrame* frame = nullptr;
+    EncodedPacket packet;  // Reused for every receive unless a consumer keeps it
+    AudioFramer framer;
     
-    m_impl->settings = settings;
-    m_impl->video_width = video_width;
-    m_impl->video_height = video_height;
-    m_impl->audio_format = audio_format;
-    m_impl->sample_rate = sample_rate;
-    m_impl->channels = channels;
+    bool initialized = false;
+    int sample_rate = 44100;
+    int channels = 2;
+    int64_t pts = 0;        // Of the oldest sample waiting in the framer
+    bool anchored = false;  // pts has been placed on the capture clock
     
-    // Initialize video encoder (H.264)
-    const AVCodec* video_codec = avcodec_find_encoder(AV_CODEC_ID_H264);
-    if (!video_codec) {
-        std::cerr << "H.264 encoder not found" << std::endl;
-        return false;
+    ~Impl() {
+        cleanup();
     }
     
-    m_impl->video_codec_context = avcodec_alloc_context3(video_codec);
-    if (!m_impl->video_codec_context) {
-        std::cerr << "Could not allocate video codec context" << std::endl;
-        return false;
+    void cleanup() {
+        framer.cleanup();
+        packet = EncodedPacket{};
+        if (frame) {
+            av_frame_free(&frame);
+        }
+        if (codec_context) {
+            avcodec_free_context(&codec_context);
+        }
     }
-    
-    // Set video codec parameters using settings
-    m_impl->video_codec_context->bit_rate = settings.videoBitrate;
-    m_impl->video_codec_context->width = video_width;
-    m_impl->video_codec_context->height = video_height;
-    m_impl->video_codec_context->time_base = {1, settings.frameRate};
-    m_impl->video_codec_context->framerate = {settings.frameRate, 1};
-    m_impl->video_codec_context->gop_size = 10;
-    m_impl->video_codec_context->max_b_frames = 1;
-    m_impl->video_codec_context->pix_fmt = AV_PIX_FMT_YUV420P;
-    
-    // Set H.264 specific options for better compression
-    av_opt_set(m_impl->video_codec_context->priv_data, "preset", "fast", 0);
-    av_opt_set(m_impl->video_codec_context->priv_data, "crf", "28", 0);  // Higher CRF = lower bitrate
-    
-    // Add bitrate control for consistent file sizes
-    m_impl->video_codec_context->bit_rate = 8000000;  // 8 Mbps max
-    m_impl->video_codec_context->rc_max_rate = 10000000;  // 10 Mbps peak
-    m_impl->video_codec_context->rc_buffer_size = 16000000;  // 16 Mbps buffer
-    
-    // Open video codec
-    if (avcodec_open2(m_impl->video_codec_context, video_codec, nullptr) < 0) {
-        std::cerr << "Could not open video codec" << std::endl;
+};
+
+AudioEncoder::AudioEncoder() : m_impl(std::make_unique<Impl>()) {}
+AudioEncoder::~AudioEncoder() = default;
+
+bool AudioEncoder::initialize(const CaptureSettings& settings, AudioFormat audio_format, int sample_rate, int channels) {
+    if (audio_format != AudioFormat::PCM_S16LE) {
+        std::cerr << "Audio encoder expects 16-bit PCM input" << std::endl;
         return false;
     }
+    m_impl->sample_rate = sample_rate;
+    m_impl->channels = channels;
     
-    // Initialize audio encoder (AAC)
-    const AVCodec* audio_codec = avcodec_find_encoder(AV_CODEC_ID_AAC);
-    if (!audio_codec) {
+    const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_AAC);
+    if (!codec) {
         std::cerr << "AAC encoder not found" << std::endl;
         return false;
     }
     
-    m_impl->audio_codec_context = avcodec_alloc_context3(audio_codec);
-    if (!m_impl->audio_codec_context) {
+    m_impl->codec_context = avcodec_alloc_context3(codec);
+    if (!m_impl->codec_context) {
         std::cerr << "Could not allocate audio codec context" << std::endl;
         return false;
     }
     
-    // Set audio codec parameters
-    m_impl->audio_codec_context->bit_rate = 128000; // 128 kbps
-    m_impl->audio_codec_context->sample_rate = sample_rate;
-    av_channel_layout_default(&m_impl->audio_codec_context->ch_layout, channels);
-    m_impl->audio_codec_context->sample_fmt = AV_SAMPLE_FMT_FLTP;
-    m_impl->audio_codec_context->time_base = {1, sample_rate};
+    m_impl->codec_context->bit_rate = settings.audioBitrate > 0 ? settings.audioBitrate : 128000;
+    m_impl->codec_context->sample_rate = sample_rate;
+    av_channel_layout_default(&m_impl->codec_context->ch_layout, channels);
+    m_impl->codec_context->sample_fmt = AV_SAMPLE_FMT_FLTP;
+    m_impl->codec_context->time_base = {1, sample_rate};
     
-    // Open audio codec
-    if (avcodec_open2(m_impl->audio_codec_context, audio_codec, nullptr) < 0) {
+    if (avcodec_open2(m_impl->codec_context, codec, nullptr) < 0) {
         std::cerr << "Could not open audio codec" << std::endl;
         return false;
     }
     
-    // Allocate frames and packet
-    m_impl->video_frame = av_frame_alloc();
-    m_impl->audio_frame = av_frame_alloc();
-    m_impl->packet = av_packet_alloc();
-    
-    if (!m_impl->video_frame || !m_impl->audio_frame || !m_impl->packet) {
-        std::cerr << "Could not allocate frames or packet" << std::endl;
+    m_impl->frame = av_frame_alloc();
+    m_impl->packet = EncodedPacket::allocate();
+    if (!m_impl->frame || !m_impl->packet) {
+        std::cerr << "Could not allocate audio frame or packet" << std::endl;
         return false;
     }
     
-    // Setup video frame
-    m_impl->video_frame->format = m_impl->video_codec_context->pix_fmt;
-    m_impl->video_frame->width = m_impl->video_codec_context->width;
-    m_impl->video_frame->height = m_impl->video_codec_context->height;
-    
-    if (av_frame_get_buffer(m_impl->video_frame, 0) < 0) {
-        std::cerr << "Could not allocate video frame buffer" << std::endl;
+    m_impl->frame->format = m_impl->codec_context->sample_fmt;
+    m_impl->frame->nb_samples = m_impl->codec_context->frame_size;
+    av_channel_layout_copy(&m_impl->frame->ch_layout, &m_impl->codec_context->ch_layout);
+    if (av_frame_get_buffer(m_impl->frame, 0) < 0) {
+        std::cerr << "Could not allocate audio frame buffer" << std::endl;
         return false;
     }
     
-    // Setup audio frame
-    m_impl->audio_frame->format = m_impl->audio_codec_context->sample_fmt;
-    m_impl->audio_frame->nb_samples = m_impl->audio_codec_context->frame_size;
-    av_channel_layout_copy(&m_impl->audio_frame->ch_layout, &m_impl->audio_codec_context->ch_layout);
-    
-    if (av_frame_get_buffer(m_impl->audio_frame, 0) < 0) {
-        std::cerr << "Could not allocate audio frame buffer" << std::endl;
+    // Capture chunks are converted and regrouped into whole codec frames
+    if (!m_impl->framer.initialize(m_impl->codec_context, sample_rate, channels)) {
         return false;
     }
     
-    // Initialize scaling context for video format conversion
-    m_impl->sws_context = sws_getContext(
-        video_width, video_height, AV_PIX_FMT_RGB24,
-        video_width, video_height, AV_PIX_FMT_YUV420P,
-        SWS_BILINEAR, nullptr, nullptr, nullptr);
+    m_impl->initialized = true;
     
-    if (!m_impl->sws_context) {
-        std::cerr << "Could not initialize video scaling context" << std::endl;
+    std::cout << "AAC encoder initialized: " << sample_rate << "Hz, " << channels << " channels, "
+              << m_impl->codec_context->bit_rate / 1000 << " kbps\n";
+    
+    return true;
+}
+
+bool AudioEncoder::encode_audio_sample(const AudioSample& sample) {
+    if (!m_impl->initialized) {
         return false;
     }
     
-    // Initialize resampling context for audio format conversion
-    m_impl->swr_context = swr_alloc();
-    if (!m_impl->swr_context) {
-        std::cerr << "Could not allocate audio resampling context" << std::endl;
+    int src_samples = sample.data.size() / (m_impl->channels * 2); // 16-bit samples
+    if (sample.data.empty() || src_samples <= 0) {
+        std::cerr << "Invalid audio sample data" << std::endl;
         return false;
     }
     
-    AVChannelLayout in_ch_layout;
-    av_channel_layout_default(&in_ch_layout, channels);
-    
-    av_opt_set_chlayout(m_impl->swr_context, "in_chlayout", &in_ch_layout, 0);
-    av_opt_set_chlayout(m_impl->swr_context, "out_chlayout", &m_impl->audio_codec_context->ch_layout, 0);
-    av_opt_set_int(m_impl->swr_context, "in_sample_rate", sample_rate, 0);
-    av_opt_set_int(m_impl->swr_context, "out_sample_rate", sample_rate, 0);
-    av_opt_set_sample_fmt(m_impl->swr_context, "in_sample_fmt", AV_SAMPLE_FMT_S16, 0);
-    av_opt_set_sample_fmt(m_impl->swr_context, "out_sample_fmt", AV_SAMPLE_FMT_FLTP, 0);
-    
-    if (swr_init(m_impl->swr_context) < 0) {
-        std::cerr << "Could not initialize audio resampling context" << std::endl;
+    // Place the first chunk on the capture clock, then count samples so the
+    // audio stays gapless. A chunk is stamped on arrival, after its samples.
+    int64_t start = std::max<int64_t>(0, clock_ticks(sample.timestamp, m_impl->sample_rate) - src_samples);
+    if (!m_impl->anchored) {
+        m_impl->pts = start;
+        m_impl->anchored = true;
+    } else if (!fill_gap(start - (m_impl->pts + m_impl->framer.buffered()), src_samples)) {
         return false;
     }
     
-    m_impl->initialized = true;
+    if (!m_impl->framer.push(sample.data.data(), src_samples)) {
+        std::cerr << "Error converting audio samples" << std::endl;
+        return false;
+    }
     
-    std::cout << "H.264 encoder initialized:\n";
-    std::cout << "  Video: " << video_width << "x" << video_height << " @ 30fps\n";
-    std::cout << "  Audio: " << sample_rate << "Hz, " << channels << " channels\n";
+    // Encode only whole frames; the rest waits for the next chunk
+    int ret = encode_audio_frames(m_impl->codec_context, m_impl->framer, m_impl->frame,
+                                  m_impl->pts, false, m_impl->packet, m_packet_callback);
+    if (ret < 0) {
+        std::cerr << "Error encoding audio frame" << std::endl;
+        return false;
+    }
     
     return true;
 }
 
-std::vector<uint8_t> H264Encoder::encode_video_frame(const Frame& frame) {
+bool AudioEncoder::fill_gap(int64_t gap, int chunk_samples) {
+    // Counting alone would slide everything after an xrun or a dropped
+    // chunk earlier against video for good. Arrival jitter stays within
+    // about a chunk, so only a longer hole is taken for lost audio.
+    int frame_size = m_impl->framer.frame_size;
+    if (gap <= std::max(chunk_samples, frame_size)) {
+        return true;
+    }
+    std::cerr << "Audio gap of " << gap * 1000 / m_impl->sample_rate << " ms filled with silence" << std::endl;
+
+    // A frame at a time, so a long gap is never held in the FIFO at once
+    while (gap > 0) {
+        int samples = static_cast<int>(std::min<int64_t>(gap, frame_size));
+        if (!m_impl->framer.push_silence(samples)) {
+            std::cerr << "Error queueing audio silence" << std::endl;
+            return false;
+        }
+        int ret = encode_audio_frames(m_impl->codec_context, m_impl->framer, m_impl->frame,
+                                      m_impl->pts, false, m_impl->packet, m_packet_callback);
+        if (ret < 0) {
+            std::cerr << "Error encoding audio frame" << std::endl;
+            return false;
+        }
+        gap -= samples;
+    }
+    return true;
+}
+
+bool AudioEncoder::finalize() {
     if (!m_impl->initialized) {
-        return {};
+        return false;
     }
     
-    std::vector<uint8_t> result;
+    // Flush the partial last frame, then the encoder
+    int ret = encode_audio_frames(m_impl->codec_context, m_impl->framer, m_impl->frame,
+                                  m_impl->pts, true, m_impl->packet, m_packet_callback);
+    avcodec_send_frame(m_impl->codec_context, nullptr);
+    ret = std::min(ret, drain_packets(m_impl->codec_context, StreamType::AUDIO, m_impl->packet, m_packet_callback));
     
-    // Make frame writable
-    if (av_frame_make_writable(m_impl->video_frame) < 0) {
-        std::cerr << "Could not make video frame writable" << std::endl;
-        return result;
+    std::cout << "AAC encoder finalized\n";
+    return ret >= 0;
+}
+
+// Encoder backend registry
+namespace {
+
+// Names accepted by --codec besides the backends' own
+struct BackendAlias {
+    const char* alias;
+    const char* name;
+};
+
+const BackendAlias kBackendAliases[] = {
+    {"H.264", "h264"},
+    {"x264", "h264"},
+    {"H.265", "h265"},
+    {"hevc", "h265"},
+    {"x265", "h265"},
+    {"svt-av1", "av1"},
+    {"libvpx", "vp9"},
+};
+
+AVCodecID codec_id(VideoCodec codec) {
+    switch (codec) {
+        case VideoCodec::H264: return AV_CODEC_ID_H264;
+        case VideoCodec::HEVC: return AV_CODEC_ID_HEVC;
+        case VideoCodec::AV1: return AV_CODEC_ID_AV1;
+        case VideoCodec::VP9: return AV_CODEC_ID_VP9;
     }
-    
-    // Convert RGB to YUV420P
-    const uint8_t* src_data[4] = {frame.data.data(), nullptr, nullptr, nullptr};
-    int src_linesize[4] = {m_impl->video_width * 3, 0, 0, 0};
-    
-    sws_scale(m_impl->sws_context, src_data, src_linesize, 0, m_impl->video_height,
-              m_impl->video_frame->data, m_impl->video_frame->linesize);
-    
-    m_impl->video_frame->pts = m_impl->video_pts++;
-    
-    // Send frame to encoder
-    int ret = avcodec_send_frame(m_impl->video_codec_context, m_impl->video_frame);
-    if (ret < 0) {
-        std::cerr << "Error sending video frame to encoder" << std::endl;
-        return result;
+    return AV_CODEC_ID_NONE;
+}
+
+// FFmpeg names GPU encoders <codec><suffix>, e.g. hevc_nvenc
+bool hardware_encoder_available(VideoCodec codec) {
+    const char* prefix = "h264";
+    switch (codec) {
+        case VideoCodec::H264: prefix = "h264"; break;
+        case VideoCodec::HEVC: prefix = "hevc"; break;
+        case VideoCodec::AV1: prefix = "av1"; break;
+        case VideoCodec::VP9: prefix = "vp9"; break;
     }
-    
-    // Receive encoded packet
-    while (ret >= 0) {
-        ret = avcodec_receive_packet(m_impl->video_codec_context, m_impl->packet);
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            break;
-        } else if (ret < 0) {
-            std::cerr << "Error encoding video frame" << std::endl;
-            break;
+#if defined(__APPLE__)
+    const char* suffixes[] = {"_videotoolbox"};
+#elif defined(_WIN32)
+    const char* suffixes[] = {"_nvenc", "_qsv"};
+#else
+    const char* suffixes[] = {"_vaapi", "_nvenc"};
+#endif
+    for (const char* suffix : suffixes) {
+        if (avcodec_find_encoder_by_name((std::string(prefix) + suffix).c_str())) {
+            return true;
         }
-        
-        // Copy packet data
-        result.insert(result.end(), m_impl->packet->data, m_impl->packet->data + m_impl->packet->size);
-        
-        av_packet_unref(m_impl->packet);
     }
-    
-    return result;
+    return false;
 }
 
-std::vector<uint8_t> H264Encoder::encode_audio_sample(const AudioSample& sample) {
-    if (!m_impl->initialized) {
-        return {};
+// Rate control for each library. x264 and x265 keep the tuning the
+// encoder has always used; the others aim at live capture. Preset and CRF
+// come from the speed ladder.
+void apply_backend_options(AVCodecContext* context, const CaptureSettings& settings) {
+    std::string library = context->codec->name;
+    void* options = context->priv_data;
+
+    if (library == "libx264") {
+        // Add bitrate control for consistent file sizes
+        context->bit_rate = 8000000;  // 8 Mbps max
+        context->rc_max_rate = 10000000;  // 10 Mbps peak
+        context->rc_buffer_size = 16000000;  // 16 Mbps buffer
+        av_opt_set_int(options, "forced-idr", 1, 0);  // Requested keyframes start a closed GOP
+    } else if (library == "libx265") {
+        context->bit_rate = settings.videoBitrate * 0.7;  // 30% less for H.265 efficiency
+        av_opt_set_int(options, "forced-idr", 1, 0);
+    } else if (library == "libsvtav1") {
+        context->bit_rate = 0;
+        context->gop_size = settings.frameRate * 2;
+        context->max_b_frames = 0;
+    } else if (library == "libvpx-vp9") {
+        // Constrained quality: CRF capped at the configured bitrate
+        context->gop_size = settings.frameRate * 2;
+        context->max_b_frames = 0;
+        av_opt_set(options, "deadline", "realtime", 0);
+        av_opt_set_int(options, "row-mt", 1, 0);
+        av_opt_set_int(options, "lag-in-frames", 0, 0);
+    } else if (library == "libopenh264") {
+        // Baseline-style encoder: no B-frames, bitrate driven, never skip
+        context->max_b_frames = 0;
+        av_opt_set(options, "rc_mode", "bitrate", 0);
+        av_opt_set_int(options, "allow_skip_frames", 0, 0);
     }
-    
-    std::vector<uint8_t> result;
-    
-    // Make frame writable
-    if (av_frame_make_writable(m_impl->audio_frame) < 0) {
-        std::cerr << "Could not make audio frame writable" << std::endl;
-        return result;
+}
+
+// Preset and CRF pairs a library steps through when it cannot keep up.
+// The first rung is the configured setting; each later one is cheaper.
+struct SpeedRung {
+    const char* speed;  // Value of the ladder's speed option
+    const char* crf;
+};
+
+struct SpeedLadder {
+    const char* library;
+    const char* option;
+    std::vector<SpeedRung> rungs;
+};
+
+const SpeedLadder kSpeedLadders[] = {
+    // CRF-only steps change in place; preset steps need a new encoder
+    {"libx264", "preset", {{"fast", "28"}, {"fast", "31"}, {"veryfast", "28"}, {"veryfast", "31"},
+                           {"superfast", "30"}, {"ultrafast", "32"}}},
+    {"libx265", "preset", {{"medium", "25"}, {"fast", "25"}, {"faster", "26"}, {"veryfast", "27"},
+                           {"superfast", "28"}, {"ultrafast", "30"}}},
+    // VP9 frames carry everything vpcC does not. SVT-AV1 has no ladder: a
+    // new preset can change the sequence header, which av1C must match.
+    {"libvpx-vp9", "cpu-used", {{"8", "32"}, {"9", "34"}}},
+};
+
+const SpeedLadder* find_speed_ladder(const std::string& library) {
+    for (const auto& ladder : kSpeedLadders) {
+        if (library == ladder.library) {
+            return &ladder;
+        }
     }
-    
-    // Convert audio format with validation
-    const uint8_t* src_data[1] = {sample.data.data()};
-    int src_samples = sample.data.size() / (m_impl->channels * 2); // 16-bit samples
-    
-    // Validate input audio data to prevent NaN values
-    if (sample.data.empty() || src_samples <= 0) {
-        std::cerr << "Invalid audio sample data" << std::endl;
-        return result;
+    return nullptr;
+}
+
+void apply_speed_rung(AVCodecContext* context, const SpeedLadder* ladder, int level) {
+    if (ladder) {
+        const SpeedRung& rung = ladder->rungs[level];
+        av_opt_set(context->priv_data, ladder->option, rung.speed, 0);
+        av_opt_set(context->priv_data, "crf", rung.crf, 0);  // Higher CRF = lower bitrate
     }
-    
-    // Clear the audio frame buffer to prevent leftover data
-    if (av_frame_make_writable(m_impl->audio_frame) < 0) {
-        std::cerr << "Could not make audio frame writable" << std::endl;
-        return result;
+}
+
+std::string speed_rung_name(const SpeedLadder* ladder, int level) {
+    if (!ladder) {
+        return "default";
     }
-    
-    // Zero out the audio frame data
-    memset(m_impl->audio_frame->data[0], 0, 
-           m_impl->audio_frame->nb_samples * av_get_bytes_per_sample(AV_SAMPLE_FMT_FLTP) * m_impl->channels);
-    
-    int converted_samples = swr_convert(m_impl->swr_context,
-                                       m_impl->audio_frame->data, m_impl->audio_frame->nb_samples,
-                                       src_data, src_samples);
-    
-    if (converted_samples < 0) {
-        std::cerr << "Error converting audio samples" << std::endl;
-        return result;
+    const SpeedRung& rung = ladder->rungs[level];
+    return std::string(rung.speed) + " crf " + rung.crf;
+}
+
+// Map a threading plan onto the library's own knobs
+void apply_threading(AVCodecContext* context, const EncoderThreadingPlan& plan) {
+    std::string library = context->codec->name;
+    void* options = context->priv_data;
+    context->thread_count = plan.threads;
+
+    if (library == "libx264") {
+        // x264 switches to sliced threads when asked for slice threading
+        context->thread_type = plan.mode == EncoderThreading::SLICE ? FF_THREAD_SLICE : FF_THREAD_FRAME;
+        if (plan.mode == EncoderThreading::SLICE) {
+            context->slices = plan.slices;
+        }
+    } else if (library == "libx265") {
+        // Worker pool for WPP rows and lookahead, plus frames in parallel
+        std::string params = "pools=" + std::to_string(plan.threads) +
+                             ":frame-threads=" + std::to_string(plan.frames_in_flight);
+        av_opt_set(options, "x265-params", params.c_str(), 0);
+    } else if (library == "libvpx-vp9") {
+        // One tile column per thread, each at least 256 pixels wide; the
+        // option takes log2 of the count
+        int tiles = std::min(plan.threads, std::max(1, context->width / 256));
+        int log2_tiles = 0;
+        while ((2 << log2_tiles) <= tiles) {
+            ++log2_tiles;
+        }
+        av_opt_set_int(options, "tile-columns", log2_tiles, 0);
+    } else if (library == "libopenh264") {
+        context->slices = plan.slices;
+    } else if (plan.mode == EncoderThreading::FRAME) {
+        context->thread_type = FF_THREAD_FRAME;
+    } else if (plan.mode == EncoderThreading::SLICE) {
+        context->thread_type = FF_THREAD_SLICE;
     }
-    
-    m_impl->audio_frame->pts = m_impl->audio_pts;
-    m_impl->audio_pts += m_impl->audio_frame->nb_samples;
-    
-    // Send frame to encoder
-    int ret = avcodec_send_frame(m_impl->audio_codec_context, m_impl->audio_frame);
-    if (ret < 0) {
-        std::cerr << "Error sending audio frame to encoder" << std::endl;
-        return result;
+}
+
+bool accepts_pixel_format(const AVCodec* codec, AVPixelFormat format) {
+    if (!codec->pix_fmts) {
+        return true;  // Not declared; avcodec_open2 will tell
     }
-    
-    // Receive encoded packet
-    while (ret >= 0) {
-        ret = avcodec_receive_packet(m_impl->audio_codec_context, m_impl->packet);
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            break;
-        } else if (ret < 0) {
-            std::cerr << "Error encoding audio frame" << std::endl;
-            break;
+    for (const AVPixelFormat* f = codec->pix_fmts; *f != AV_PIX_FMT_NONE; ++f) {
+        if (*f == format) {
+            return true;
         }
-        
-        // Copy packet data
-        result.insert(result.end(), m_impl->packet->data, m_impl->packet->data + m_impl->packet->size);
-        
-        av_packet_unref(m_impl->packet);
     }
-    
-    return result;
+    return false;
 }
 
-std::vector<uint8_t> H264Encoder::finalize() {
-    if (!m_impl->initialized) {
-        return {};
+} // namespace
+
+const std::vector<EncoderBackend>& encoder_backends() {
+    static const std::vector<EncoderBackend> backends = {
+        {"h264", "H.264 (x264)", VideoCodec::H264, "libx264", "fast"},
+        {"h265", "H.265 (x265)", VideoCodec::HEVC, "libx265", "medium"},
+        {"av1", "AV1 (SVT-AV1)", VideoCodec::AV1, "libsvtav1", "10"},
+        {"vp9", "VP9 (libvpx)", VideoCodec::VP9, "libvpx-vp9", "realtime"},
+        {"openh264", "H.264 (OpenH264)", VideoCodec::H264, "libopenh264", ""},
+    };
+    return backends;
+}
+
+const EncoderBackend* find_encoder_backend(const std::string& name) {
+    std::string wanted = name;
+    for (const auto& alias : kBackendAliases) {
+        if (name == alias.alias) {
+            wanted = alias.name;
+        }
     }
-    
-    std::vector<uint8_t> result;
-    
-    // Flush video encoder
-    avcodec_send_frame(m_impl->video_codec_context, nullptr);
-    int ret = 0;
-    while (ret >= 0) {
-        ret = avcodec_receive_packet(m_impl->video_codec_context, m_impl->packet);
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            break;
+    for (const auto& backend : encoder_backends()) {
+        if (backend.name == wanted) {
+            return &backend;
         }
-        result.insert(result.end(), m_impl->packet->data, m_impl->packet->data + m_impl->packet->size);
-        av_packet_unref(m_impl->packet);
     }
-    
-    // Flush audio encoder
-    avcodec_send_frame(m_impl->audio_codec_context, nullptr);
-    ret = 0;
-    while (ret >= 0) {
-        ret = avcodec_receive_packet(m_impl->audio_codec_context, m_impl->packet);
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            break;
+    return nullptr;
+}
+
+EncoderCapabilities probe_encoder_backend(const EncoderBackend& backend) {
+    EncoderCapabilities capabilities;
+    const AVCodec* codec = avcodec_find_encoder_by_name(backend.library.c_str());
+    capabilities.hardware_variant = hardware_encoder_available(backend.codec);
+    if (!codec) {
+        return capabilities;
+    }
+
+    capabilities.available = true;
+    if (codec->pix_fmts) {
+        for (const AVPixelFormat* f = codec->pix_fmts; *f != AV_PIX_FMT_NONE; ++f) {
+            capabilities.pixel_formats.push_back(av_get_pix_fmt_name(*f));
         }
-        result.insert(result.end(), m_impl->packet->data, m_impl->packet->data + m_impl->packet->size);
-        av_packet_unref(m_impl->packet);
     }
-    
-    std::cout << "H.264 encoder finalized\n";
-    return result;
+
+    if (codec->capabilities & AV_CODEC_CAP_OTHER_THREADS) {
+        capabilities.threading = EncoderThreading::INTERNAL;
+    } else if (codec->capabilities & AV_CODEC_CAP_FRAME_THREADS) {
+        capabilities.threading = EncoderThreading::FRAME;
+    } else if (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS) {
+        capabilities.threading = EncoderThreading::SLICE;
+    }
+    return capabilities;
+}
+
+const char* encoder_threading_name(EncoderThreading threading) {
+    switch (threading) {
+        case EncoderThreading::FRAME: return "frame";
+        case EncoderThreading::SLICE: return "slice";
+        case EncoderThreading::INTERNAL: return "internal";
+        case EncoderThreading::NONE: break;
+    }
+    return "none";
+}
+
+EncoderThreadingPlan plan_encoder_threading(const EncoderBackend& backend, const CaptureSettings& settings,
+                                            int height, unsigned cores) {
+    EncoderThreadingPlan plan;
+    plan.latency_target_ms = settings.encode_latency_target_ms;
+    if (cores == 0) {
+        cores = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Leave a core each to capture and conversion. Past one thread per 64
+    // rows the threads mostly wait on each other.
+    if (settings.encoder_threads > 0) {
+        plan.threads = settings.encoder_threads;
+        plan.automatic = false;
+    } else {
+        plan.threads = std::clamp(static_cast<int>(cores) - 2, 1, std::max(1, height / 64));
+    }
+    if (plan.threads <= 1) {
+        plan.threads = 1;
+        return plan;
+    }
+
+    // Frames that can be in flight without exceeding the latency target, at
+    // the rate frames actually arrive (frameRate is only the nominal one)
+    double frame_ms = 1000.0 / std::max(1, settings.target_fps);
+    int frames_allowed = 1 + static_cast<int>(std::max(0.0, settings.encode_latency_target_ms) / frame_ms);
+
+    const std::string& library = backend.library;
+    bool frame_threads = false;
+    bool slice_threads = false;
+    int frames_wanted = plan.threads;
+    if (library == "libsvtav1" || library == "libvpx-vp9") {
+        plan.mode = EncoderThreading::INTERNAL;
+        return plan;
+    } else if (library == "libopenh264") {
+        slice_threads = true;
+    } else if (library == "libx264") {
+        frame_threads = slice_threads = true;
+    } else if (library == "libx265") {
+        // x265 parallelises rows within a frame too; a few frame threads
+        // are enough to fill the pool
+        frame_threads = true;
+        frames_wanted = std::min(plan.threads, 4);
+    } else {
+        EncoderThreading threading = probe_encoder_backend(backend).threading;
+        frame_threads = threading == EncoderThreading::FRAME;
+        slice_threads = threading == EncoderThreading::SLICE;
+        if (threading == EncoderThreading::INTERNAL) {
+            plan.mode = EncoderThreading::INTERNAL;
+            return plan;
+        }
+    }
+
+    if (frame_threads && frames_allowed >= frames_wanted) {
+        plan.mode = EncoderThreading::FRAME;
+        plan.frames_in_flight = frames_wanted;
+    } else if (slice_threads) {
+        plan.mode = EncoderThreading::SLICE;
+        plan.slices = plan.threads;
+    } else if (library == "libx265") {
+        plan.mode = EncoderThreading::INTERNAL;  // Row threads on one frame at a time
+    } else if (frame_threads && frames_allowed > 1) {
+        plan.mode = EncoderThreading::FRAME;
+        plan.threads = plan.frames_in_flight = std::min(plan.threads, frames_allowed);
+    } else {
+        plan.threads = 1;
+    }
+    return plan;
 }
 
-bool H264Encoder::supports_hardware_acceleration() const {
-    // Check for hardware acceleration support
-    #if defined(__APPLE__)
-        return avcodec_find_encoder_by_name("h264_videotoolbox") != nullptr;
-    #elif defined(_WIN32)
-        return avcodec_find_encoder_by_name("h264_nvenc") != nullptr ||
-               avcodec_find_encoder_by_name("h264_qsv") != nullptr;
-    #else
-        return avcodec_find_encoder_by_name("h264_vaapi") != nullptr ||
-               avcodec_find_encoder_by_name("h264_nvenc") != nullptr;
-    #endif
+std::string describe_threading(const EncoderThreadingPlan& plan) {
+    std::string text = encoder_threading_name(plan.mode);
+    text += ", " + std::to_string(plan.threads) + (plan.threads == 1 ? " thread" : " threads");
+    if (plan.mode == EncoderThreading::FRAME) {
+        text += ", " + std::to_string(plan.frames_in_flight) + " frames in flight";
+    } else if (plan.mode == EncoderThreading::SLICE) {
+        text += ", " + std::to_string(plan.slices) + " slices";
+    }
+    text += plan.automatic ? " (auto)" : " (manual)";
+    return text;
 }
 
-// H.265 Encoder implementation
-struct H265Encoder::Impl {
+// Video encoder implementation
+struct FFmpegVideoEncoder::Impl {
+    EncoderBackend backend;
     AVCodecContext* video_codec_context = nullptr;
-    AVCodecContext* audio_codec_context = nullptr;
-    AVFrame* video_frame = nullptr;
-    AVFrame* audio_frame = nullptr;
-    AVPacket* packet = nullptr;
-    SwsContext* sws_context = nullptr;
-    SwrContext* swr_context = nullptr;
+    ConvertedFrame picture;  // Input frame for the single-threaded encode_video_frame
+    EncodedPacket video_packet;  // Reused for every receive unless a consumer keeps it
+    VideoConverter converter;
+    EncoderThreadingPlan threading;
+    const AVCodec* codec = nullptr;
+    
+    // Speed ladder position; a requested level waits for a GOP boundary
+    const SpeedLadder* ladder = nullptr;
+    int level = 0;
+    int pending_level = 0;
+    std::string pending_reason;
+    uint64_t frames_sent = 0;
+    uint64_t gop_start = 0;  // frames_sent at the last forced keyframe
+    std::atomic<bool> keyframe_requested{false};
+    int64_t last_dts = INT64_MIN;
+    mutable std::mutex adjustments_mutex;  // Guards level and adjustments for readers
+    std::vector<SpeedAdjustment> adjustments;
+    
+    // Submit time of each frame still inside the encoder, by PTS
+    std::deque<std::pair<int64_t, std::chrono::steady_clock::time_point>> in_flight;
+    LatencyHistogram encode_latency;
     
     bool initialized = false;
     CaptureSettings settings;
     int video_width = 0;
     int video_height = 0;
-    AudioFormat audio_format = AudioFormat::PCM_S16LE;
-    int sample_rate = 44100;
-    int channels = 2;
-    int64_t video_pts = 0;
-    int64_t audio_pts = 0;
+    // Encoder input format; the same on every rung, and read by the convert
+    // thread, which must not touch a codec context a speed change may free
+    AVPixelFormat picture_format = AV_PIX_FMT_NONE;
+    int64_t last_video_pts = -1;
     
     ~Impl() {
         cleanup();
     }
     
     void cleanup() {
-        if (sws_context) {
-            sws_freeContext(sws_context);
-            sws_context = nullptr;
-        }
-        if (swr_context) {
-            swr_free(&swr_context);
-        }
-        if (packet) {
-            av_packet_free(&packet);
-        }
-        if (video_frame) {
-            av_frame_free(&video_frame);
-        }
-        if (audio_frame) {
-            av_frame_free(&audio_frame);
-        }
+        video_packet = EncodedPacket{};
+        picture = ConvertedFrame{};
         if (video_codec_context) {
             avcodec_free_context(&video_codec_context);
         }
-        if (audio_codec_context) {
-            avcodec_free_context(&audio_codec_context);
-        }
     }
+    
+    // A codec context at a ladder level, opened; null on failure
+    AVCodecContext* open_context(int speed_level, bool global_header);
 };
 
-H265Encoder::H265Encoder() : m_impl(std::make_unique<Impl>()) {}
-H265Encoder::~H265Encoder() = default;
-
-bool H265Encoder::initialize(const CaptureSettings& settings,
-                            int video_width, int video_height,
-                            AudioFormat audio_format, int sample_rate, int channels) {
-    
-    m_impl->settings = settings;
-    m_impl->video_width = video_width;
-    m_impl->video_height = video_height;
-    m_impl->audio_format = audio_format;
-    m_impl->sample_rate = sample_rate;
-    m_impl->channels = channels;
-    
-    // Initialize video encoder (H.265)
-    const AVCodec* video_codec = avcodec_find_encoder(AV_CODEC_ID_HEVC);
-    if (!video_codec) {
-        std::cerr << "H.265 encoder not found" << std::endl;
-        return false;
-    }
-    
-    m_impl->video_codec_context = avcodec_alloc_context3(video_codec);
-    if (!m_impl->video_codec_context) {
+AVCodecContext* FFmpegVideoEncoder::Impl::open_context(int speed_level, bool global_header) {
+    AVCodecContext* context = avcodec_alloc_context3(codec);
+    if (!context) {
         std::cerr << "Could not allocate video codec context" << std::endl;
-        return false;
-    }
-    
-    // Set video codec parameters using settings (H.265 is more efficient)
-    m_impl->video_codec_context->bit_rate = settings.videoBitrate * 0.7; // 30% less for H.265 efficiency
-    m_impl->video_codec_context->width = video_width;
-    m_impl->video_codec_context->height = video_height;
-    m_impl->video_codec_context->time_base = {1, settings.frameRate};
-    m_impl->video_codec_context->framerate = {settings.frameRate, 1};
-    m_impl->video_codec_context->gop_size = 10;
-    m_impl->video_codec_context->max_b_frames = 1;
-    m_impl->video_codec_context->pix_fmt = AV_PIX_FMT_YUV420P;
-    
-    // Set H.265 specific options
-    av_opt_set(m_impl->video_codec_context->priv_data, "preset", "medium", 0);
-    av_opt_set(m_impl->video_codec_context->priv_data, "crf", "25", 0);
-    
-    // Open video codec
-    if (avcodec_open2(m_impl->video_codec_context, video_codec, nullptr) < 0) {
-        std::cerr << "Could not open video codec" << std::endl;
-        return false;
-    }
-    
-    // Audio encoding is same as H.264 (AAC)
-    const AVCodec* audio_codec = avcodec_find_encoder(AV_CODEC_ID_AAC);
-    if (!audio_codec) {
-        std::cerr << "AAC encoder not found" << std::endl;
-        return false;
+        return nullptr;
     }
     
-    m_impl->audio_codec_context = avcodec_alloc_context3(audio_codec);
-    if (!m_impl->audio_codec_context) {
-        std::cerr << "Could not allocate audio codec context" << std::endl;
-        return false;
+    // Set video codec parameters using settings
+    context->bit_rate = settings.videoBitrate;
+    context->width = video_width;
+    context->height = video_height;
+    context->time_base = {1, kVideoClockRate};
+    context->framerate = {settings.frameRate, 1};  // Nominal rate; PTS decide
+    context->gop_size = 10;
+    context->max_b_frames = 1;
+    context->pix_fmt = AV_PIX_FMT_YUV420P;
+    context->colorspace = AVCOL_SPC_BT709;
+    context->color_primaries = AVCOL_PRI_BT709;
+    context->color_trc = AVCOL_TRC_BT709;
+    context->color_range = AVCOL_RANGE_MPEG;
+    
+    // MP4 keeps parameter sets in the sample description, not in-band
+    if (global_header) {
+        context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
     }
     
-    m_impl->audio_codec_context->bit_rate = 128000;
-    m_impl->audio_codec_context->sample_rate = sample_rate;
-    av_channel_layout_default(&m_impl->audio_codec_context->ch_layout, channels);
-    m_impl->audio_codec_context->sample_fmt = AV_SAMPLE_FMT_FLTP;
-    m_impl->audio_codec_context->time_base = {1, sample_rate};
+    apply_backend_options(context, settings);
+    apply_speed_rung(context, ladder, speed_level);
+    apply_threading(context, threading);
     
-    if (avcodec_open2(m_impl->audio_codec_context, audio_codec, nullptr) < 0) {
-        std::cerr << "Could not open audio codec" << std::endl;
-        return false;
+    // Open video codec
+    if (avcodec_open2(context, codec, nullptr) < 0) {
+        std::cerr << "Could not open video codec " << codec->name << std::endl;
+        avcodec_free_context(&context);
+        return nullptr;
     }
+    return context;
+}
+
+FFmpegVideoEncoder::FFmpegVideoEncoder(const EncoderBackend& backend) : m_impl(std::make_unique<Impl>()) {
+    m_impl->backend = backend;
+}
+
+FFmpegVideoEncoder::~FFmpegVideoEncoder() = default;
+
+bool FFmpegVideoEncoder::initialize(const CaptureSettings& settings, int video_width, int video_height) {
+    m_impl->settings = settings;
+    m_impl->video_width = video_width;
+    m_impl->video_height = video_height;
+    const EncoderBackend& backend = m_impl->backend;
     
-    // Setup frames and contexts (same as H.264)
-    m_impl->video_frame = av_frame_alloc();
-    m_impl->audio_frame = av_frame_alloc();
-    m_impl->packet = av_packet_alloc();
-    
-    if (!m_impl->video_frame || !m_impl->audio_frame || !m_impl->packet) {
-        std::cerr << "Could not allocate frames or packet" << std::endl;
-        return false;
+    // The backend's own library, else whatever FFmpeg has for the codec
+    const AVCodec* video_codec = avcodec_find_encoder_by_name(backend.library.c_str());
+    if (!video_codec) {
+        video_codec = avcodec_find_encoder(codec_id(backend.codec));
+        if (video_codec) {
+            std::cerr << backend.library << " not available, using " << video_codec->name << " instead" << std::endl;
+        }
     }
-    
-    // Setup video frame
-    m_impl->video_frame->format = m_impl->video_codec_context->pix_fmt;
-    m_impl->video_frame->width = m_impl->video_codec_context->width;
-    m_impl->video_frame->height = m_impl->video_codec_context->height;
-    
-    if (av_frame_get_buffer(m_impl->video_frame, 0) < 0) {
-        std::cerr << "Could not allocate video frame buffer" << std::endl;
+    if (!video_codec) {
+        std::cerr << backend.display_name << " encoder not found" << std::endl;
         return false;
     }
-    
-    // Setup audio frame
-    m_impl->audio_frame->format = m_impl->audio_codec_context->sample_fmt;
-    m_impl->audio_frame->nb_samples = m_impl->audio_codec_context->frame_size;
-    av_channel_layout_copy(&m_impl->audio_frame->ch_layout, &m_impl->audio_codec_context->ch_layout);
-    
-    if (av_frame_get_buffer(m_impl->audio_frame, 0) < 0) {
-        std::cerr << "Could not allocate audio frame buffer" << std::endl;
+    if (!accepts_pixel_format(video_codec, AV_PIX_FMT_YUV420P)) {
+        std::cerr << video_codec->name << " does not accept yuv420p input" << std::endl;
         return false;
     }
+    m_impl->codec = video_codec;
+    m_impl->ladder = find_speed_ladder(video_codec->name);
+    m_impl->converter.set_kernels_enabled(settings.simd_color_convert);
     
-    // Initialize contexts
-    m_impl->sws_context = sws_getContext(
-        video_width, video_height, AV_PIX_FMT_RGB24,
-        video_width, video_height, AV_PIX_FMT_YUV420P,
-        SWS_BILINEAR, nullptr, nullptr, nullptr);
+    // Thread for the library actually opened, which may be a fallback
+    EncoderBackend opened = backend;
+    opened.library = video_codec->name;
+    m_impl->threading = plan_encoder_threading(opened, settings, video_height);
     
-    if (!m_impl->sws_context) {
-        std::cerr << "Could not initialize video scaling context" << std::endl;
-        return false;
-    }
-    
-    // Audio resampling context
-    m_impl->swr_context = swr_alloc();
-    if (!m_impl->swr_context) {
-        std::cerr << "Could not allocate audio resampling context" << std::endl;
+    m_impl->video_codec_context = m_impl->open_context(0, true);
+    if (!m_impl->video_codec_context) {
         return false;
     }
+    m_impl->picture_format = m_impl->video_codec_context->pix_fmt;
     
-    AVChannelLayout in_ch_layout;
-    av_channel_layout_default(&in_ch_layout, channels);
-    
-    av_opt_set_chlayout(m_impl->swr_context, "in_chlayout", &in_ch_layout, 0);
-    av_opt_set_chlayout(m_impl->swr_context, "out_chlayout", &m_impl->audio_codec_context->ch_layout, 0);
-    av_opt_set_int(m_impl->swr_context, "in_sample_rate", sample_rate, 0);
-    av_opt_set_int(m_impl->swr_context, "out_sample_rate", sample_rate, 0);
-    av_opt_set_sample_fmt(m_impl->swr_context, "in_sample_fmt", AV_SAMPLE_FMT_S16, 0);
-    av_opt_set_sample_fmt(m_impl->swr_context, "out_sample_fmt", AV_SAMPLE_FMT_FLTP, 0);
-    
-    if (swr_init(m_impl->swr_context) < 0) {
-        std::cerr << "Could not initialize audio resampling context" << std::endl;
+    // Allocate frames and packets
+    m_impl->picture = ConvertedFrame::allocate(m_impl->picture_format, video_width, video_height);
+    m_impl->video_packet = EncodedPacket::allocate();
+    if (!m_impl->picture || !m_impl->video_packet) {
+        std::cerr << "Could not allocate frames or packets" << std::endl;
         return false;
     }
     
     m_impl->initialized = true;
     
-    std::cout << "H.265 encoder initialized:\n";
-    std::cout << "  Video: " << video_width << "x" << video_height << " @ 30fps\n";
-    std::cout << "  Audio: " << sample_rate << "Hz, " << channels << " channels\n";
+    std::cout << backend.display_name << " encoder initialized (" << video_codec->name << "):\n";
+    std::cout << "  Video: " << video_width << "x" << video_height << " @ " << settings.frameRate << "fps\n";
+    std::cout << "  Threading: " << describe_threading(m_impl->threading) << ", latency target "
+              << settings.encode_latency_target_ms << " ms\n";
+    std::cout << "  Speed: " << speed_rung_name(m_impl->ladder, 0) << " (" << speed_levels() << " levels)\n";
     
     return true;
 }
 
-std::vector<uint8_t> H265Encoder::encode_video_frame(const Frame& frame) {
-    // Same implementation as H.264 but with H.265 codec
+bool FFmpegVideoEncoder::encode_video_frame(const Frame& frame) {
+    return convert_video_frame(frame, m_impl->picture) && encode_converted_frame(m_impl->picture);
+}
+
+bool FFmpegVideoEncoder::convert_video_frame(const Frame& frame, ConvertedFrame& converted) {
     if (!m_impl->initialized) {
-        return {};
+        return false;
     }
     
-    std::vector<uint8_t> result;
-    
-    if (av_frame_make_writable(m_impl->video_frame) < 0) {
+    // Reuse the caller's picture when it has one, otherwise start a new one
+    if (!converted) {
+        converted = ConvertedFrame::allocate(m_impl->picture_format, m_impl->video_width, m_impl->video_height);
+        if (!converted) {
+            std::cerr << "Could not allocate video frame buffer" << std::endl;
+            return false;
+        }
+    } else if (!converted.make_writable()) {
         std::cerr << "Could not make video frame writable" << std::endl;
-        return result;
-    }
-    
-    const uint8_t* src_data[4] = {frame.data.data(), nullptr, nullptr, nullptr};
-    int src_linesize[4] = {m_impl->video_width * 3, 0, 0, 0};
-    
-    sws_scale(m_impl->sws_context, src_data, src_linesize, 0, m_impl->video_height,
-              m_impl->video_frame->data, m_impl->video_frame->linesize);
-    
-    m_impl->video_frame->pts = m_impl->video_pts++;
-    
-    int ret = avcodec_send_frame(m_impl->video_codec_context, m_impl->video_frame);
-    if (ret < 0) {
-        std::cerr << "Error sending video frame to encoder" << std::endl;
-        return result;
+        return false;
     }
     
-    while (ret >= 0) {
-        ret = avcodec_receive_packet(m_impl->video_codec_context, m_impl->packet);
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            break;
-        } else if (ret < 0) {
-            std::cerr << "Error encoding video frame" << std::endl;
-            break;
-        }
-        
-        result.insert(result.end(), m_impl->packet->data, m_impl->packet->data + m_impl->packet->size);
-        av_packet_unref(m_impl->packet);
+    // Convert the captured format to YUV420P
+    if (!m_impl->converter.convert(frame, converted.get())) {
+        std::cerr << "Could not convert video frame" << std::endl;
+        return false;
     }
+    converted.timestamp = frame.timestamp;
     
-    return result;
+    return true;
 }
 
-std::vector<uint8_t> H265Encoder::encode_audio_sample(const AudioSample& sample) {
-    // Same implementation as H.264
-    if (!m_impl->initialized) {
-        return {};
+bool FFmpegVideoEncoder::encode_converted_frame(ConvertedFrame& converted) {
+    if (!m_impl->initialized || !converted) {
+        return false;
     }
     
-    std::vector<uint8_t> result;
-    
-    if (av_frame_make_writable(m_impl->audio_frame) < 0) {
-        std::cerr << "Could not make audio frame writable" << std::endl;
-        return result;
+    // Stamp from the capture clock so late or dropped grabs leave a gap
+    // rather than shifting every later frame; PTS must still increase
+    int64_t pts = clock_ticks(converted.timestamp, kVideoClockRate);
+    if (pts <= m_impl->last_video_pts) {
+        pts = m_impl->last_video_pts + 1;
     }
-    
-    const uint8_t* src_data[1] = {sample.data.data()};
-    int src_samples = sample.data.size() / (m_impl->channels * 2);
-    
-    int converted_samples = swr_convert(m_impl->swr_context,
-                                       m_impl->audio_frame->data, m_impl->audio_frame->nb_samples,
-                                       src_data, src_samples);
-    
-    if (converted_samples < 0) {
-        std::cerr << "Error converting audio samples" << std::endl;
-        return result;
+    converted.get()->pts = pts;
+    m_impl->last_video_pts = pts;
+    
+    // A requested keyframe restarts the encoder's GOP count
+    AVFrame* frame = converted.get();
+    frame->pict_type = AV_PICTURE_TYPE_NONE;
+    if (m_impl->keyframe_requested.exchange(false)) {
+        frame->pict_type = AV_PICTURE_TYPE_I;
+        m_impl->gop_start = m_impl->frames_sent;
     }
     
-    m_impl->audio_frame->pts = m_impl->audio_pts;
-    m_impl->audio_pts += m_impl->audio_frame->nb_samples;
+    // Speed changes wait for a GOP boundary so the new setting starts on
+    // a keyframe
+    int gop_size = std::max(1, m_impl->video_codec_context->gop_size);
+    if (m_impl->pending_level != m_impl->level && (m_impl->frames_sent - m_impl->gop_start) % gop_size == 0) {
+        change_speed_level();
+    }
+    m_impl->frames_sent++;
+    m_impl->in_flight.emplace_back(pts, std::chrono::steady_clock::now());
     
-    int ret = avcodec_send_frame(m_impl->audio_codec_context, m_impl->audio_frame);
+    // Send frame to encoder
+    int ret = 0;
+    {
+        trace::Span span("send frame", static_cast<uint64_t>(pts));
+        ret = avcodec_send_frame(m_impl->video_codec_context, converted.get());
+    }
     if (ret < 0) {
-        std::cerr << "Error sending audio frame to encoder" << std::endl;
-        return result;
+        m_impl->in_flight.pop_back();
+        std::cerr << "Error sending video frame to encoder" << std::endl;
+        return false;
     }
     
-    while (ret >= 0) {
-        ret = avcodec_receive_packet(m_impl->audio_codec_context, m_impl->packet);
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            break;
-        } else if (ret < 0) {
-            std::cerr << "Error encoding audio frame" << std::endl;
-            break;
-        }
-        
-        result.insert(result.end(), m_impl->packet->data, m_impl->packet->data + m_impl->packet->size);
-        av_packet_unref(m_impl->packet);
+    // Hand the encoded packets on without copying them
+    trace::Span span("receive packets");
+    ret = drain_packets(m_impl->video_codec_context, StreamType::VIDEO, m_impl->video_packet, timed_callback());
+    if (ret < 0) {
+        std::cerr << "Error encoding video frame" << std::endl;
+        return false;
     }
     
-    return result;
+    return true;
 }
 
-std::vector<uint8_t> H265Encoder::finalize() {
+bool FFmpegVideoEncoder::finalize() {
     if (!m_impl->initialized) {
-        return {};
+        return false;
     }
     
-    std::vector<uint8_t> result;
-    
-    // Flush encoders (same as H.264)
+    // Flush video encoder
     avcodec_send_frame(m_impl->video_codec_context, nullptr);
-    int ret = 0;
-    while (ret >= 0) {
-        ret = avcodec_receive_packet(m_impl->video_codec_context, m_impl->packet);
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            break;
+    int video_ret = drain_packets(m_impl->video_codec_context, StreamType::VIDEO, m_impl->video_packet, timed_callback());
+    
+    EncodeStats stats = get_encode_stats();
+    std::cout << m_impl->backend.display_name << " encoder finalized\n";
+    std::cout << "  Threading: " << describe_threading(stats.threading) << "; encode latency p50 "
+              << stats.p50_latency_ms << " ms, p95 " << stats.p95_latency_ms << " ms, p99 "
+              << stats.p99_latency_ms << " ms over " << stats.frames << " frames\n";
+    return video_ret >= 0;
+}
+
+bool FFmpegVideoEncoder::change_speed_level() {
+    Impl& impl = *m_impl;
+    int from = impl.level;
+    int to = impl.pending_level;
+    const SpeedRung& current = impl.ladder->rungs[from];
+    const SpeedRung& next = impl.ladder->rungs[to];
+    
+    // x264 picks up a new CRF between frames; anything else takes a new
+    // encoder, started after the old one has flushed its last GOP
+    bool in_place = std::strcmp(impl.codec->name, "libx264") == 0 && std::strcmp(current.speed, next.speed) == 0;
+    if (in_place) {
+        av_opt_set(impl.video_codec_context->priv_data, "crf", next.crf, 0);
+    } else {
+        // Parameter sets go in-band from here on, before every keyframe,
+        // since the container's copy describes the first encoder only
+        // (the muxer marks the track avc3/hev1 for this)
+        AVCodecContext* replacement = impl.open_context(to, false);
+        if (!replacement) {
+            std::cerr << "Could not switch encoder to " << speed_rung_name(impl.ladder, to) << std::endl;
+            impl.pending_level = from;
+            return false;
+        }
+        avcodec_send_frame(impl.video_codec_context, nullptr);
+        int ret = drain_packets(impl.video_codec_context, StreamType::VIDEO, impl.video_packet, timed_callback());
+        if (ret < 0) {
+            std::cerr << "Error flushing video encoder before switching" << std::endl;
         }
-        result.insert(result.end(), m_impl->packet->data, m_impl->packet->data + m_impl->packet->size);
-        av_packet_unref(m_impl->packet);
+        avcodec_free_context(&impl.video_codec_context);
+        impl.video_codec_context = replacement;
     }
     
-    avcodec_send_frame(m_impl->audio_codec_context, nullptr);
-    ret = 0;
-    while (ret >= 0) {
-        ret = avcodec_receive_packet(m_impl->audio_codec_context, m_impl->packet);
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            break;
+    SpeedAdjustment adjustment;
+    adjustment.frame = impl.frames_sent;
+    adjustment.from_level = from;
+    adjustment.to_level = to;
+    adjustment.setting = speed_rung_name(impl.ladder, to);
+    adjustment.swapped = !in_place;
+    adjustment.reason = impl.pending_reason;
+    std::cout << "Encoder speed " << speed_rung_name(impl.ladder, from) << " -> " << adjustment.setting
+              << (in_place ? " (reconfigured)" : " (new encoder)") << " at frame " << adjustment.frame
+              << ": " << adjustment.reason << "\n";
+    
+    std::lock_guard<std::mutex> lock(impl.adjustments_mutex);
+    impl.level = to;
+    impl.adjustments.push_back(std::move(adjustment));
+    return true;
+}
+
+PacketCallback FFmpegVideoEncoder::timed_callback() {
+    // Small enough to be stored without allocating
+    return [this](EncodedPacket& packet) {
+        // Packets of a replacement encoder may start with a DTS at or
+        // before the previous encoder's last one
+        AVPacket* pkt = packet.get();
+        if (pkt->dts != AV_NOPTS_VALUE) {
+            if (pkt->dts <= m_impl->last_dts) {
+                pkt->dts = std::min(pkt->pts, m_impl->last_dts + 1);
+            }
+            m_impl->last_dts = pkt->dts;
+        }
+        
+        auto& in_flight = m_impl->in_flight;
+        int64_t pts = pkt->pts;
+        auto it = std::find_if(in_flight.begin(), in_flight.end(),
+                               [pts](const auto& entry) { return entry.first == pts; });
+        if (it != in_flight.end()) {
+            m_impl->encode_latency.record(std::chrono::steady_clock::now() - it->second);
+            in_flight.erase(it);
+        }
+        if (m_packet_callback) {
+            m_packet_callback(packet);
+        }
+    };
+}
+
+std::string FFmpegVideoEncoder::get_codec_name() const {
+    return m_impl->backend.display_name;
+}
+
+bool FFmpegVideoEncoder::supports_hardware_acceleration() const {
+    return hardware_encoder_available(m_impl->backend.codec);
+}
+
+VideoStreamInfo FFmpegVideoEncoder::stream_info() const {
+    VideoStreamInfo info;
+    info.codec = m_impl->backend.codec;
+    info.width = m_impl->video_width;
+    info.height = m_impl->video_height;
+    const AVCodecContext* context = m_impl->video_codec_context;
+    if (context) {
+        info.bit_rate = context->bit_rate > 0 ? context->bit_rate : m_impl->settings.videoBitrate;
+        if (context->extradata && context->extradata_size > 0) {
+            info.extradata.assign(context->extradata, context->extradata + context->extradata_size);
         }
-        result.insert(result.end(), m_impl->packet->data, m_impl->packet->data + m_impl->packet->size);
-        av_packet_unref(m_impl->packet);
     }
-    
-    std::cout << "H.265 encoder finalized\n";
-    return result;
+    return info;
+}
+
+VideoConverter::Stats FFmpegVideoEncoder::get_convert_stats() const {
+    return m_impl->converter.get_stats();
+}
+
+int FFmpegVideoEncoder::speed_levels() const {
+    return m_impl->ladder ? static_cast<int>(m_impl->ladder->rungs.size()) : 1;
 }
 
-bool H265Encoder::supports_hardware_acceleration() const {
-    #if defined(__APPLE__)
-        return avcodec_find_encoder_by_name("hevc_videotoolbox") != nullptr;
-    #elif defined(_WIN32)
-        return avcodec_find_encoder_by_name("hevc_nvenc") != nullptr ||
-               avcodec_find_encoder_by_name("hevc_qsv") != nullptr;
-    #else
-        return avcodec_find_encoder_by_name("hevc_vaapi") != nullptr ||
-               avcodec_find_encoder_by_name("hevc_nvenc") != nullptr;
-    #endif
+int FFmpegVideoEncoder::speed_level() const {
+    std::lock_guard<std::mutex> lock(m_impl->adjustments_mutex);
+    return m_impl->level;
+}
+
+int FFmpegVideoEncoder::requested_speed_level() const {
+    return m_impl->pending_level;
+}
+
+void FFmpegVideoEncoder::request_speed_level(int level, const std::string& reason) {
+    m_impl->pending_level = std::clamp(level, 0, speed_levels() - 1);
+    m_impl->pending_reason = reason;
+}
+
+void FFmpegVideoEncoder::request_keyframe() {
+    m_impl->keyframe_requested = true;
+}
+
+VideoEncoder::EncodeStats FFmpegVideoEncoder::get_encode_stats() const {
+    EncodeStats stats;
+    stats.threading = m_impl->threading;
+    {
+        std::lock_guard<std::mutex> lock(m_impl->adjustments_mutex);
+        stats.speed_level = m_impl->level;
+        stats.adjustments = m_impl->adjustments;
+    }
+    stats.frames = m_impl->encode_latency.count();
+    stats.p50_latency_ms = m_impl->encode_latency.percentile_ms(0.50);
+    stats.p95_latency_ms = m_impl->encode_latency.percentile_ms(0.95);
+    stats.p99_latency_ms = m_impl->encode_latency.percentile_ms(0.99);
+    return stats;
 }
 
 // Factory function
-std::unique_ptr<Encoder> create_encoder(const std::string& codec_name) {
-    if (codec_name == "h264" || codec_name == "H.264") {
-        return std::make_unique<H264Encoder>();
-    } else if (codec_name == "h265" || codec_name == "H.265" || codec_name == "hevc") {
-        return std::make_unique<H265Encoder>();
-    } else {
+std::unique_ptr<VideoEncoder> create_video_encoder(const std::string& codec_name) {
+    const EncoderBackend* backend = find_encoder_backend(codec_name);
+    if (!backend) {
         std::cerr << "Unknown codec: " << codec_name << ". Defaulting to H.264\n";
-        return std::make_unique<H264Encoder>();
+        backend = find_encoder_backend("h264");
     }
+    return std::make_unique<FFmpegVideoEncoder>(*backend);
+}
+
+std::unique_ptr<AudioEncoder> create_audio_encoder() {
+    return std::make_unique<AudioEncoder>();
 }
 
 } // namespace playrec
\ No newline at end of file
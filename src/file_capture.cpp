@@ -0,0 +1,331 @@
+#include "file_capture.h"
+#include "video_converter.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace playrec {
+
+namespace {
+
+constexpr size_t kReadBufferSize = 8 << 20;  // stdio buffer for unmappable input
+constexpr size_t kMaxHeaderLength = 1024;    // Y4M stream and frame header lines
+
+bool ends_with(const std::string& value, const std::string& suffix) {
+    return value.size() >= suffix.size() &&
+           value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Read up to and including '\n', without the newline
+bool read_line(FILE* stream, std::string& line) {
+    line.clear();
+    for (int c = std::fgetc(stream); c != EOF; c = std::fgetc(stream)) {
+        if (c == '\n') {
+            return true;
+        }
+        if (line.size() >= kMaxHeaderLength) {
+            return false;
+        }
+        line.push_back(static_cast<char>(c));
+    }
+    return false;
+}
+
+} // namespace
+
+struct FileVideoCapture::Mapping {
+    uint8_t* data = nullptr;
+    size_t size = 0;
+
+    ~Mapping() {
+#ifndef _WIN32
+        if (data) {
+            munmap(data, size);
+        }
+#endif
+    }
+};
+
+FileVideoCapture::FileVideoCapture(std::string path, RawVideoFormat raw, bool realtime)
+    : m_path(std::move(path)), m_format(raw), m_realtime(realtime) {}
+
+FileVideoCapture::~FileVideoCapture() {
+    stop();
+    if (m_stream) {
+        std::fclose(m_stream);
+    }
+}
+
+bool FileVideoCapture::open() {
+    if (m_opened) {
+        return true;
+    }
+
+    // Without a raw frame size the input has to describe itself
+    m_is_y4m = ends_with(m_path, ".y4m") || m_format.width <= 0;
+
+#ifndef _WIN32
+    int fd = ::open(m_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Failed to open input file: " << m_path << "\n";
+        return false;
+    }
+
+    struct stat info {};
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        // Private and writable so a stray write downstream cannot fault
+        size_t size = static_cast<size_t>(info.st_size);
+        void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, size, MADV_SEQUENTIAL);
+            m_mapping = std::make_shared<Mapping>();
+            m_mapping->data = static_cast<uint8_t*>(data);
+            m_mapping->size = size;
+        }
+    }
+
+    if (m_mapping) {
+        ::close(fd);
+    } else {
+        m_stream = fdopen(fd, "rb");
+        if (!m_stream) {
+            ::close(fd);
+        }
+    }
+#else
+    m_stream = std::fopen(m_path.c_str(), "rb");
+#endif
+
+    if (!m_mapping && !m_stream) {
+        std::cerr << "Failed to open input file: " << m_path << "\n";
+        return false;
+    }
+    if (m_stream) {
+        std::setvbuf(m_stream, nullptr, _IOFBF, kReadBufferSize);
+    }
+
+    if (m_is_y4m) {
+        std::string header;
+        if (m_mapping) {
+            auto* begin = reinterpret_cast<const char*>(m_mapping->data);
+            auto* newline = static_cast<const char*>(
+                std::memchr(begin, '\n', std::min(m_mapping->size, kMaxHeaderLength)));
+            if (newline) {
+                header.assign(begin, newline);
+                m_offset = static_cast<size_t>(newline - begin) + 1;
+            }
+        } else {
+            read_line(m_stream, header);
+        }
+        if (!parse_y4m_header(header)) {
+            return false;
+        }
+    }
+
+    int width = m_format.width;
+    int height = m_format.height;
+    if (width <= 0 || height <= 0 || m_format.fps_num <= 0 || m_format.fps_den <= 0) {
+        std::cerr << "Raw input needs a frame size and rate\n";
+        return false;
+    }
+    bool planar = m_format.format == VideoFormat::YUV420P || m_format.format == VideoFormat::NV12;
+    if (planar && ((width | height) & 1)) {
+        std::cerr << "4:2:0 input must have an even width and height\n";
+        return false;
+    }
+
+    m_frame_size = VideoConverter::required_size(
+        m_format.format, VideoConverter::default_stride(m_format.format, width), height);
+
+    if (m_mapping) {
+        // Y4M frames normally carry a bare "FRAME\n" header
+        size_t per_frame = m_frame_size + (m_is_y4m ? 6 : 0);
+        size_t payload = m_mapping->size - m_offset;
+        m_frame_count = payload / per_frame;
+        if (!m_is_y4m && payload % per_frame != 0) {
+            std::cerr << "Warning: input size is not a whole number of frames, ignoring the tail\n";
+        }
+    }
+
+    m_opened = true;
+    return true;
+}
+
+bool FileVideoCapture::parse_y4m_header(const std::string& header) {
+    std::istringstream tokens(header);
+    std::string token;
+    if (!(tokens >> token) || token != "YUV4MPEG2") {
+        std::cerr << "Not a YUV4MPEG2 file: " << m_path << "\n";
+        return false;
+    }
+
+    m_format = RawVideoFormat{};
+    m_format.format = VideoFormat::YUV420P;
+    while (tokens >> token) {
+        char tag = token[0];
+        std::string value = token.substr(1);
+        if (tag == 'W') {
+            m_format.width = std::atoi(value.c_str());
+        } else if (tag == 'H') {
+            m_format.height = std::atoi(value.c_str());
+        } else if (tag == 'F') {
+            auto colon = value.find(':');
+            if (colon != std::string::npos) {
+                m_format.fps_num = std::atoi(value.substr(0, colon).c_str());
+                m_format.fps_den = std::atoi(value.substr(colon + 1).c_str());
+            }
+        } else if (tag == 'C') {
+            // Chroma siting variants are all 8-bit 4:2:0 to us
+            if (value != "420" && value != "420jpeg" && value != "420paldv" && value != "420mpeg2") {
+                std::cerr << "Unsupported Y4M colorspace C" << value << " (only 8-bit 4:2:0)\n";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool FileVideoCapture::initialize(const CaptureSettings& settings) {
+    if (!open()) {
+        return false;
+    }
+
+    if (m_stream) {
+        m_frame_pool.reserve(settings, m_frame_size);
+    }
+
+    std::cout << "File input initialized: " << m_path << "\n";
+    std::cout << "  " << m_format.width << "x" << m_format.height << " @ " << frame_rate() << " FPS, "
+              << (m_is_y4m ? "Y4M" : "raw") << ", " << (m_mapping ? "memory-mapped" : "streamed");
+    if (m_frame_count > 0) {
+        std::cout << ", " << m_frame_count << " frames";
+    }
+    std::cout << (m_realtime ? ", realtime" : "") << "\n";
+    return true;
+}
+
+bool FileVideoCapture::start() {
+    if (!m_opened || m_is_active) {
+        return false;
+    }
+
+    m_should_stop = false;
+    m_frames_emitted = 0;
+    m_start_time = std::chrono::high_resolution_clock::now();
+    m_is_active = true;
+    m_thread = std::thread(&FileVideoCapture::replay_loop, this);
+    return true;
+}
+
+void FileVideoCapture::stop() {
+    m_should_stop = true;
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    m_is_active = false;
+}
+
+std::pair<int, int> FileVideoCapture::get_resolution() const {
+    return {m_format.width, m_format.height};
+}
+
+bool FileVideoCapture::is_active() const {
+    return m_is_active;
+}
+
+double FileVideoCapture::frame_rate() const {
+    return static_cast<double>(m_format.fps_num) / m_format.fps_den;
+}
+
+bool FileVideoCapture::next_frame(Frame& frame) {
+    frame.width = m_format.width;
+    frame.height = m_format.height;
+    frame.format = m_format.format;
+    frame.stride = VideoConverter::default_stride(m_format.format, m_format.width);
+
+    if (m_mapping) {
+        size_t offset = m_offset;
+        if (m_is_y4m) {
+            auto* begin = reinterpret_cast<const char*>(m_mapping->data + offset);
+            size_t remaining = m_mapping->size - offset;
+            if (remaining < 5 || std::memcmp(begin, "FRAME", 5) != 0) {
+                return false;
+            }
+            auto* newline = static_cast<const char*>(
+                std::memchr(begin, '\n', std::min(remaining, kMaxHeaderLength)));
+            if (!newline) {
+                return false;
+            }
+            offset += static_cast<size_t>(newline - begin) + 1;
+        }
+        if (m_mapping->size - offset < m_frame_size) {
+            return false;
+        }
+
+        // A view of the mapping; the mapping lives until the last view goes
+        auto mapping = m_mapping;
+        std::shared_ptr<FrameBuffer::Storage> storage(
+            new FrameBuffer::Storage{m_mapping->data + offset, m_frame_size},
+            [mapping](FrameBuffer::Storage* view) { delete view; });
+        frame.data = FrameBuffer(std::move(storage), m_frame_size);
+        m_offset = offset + m_frame_size;
+
+#ifndef _WIN32
+        // Start reading the next frame in while this one is converted
+        static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t ahead = m_offset & ~(page - 1);
+        if (ahead < m_mapping->size) {
+            madvise(m_mapping->data + ahead, std::min(m_frame_size + page, m_mapping->size - ahead), MADV_WILLNEED);
+        }
+#endif
+        return true;
+    }
+
+    if (m_is_y4m) {
+        std::string header;
+        if (!read_line(m_stream, header) || header.compare(0, 5, "FRAME") != 0) {
+            return false;
+        }
+    }
+    frame.data = m_frame_pool.acquire(m_frame_size);
+    return std::fread(frame.data.data(), 1, m_frame_size, m_stream) == m_frame_size;
+}
+
+void FileVideoCapture::replay_loop() {
+    double frame_seconds = static_cast<double>(m_format.fps_den) / m_format.fps_num;
+    m_pacer.set_period(std::chrono::nanoseconds(1000000000LL * m_format.fps_den / m_format.fps_num));
+    m_pacer.start();
+
+    for (uint64_t index = 0; !m_should_stop; ++index) {
+        TimeStamp timestamp = m_start_time + std::chrono::duration_cast<TimeStamp::duration>(
+            std::chrono::duration<double>(index * frame_seconds));
+        if (m_realtime) {
+            m_pacer.wait_for(index);
+        }
+
+        auto read_start = std::chrono::high_resolution_clock::now();
+        Frame frame;
+        if (!next_frame(frame)) {
+            break;
+        }
+        frame.timestamp = timestamp;
+        record_grab_latency(std::chrono::high_resolution_clock::now() - read_start);
+
+        emit_frame(frame);
+        m_frames_emitted++;
+    }
+
+    std::cout << "Input file finished after " << m_frames_emitted << " frames\n";
+    m_is_active = false;
+}
+
+} // namespace playrec
@@ -1,6 +1,20 @@
 #include "file_writer.h"
+#include "trace.h"
 #include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 extern "C" {
 #include <libavformat/avformat.h>
@@ -19,6 +33,149 @@ static std::string av_error_to_string(int errnum) {
     return std::string(errbuf);
 }
 
+static AVCodecID video_codec_id(VideoCodec codec) {
+    switch (codec) {
+        case VideoCodec::H264: return AV_CODEC_ID_H264;
+        case VideoCodec::HEVC: return AV_CODEC_ID_HEVC;
+        case VideoCodec::AV1: return AV_CODEC_ID_AV1;
+        case VideoCodec::VP9: return AV_CODEC_ID_VP9;
+    }
+    return AV_CODEC_ID_H264;
+}
+
+namespace {
+
+constexpr size_t kDirectAlignment = 4096;  // O_DIRECT offset, size and address alignment
+
+uint8_t* allocate_aligned(size_t size) {
+#ifdef _WIN32
+    return static_cast<uint8_t*>(_aligned_malloc(size, kDirectAlignment));
+#else
+    void* memory = nullptr;
+    return posix_memalign(&memory, kDirectAlignment, size) == 0 ? static_cast<uint8_t*>(memory) : nullptr;
+#endif
+}
+
+struct AlignedFree {
+    void operator()(uint8_t* memory) const {
+#ifdef _WIN32
+        _aligned_free(memory);
+#else
+        std::free(memory);
+#endif
+    }
+};
+
+} // namespace
+
+// A run of bytes bound for one place in the file
+struct FileWriter::Chunk {
+    std::unique_ptr<uint8_t, AlignedFree> data;
+    size_t size = 0;
+    size_t limit = 0;       // Bytes this chunk takes; ends it on an aligned offset
+    uint64_t offset = 0;
+};
+
+struct FileWriter::IoState {
+    FileWriterOptions options;
+    std::string filename;
+    size_t chunk_capacity = 0;
+#ifdef _WIN32
+    FILE* file = nullptr;
+#else
+    int fd = -1;
+    int direct_fd = -1;     // Second descriptor opened with O_DIRECT, if requested and supported
+#endif
+    bool open = false;
+
+    // Writer side
+    Chunk current;
+    uint64_t position = 0;
+    std::atomic<uint64_t> end{0};           // Furthest byte accepted, i.e. the file size
+    std::chrono::steady_clock::time_point opened_at;
+
+    // Full chunks go to the I/O thread; written ones come back for reuse
+    std::unique_ptr<StageQueue<Chunk>> queue;
+    std::unique_ptr<RingQueue<Chunk>> spare;
+    std::thread thread;
+    StageMeter meter;
+
+    std::atomic<uint64_t> bytes_submitted{0};
+    std::atomic<uint64_t> bytes_done{0};      // Written or failed
+    std::atomic<uint64_t> bytes_written{0};
+    std::atomic<uint64_t> writes{0};
+    std::atomic<uint64_t> direct_writes{0};
+    std::atomic<bool> failed{false};
+    std::mutex done_mutex;
+    std::condition_variable done_changed;
+
+    void run();
+    bool write_at(const Chunk& chunk);
+};
+
+void FileWriter::IoState::run() {
+    meter.bind_thread();
+    trace::set_thread_name("io");
+    Chunk chunk;
+    while (queue->pop(chunk)) {
+        auto start_time = std::chrono::steady_clock::now();
+        trace::Span span("write chunk");
+        bool ok = write_at(chunk);
+        meter.record(std::chrono::steady_clock::now() - start_time);
+
+        if (ok) {
+            bytes_written += chunk.size;
+        } else if (!failed.exchange(true)) {
+            std::cerr << "Error writing to file " << filename << ": " << std::strerror(errno) << "\n";
+        }
+        {
+            std::lock_guard<std::mutex> lock(done_mutex);
+            bytes_done += chunk.size;
+        }
+        done_changed.notify_all();
+
+        // Back to the writer; dropped if enough are already waiting
+        chunk.size = 0;
+        spare->try_push(std::move(chunk));
+    }
+    meter.unbind_thread();
+}
+
+bool FileWriter::IoState::write_at(const Chunk& chunk) {
+    const uint8_t* data = chunk.data.get();
+    size_t remaining = chunk.size;
+    uint64_t offset = chunk.offset;
+
+#ifdef _WIN32
+    if (_fseeki64(file, static_cast<long long>(offset), SEEK_SET) != 0) {
+        return false;
+    }
+    writes++;
+    return std::fwrite(data, 1, remaining, file) == remaining;
+#else
+    // The buffer is always aligned; the tail and anything after a flush may not be
+    bool direct = direct_fd >= 0 && offset % kDirectAlignment == 0 && remaining % kDirectAlignment == 0;
+    int target = direct ? direct_fd : fd;
+    while (remaining > 0) {
+        ssize_t written = pwrite(target, data, remaining, static_cast<off_t>(offset));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        writes++;
+        if (direct) {
+            direct_writes++;
+        }
+        data += written;
+        offset += static_cast<uint64_t>(written);
+        remaining -= static_cast<size_t>(written);
+    }
+    return true;
+#endif
+}
+
 // Base FileWriter implementation
 FileWriter::FileWriter() = default;
 
@@ -28,27 +185,98 @@ FileWriter::~FileWriter() {
     }
 }
 
-bool FileWriter::open(const std::string& filename) {
+bool FileWriter::open(const std::string& filename, const FileWriterOptions& options) {
     if (is_open()) {
         close();
     }
-    
-    m_file.open(filename, std::ios::binary | std::ios::out);
-    if (!m_file.is_open()) {
+
+    auto io = std::make_unique<IoState>();
+    io->options = options;
+    io->filename = filename;
+    io->chunk_capacity = std::max(options.chunk_bytes, kDirectAlignment);
+    io->chunk_capacity = (io->chunk_capacity + kDirectAlignment - 1) / kDirectAlignment * kDirectAlignment;
+
+#ifdef _WIN32
+    io->file = std::fopen(filename.c_str(), "wb");
+    if (!io->file) {
         std::cerr << "Failed to open file for writing: " << filename << "\n";
         return false;
     }
-    
-    m_bytes_written = 0;
-    std::cout << "File opened for writing: " << filename << "\n";
+    // Chunks are already large; stdio's buffer would only add a copy
+    std::setvbuf(io->file, nullptr, _IONBF, 0);
+#else
+    io->fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (io->fd < 0) {
+        std::cerr << "Failed to open file for writing: " << filename << "\n";
+        return false;
+    }
+
+#ifdef O_DIRECT
+    if (options.direct_io) {
+        io->direct_fd = ::open(filename.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+        if (io->direct_fd < 0) {
+            std::cerr << "O_DIRECT not supported for " << filename << ", using buffered writes\n";
+        }
+    }
+#endif
+
+#ifdef __linux__
+    // Reserve the extents without changing the visible size, so a short
+    // recording does not leave a tail of zeros
+    if (options.preallocate_bytes > 0 &&
+        fallocate(io->fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(options.preallocate_bytes)) != 0) {
+        std::cerr << "Could not preallocate " << options.preallocate_bytes << " bytes: " << std::strerror(errno) << "\n";
+    }
+#endif
+#endif
+
+    size_t depth = std::max<size_t>(2, options.memory_cap_bytes / io->chunk_capacity);
+    io->queue = std::make_unique<StageQueue<Chunk>>(depth);
+    io->spare = std::make_unique<RingQueue<Chunk>>(depth + 1);
+    io->open = true;
+    io->opened_at = std::chrono::steady_clock::now();
+    io->thread = std::thread(&IoState::run, io.get());
+    m_io = std::move(io);
+
+    std::cout << "File opened for writing: " << filename << " (" << (m_io->chunk_capacity >> 10) << " KB chunks, "
+              << (depth * m_io->chunk_capacity >> 20) << " MB write-behind"
+#ifdef O_DIRECT
+              << (m_io->direct_fd >= 0 ? ", O_DIRECT" : "")
+#endif
+              << ")\n";
     return true;
 }
 
-void FileWriter::close() {
-    if (m_file.is_open()) {
-        m_file.close();
-        std::cout << "File closed. Total bytes written: " << m_bytes_written << "\n";
+bool FileWriter::close() {
+    if (!is_open()) {
+        return true;
+    }
+
+    submit_chunk();
+    m_io->queue->close();
+    if (m_io->thread.joinable()) {
+        m_io->thread.join();
+    }
+
+    // Some filesystems only report a failed write when the file is closed
+    bool closed = true;
+#ifdef _WIN32
+    closed = std::fclose(m_io->file) == 0;
+    m_io->file = nullptr;
+#else
+    if (m_io->direct_fd >= 0) {
+        closed = ::close(m_io->direct_fd) == 0;
+        m_io->direct_fd = -1;
     }
+    closed = ::close(m_io->fd) == 0 && closed;
+    m_io->fd = -1;
+#endif
+    m_io->open = false;
+    if (!closed && !m_io->failed.exchange(true)) {
+        std::cerr << "Error closing file " << m_io->filename << ": " << std::strerror(errno) << "\n";
+    }
+    std::cout << "File closed. Total bytes written: " << m_io->bytes_written << "\n";
+    return !m_io->failed;
 }
 
 bool FileWriter::write(const std::vector<uint8_t>& data) {
@@ -56,34 +284,120 @@ bool FileWriter::write(const std::vector<uint8_t>& data) {
 }
 
 bool FileWriter::write(const uint8_t* data, size_t size) {
-    if (!is_open() || !data || size == 0) {
+    if (!is_open() || !data || size == 0 || m_io->failed) {
         return false;
     }
-    
-    m_file.write(reinterpret_cast<const char*>(data), size);
-    if (m_file.good()) {
-        m_bytes_written += size;
-        return true;
+
+    IoState& io = *m_io;
+    while (size > 0) {
+        Chunk& chunk = io.current;
+        if (!chunk.data) {
+            // Reuse a written chunk when one is back, otherwise grow
+            if (!io.spare->try_pop(chunk)) {
+                chunk.data.reset(allocate_aligned(io.chunk_capacity));
+                if (!chunk.data) {
+                    std::cerr << "Failed to allocate write buffer\n";
+                    return false;
+                }
+            }
+            chunk.size = 0;
+            chunk.offset = io.position;
+            chunk.limit = io.chunk_capacity - static_cast<size_t>(io.position % kDirectAlignment);
+        }
+
+        size_t count = std::min(size, chunk.limit - chunk.size);
+        std::memcpy(chunk.data.get() + chunk.size, data, count);
+        chunk.size += count;
+        io.position += count;
+        if (io.position > io.end.load(std::memory_order_relaxed)) {
+            io.end.store(io.position, std::memory_order_relaxed);
+        }
+        data += count;
+        size -= count;
+
+        if (chunk.size == chunk.limit) {
+            submit_chunk();
+        }
     }
-    
-    std::cerr << "Error writing to file\n";
-    return false;
+    return true;
+}
+
+bool FileWriter::seek(uint64_t offset) {
+    if (!is_open() || m_io->failed) {
+        return false;
+    }
+
+    // Chunks carry their own offsets and the I/O thread writes them in
+    // order, so a rewrite lands after the data it overwrites
+    if (offset != m_io->position) {
+        submit_chunk();
+        m_io->position = offset;
+    }
+    return true;
+}
+
+uint64_t FileWriter::tell() const {
+    return m_io ? m_io->position : 0;
+}
+
+void FileWriter::submit_chunk() {
+    Chunk& chunk = m_io->current;
+    if (!chunk.data || chunk.size == 0) {
+        return;
+    }
+
+    m_io->bytes_submitted += chunk.size;
+    auto start_time = std::chrono::steady_clock::now();
+    m_io->queue->push(std::move(chunk));
+    m_io->meter.add_blocked(std::chrono::steady_clock::now() - start_time);
+    chunk = Chunk{};
 }
 
 uint64_t FileWriter::get_file_size() const {
-    return m_bytes_written;
+    return m_io ? m_io->end.load(std::memory_order_relaxed) : 0;
 }
 
 bool FileWriter::is_open() const {
-    return m_file.is_open();
+    return m_io && m_io->open;
 }
 
-void FileWriter::flush() {
+void FileWriter::submit() {
     if (is_open()) {
-        m_file.flush();
+        submit_chunk();
     }
 }
 
+void FileWriter::flush() {
+    if (!is_open()) {
+        return;
+    }
+
+    // The next chunk is shortened to get back onto an aligned offset
+    submit_chunk();
+    std::unique_lock<std::mutex> lock(m_io->done_mutex);
+    m_io->done_changed.wait(lock, [this] {
+        return m_io->bytes_done.load() >= m_io->bytes_submitted.load();
+    });
+}
+
+FileWriter::Stats FileWriter::get_stats() const {
+    Stats stats;
+    if (!m_io || !m_io->queue) {
+        return stats;
+    }
+    stats.bytes_written = m_io->bytes_written;
+    stats.bytes_queued = m_io->bytes_submitted - m_io->bytes_done;
+    stats.writes = m_io->writes;
+    stats.direct_writes = m_io->direct_writes;
+    stats.io = m_io->meter.snapshot("io", *m_io->queue);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_io->opened_at).count();
+    if (seconds > 0) {
+        stats.bytes_per_second = stats.bytes_written / seconds;
+        stats.writes_per_second = stats.writes / seconds;
+    }
+    return stats;
+}
+
 // MP4Writer implementation with FFmpeg libavformat
 struct MP4Writer::Impl {
     AVFormatContext* format_context = nullptr;
@@ -91,9 +405,11 @@ struct MP4Writer::Impl {
     AVStream* audio_stream = nullptr;
     
     std::string filename;
+    MP4Options options;
     bool initialized = false;
     bool finalized = false;
     bool header_written = false;
+    int64_t handed_over = 0;  // Muxer output up to here has gone to the I/O thread
     
     // Video parameters
     int video_width = 0;
@@ -109,6 +425,7 @@ struct MP4Writer::Impl {
     // Timing
     uint64_t video_frame_count = 0;
     uint64_t audio_sample_count = 0;
+    uint64_t keyframe_count = 0;
     int64_t last_video_pts = 0;
     int64_t last_audio_pts = 0;
     
@@ -121,18 +438,61 @@ struct MP4Writer::Impl {
             if (header_written && !finalized) {
                 av_write_trailer(format_context);
             }
-            if (!(format_context->oformat->flags & AVFMT_NOFILE)) {
-                avio_closep(&format_context->pb);
-            }
+            close_io();
             avformat_free_context(format_context);
             format_context = nullptr;
         }
         initialized = false;
         header_written = false;
         finalized = false;
+        handed_over = 0;
+    }
+    
+    // Flush the AVIO buffer into the FileWriter and release the context.
+    // False if a write from AVIO was refused.
+    bool close_io() {
+        bool ok = true;
+        if (format_context && format_context->pb) {
+            avio_flush(format_context->pb);
+            ok = format_context->pb->error >= 0;
+            av_freep(&format_context->pb->buffer);
+            avio_context_free(&format_context->pb);
+        }
+        return ok;
     }
 };
 
+namespace {
+
+// The AVIO write callback lost its non-const buffer in FFmpeg 6.1
+#if defined(FF_API_AVIO_WRITE_NONCONST) && !FF_API_AVIO_WRITE_NONCONST
+using AvioWriteBuffer = const uint8_t*;
+#else
+using AvioWriteBuffer = uint8_t*;
+#endif
+
+int avio_write_to_file(void* opaque, AvioWriteBuffer buffer, int size) {
+    auto* file = static_cast<FileWriter*>(opaque);
+    return file->write(buffer, static_cast<size_t>(size)) ? size : AVERROR(EIO);
+}
+
+int64_t avio_seek_file(void* opaque, int64_t offset, int whence) {
+    auto* file = static_cast<FileWriter*>(opaque);
+    switch (whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE: return static_cast<int64_t>(file->get_file_size());
+        case SEEK_SET: break;
+        case SEEK_CUR: offset += static_cast<int64_t>(file->tell()); break;
+        case SEEK_END: offset += static_cast<int64_t>(file->get_file_size()); break;
+        default: return AVERROR(EINVAL);
+    }
+    if (offset < 0 || !file->seek(static_cast<uint64_t>(offset))) {
+        return AVERROR(EIO);
+    }
+    return offset;
+}
+
+} // namespace
+
 MP4Writer::MP4Writer() : m_impl(std::make_unique<Impl>()) {}
 MP4Writer::~MP4Writer() {
     if (m_impl && m_impl->initialized && !m_impl->finalized) {
@@ -141,8 +501,9 @@ MP4Writer::~MP4Writer() {
 }
 
 bool MP4Writer::initialize(const std::string& filename,
-                          int video_width, int video_height, int fps,
-                          int audio_sample_rate, int audio_channels) {
+                          const VideoStreamInfo& video, int fps,
+                          int audio_sample_rate, int audio_channels,
+                          const MP4Options& options) {
     if (m_impl->initialized) {
         std::cerr << "MP4Writer already initialized\n";
         return false;
@@ -150,8 +511,9 @@ bool MP4Writer::initialize(const std::string& filename,
     
     // Store parameters
     m_impl->filename = filename;
-    m_impl->video_width = video_width;
-    m_impl->video_height = video_height;
+    m_impl->options = options;
+    m_impl->video_width = video.width;
+    m_impl->video_height = video.height;
     m_impl->fps = fps;
     m_impl->audio_sample_rate = audio_sample_rate;
     m_impl->audio_channels = audio_channels;
@@ -163,8 +525,9 @@ bool MP4Writer::initialize(const std::string& filename,
         return false;
     }
     
-    // Set time bases
-    m_impl->video_time_base = {1, fps};
+    // Set time bases. Video is variable frame rate on the capture clock, so
+    // its track uses the 90 kHz MPEG timescale rather than 1/fps.
+    m_impl->video_time_base = {1, 90000};
     m_impl->audio_time_base = {1, audio_sample_rate};
     
     // Add video stream
@@ -177,15 +540,38 @@ bool MP4Writer::initialize(const std::string& filename,
     
     m_impl->video_stream->id = 0;
     m_impl->video_stream->time_base = m_impl->video_time_base;
+    m_impl->video_stream->avg_frame_rate = {fps, 1};  // Nominal only
     
     // Configure video stream parameters
     AVCodecParameters* video_params = m_impl->video_stream->codecpar;
     video_params->codec_type = AVMEDIA_TYPE_VIDEO;
-    video_params->codec_id = AV_CODEC_ID_H264;
-    video_params->width = video_width;
-    video_params->height = video_height;
+    video_params->codec_id = video_codec_id(video.codec);
+    video_params->width = video.width;
+    video_params->height = video.height;
     video_params->format = AV_PIX_FMT_YUV420P;
-    video_params->bit_rate = video_width * video_height * fps / 4; // Rough estimate
+    video_params->bit_rate = video.bit_rate > 0 ? video.bit_rate : video.width * video.height * fps / 4;
+    
+    // Parameter sets / sequence header for the sample description (avcC,
+    // hvcC, av1C, vpcC)
+    if (!video.extradata.empty()) {
+        size_t size = video.extradata.size();
+        video_params->extradata = static_cast<uint8_t*>(av_mallocz(size + AV_INPUT_BUFFER_PADDING_SIZE));
+        if (!video_params->extradata) {
+            std::cerr << "Failed to allocate video extradata\n";
+            m_impl->cleanup();
+            return false;
+        }
+        std::memcpy(video_params->extradata, video.extradata.data(), size);
+        video_params->extradata_size = static_cast<int>(size);
+    }
+    
+    // avc3/hev1 tell players to take parameter sets from the samples, as
+    // the ones in the sample description cover only the first encoder
+    if (video.parameter_sets_in_band && video.codec == VideoCodec::H264) {
+        video_params->codec_tag = MKTAG('a', 'v', 'c', '3');
+    } else if (video.parameter_sets_in_band && video.codec == VideoCodec::HEVC) {
+        video_params->codec_tag = MKTAG('h', 'e', 'v', '1');
+    }
     
     // Add audio stream
     m_impl->audio_stream = avformat_new_stream(m_impl->format_context, nullptr);
@@ -210,36 +596,60 @@ bool MP4Writer::initialize(const std::string& filename,
     audio_params->frame_size = 1024; // AAC frame size
     audio_params->block_align = 0; // Let FFmpeg calculate
     
-    // Open output file
-    if (!(m_impl->format_context->oformat->flags & AVFMT_NOFILE)) {
-        ret = avio_open(&m_impl->format_context->pb, filename.c_str(), AVIO_FLAG_WRITE);
-        if (ret < 0) {
-            std::cerr << "Failed to open output file: " << av_error_to_string(ret) << "\n";
-            m_impl->cleanup();
-            return false;
-        }
+    // Mux into our own write-behind file rather than avio_open's small
+    // synchronous buffer; the muxer only ever blocks at the memory cap
+    if (!FileWriter::open(filename, options.file)) {
+        m_impl->cleanup();
+        return false;
+    }
+    size_t buffer_size = std::max<size_t>(options.io_buffer_bytes, 4096);
+    auto* buffer = static_cast<unsigned char*>(av_malloc(buffer_size));
+    if (buffer) {
+        // The callbacks cast the opaque pointer back to FileWriter
+        m_impl->format_context->pb = avio_alloc_context(buffer, static_cast<int>(buffer_size), 1,
+                                                        static_cast<FileWriter*>(this), nullptr,
+                                                        avio_write_to_file, avio_seek_file);
+    }
+    if (!m_impl->format_context->pb) {
+        std::cerr << "Failed to allocate output I/O context\n";
+        av_free(buffer);
+        m_impl->cleanup();
+        FileWriter::close();
+        return false;
     }
     
     m_impl->initialized = true;
     
     std::cout << "MP4 writer initialized:\n";
     std::cout << "  File: " << filename << "\n";
-    std::cout << "  Video: " << video_width << "x" << video_height << " @ " << fps << " FPS\n";
+    std::cout << "  Video: " << avcodec_get_name(video_params->codec_id) << " " << video.width << "x" << video.height << " @ " << fps << " FPS\n";
     std::cout << "  Audio: " << audio_sample_rate << "Hz, " << audio_channels << " channels\n";
     std::cout << "  Video time base: " << m_impl->video_time_base.num << "/" << m_impl->video_time_base.den << "\n";
     std::cout << "  Audio time base: " << m_impl->audio_time_base.num << "/" << m_impl->audio_time_base.den << "\n";
+    if (options.fragment_seconds > 0) {
+        std::cout << "  Layout: fragmented, " << options.fragment_seconds << " s fragments\n";
+    }
     
     return true;
 }
 
-bool MP4Writer::write_video_packet(const std::vector<uint8_t>& packet, uint64_t timestamp_ms) {
-    if (!m_impl->initialized || m_impl->finalized || packet.empty()) {
+bool MP4Writer::write_packet(EncodedPacket& packet) {
+    if (!m_impl->initialized || m_impl->finalized || packet.size() == 0) {
         return false;
     }
     
     // Write header on first packet
     if (!m_impl->header_written) {
-        int ret = avformat_write_header(m_impl->format_context, nullptr);
+        // Fragmented: moov holds only the track setup, and a fragment is
+        // cut at the first video keyframe once min_frag_duration has passed
+        AVDictionary* muxer_options = nullptr;
+        if (m_impl->options.fragment_seconds > 0) {
+            av_dict_set(&muxer_options, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+            av_dict_set_int(&muxer_options, "min_frag_duration",
+                            static_cast<int64_t>(m_impl->options.fragment_seconds * 1000000), 0);
+        }
+        int ret = avformat_write_header(m_impl->format_context, &muxer_options);
+        av_dict_free(&muxer_options);
         if (ret < 0) {
             std::cerr << "Failed to write header: " << av_error_to_string(ret) << "\n";
             return false;
@@ -248,123 +658,72 @@ bool MP4Writer::write_video_packet(const std::vector<uint8_t>& packet, uint64_t
         std::cout << "MP4 header written successfully\n";
     }
     
-    // Create packet
-    AVPacket* pkt = av_packet_alloc();
-    if (!pkt) {
-        std::cerr << "Failed to allocate packet\n";
-        return false;
-    }
+    bool is_video = packet.stream == StreamType::VIDEO;
+    AVStream* stream = is_video ? m_impl->video_stream : m_impl->audio_stream;
+    AVPacket* pkt = packet.get();
     
-    // Copy packet data safely
-    pkt->data = static_cast<uint8_t*>(av_malloc(packet.size()));
-    if (!pkt->data) {
-        std::cerr << "Failed to allocate packet data\n";
-        av_packet_free(&pkt);
-        return false;
+    // Fill in a duration if the encoder left it out: one frame of video, or
+    // one AAC frame (1024 samples) of audio, in the encoder's time base
+    if (pkt->duration <= 0 && pkt->time_base.num > 0) {
+        AVRational frame_duration = is_video ? AVRational{1, m_impl->fps}
+                                             : AVRational{1024, m_impl->audio_sample_rate};
+        pkt->duration = av_rescale_q(1, frame_duration, pkt->time_base);
     }
-    memcpy(pkt->data, packet.data(), packet.size());
-    pkt->size = packet.size();
-    
-    // Set packet properties
-    pkt->stream_index = m_impl->video_stream->index;
-    
-    // Convert timestamp from milliseconds to stream time base
-    int64_t pts = av_rescale_q(timestamp_ms, {1, 1000}, m_impl->video_stream->time_base);
-    pkt->pts = pts;
-    pkt->dts = pts;
     
-    // Set duration (time between frames)
-    pkt->duration = av_rescale_q(1, {1, m_impl->fps}, m_impl->video_stream->time_base);
-    
-    // Key frame detection (simplified - assume first frame and every 30th frame is keyframe)
-    if (m_impl->video_frame_count == 0 || m_impl->video_frame_count % 30 == 0) {
-        pkt->flags |= AV_PKT_FLAG_KEY;
+    // Keep the encoder's pts/dts and flags, only moving them to the stream time base
+    if (pkt->time_base.num > 0) {
+        av_packet_rescale_ts(pkt, pkt->time_base, stream->time_base);
     }
+    pkt->time_base = stream->time_base;
+    pkt->stream_index = stream->index;
+    int64_t pts = pkt->pts;
+    bool keyframe = packet.is_keyframe();
     
-    // Write packet
+    // The muxer takes over the payload reference and leaves pkt blank
+    trace::Span span("interleave");
     int ret = av_interleaved_write_frame(m_impl->format_context, pkt);
     if (ret < 0) {
-        std::cerr << "Failed to write video packet: " << av_error_to_string(ret) << "\n";
-        av_packet_free(&pkt);
+        std::cerr << "Failed to write " << (is_video ? "video" : "audio") << " packet: "
+                  << av_error_to_string(ret) << "\n";
         return false;
     }
     
-    m_impl->video_frame_count++;
-    m_impl->last_video_pts = pts;
-    
-    // Log progress every 100 frames
-    if (m_impl->video_frame_count % 100 == 0) {
-        std::cout << "Wrote video frame " << m_impl->video_frame_count 
-                  << " (PTS: " << pts << ", timestamp: " << timestamp_ms << "ms)\n";
-    }
-    
-    av_packet_free(&pkt);
-    return true;
-}
-
-bool MP4Writer::write_audio_packet(const std::vector<uint8_t>& packet, uint64_t timestamp_ms) {
-    if (!m_impl->initialized || m_impl->finalized || packet.empty()) {
-        return false;
-    }
-    
-    // Write header on first packet if not already written
-    if (!m_impl->header_written) {
-        int ret = avformat_write_header(m_impl->format_context, nullptr);
-        if (ret < 0) {
-            std::cerr << "Failed to write header: " << av_error_to_string(ret) << "\n";
-            return false;
+    // Fragmented, the muxer keeps samples to itself until it writes out a
+    // whole fragment, so output moving on means one is finished (possibly
+    // on an audio packet, as the keyframe that cut it may still have been
+    // waiting to interleave). Push it through the AVIO buffer and the
+    // write-behind chunk to the I/O thread, so it reaches the OS even if
+    // this process dies.
+    if (m_impl->options.fragment_seconds > 0) {
+        int64_t position = avio_tell(m_impl->format_context->pb);
+        if (position > m_impl->handed_over) {
+            avio_flush(m_impl->format_context->pb);
+            submit();
+            m_impl->handed_over = position;
         }
-        m_impl->header_written = true;
-        std::cout << "MP4 header written successfully\n";
     }
     
-    // Create packet
-    AVPacket* pkt = av_packet_alloc();
-    if (!pkt) {
-        std::cerr << "Failed to allocate audio packet\n";
-        return false;
-    }
-    
-    // Copy packet data safely
-    pkt->data = static_cast<uint8_t*>(av_malloc(packet.size()));
-    if (!pkt->data) {
-        std::cerr << "Failed to allocate audio packet data\n";
-        av_packet_free(&pkt);
-        return false;
-    }
-    memcpy(pkt->data, packet.data(), packet.size());
-    pkt->size = packet.size();
-    
-    // Set packet properties
-    pkt->stream_index = m_impl->audio_stream->index;
-    
-    // Convert timestamp from milliseconds to stream time base
-    int64_t pts = av_rescale_q(timestamp_ms, {1, 1000}, m_impl->audio_stream->time_base);
-    pkt->pts = pts;
-    pkt->dts = pts;
-    
-    // Set duration (AAC frame is typically 1024 samples)
-    int samples_per_frame = 1024;
-    pkt->duration = av_rescale_q(samples_per_frame, {1, m_impl->audio_sample_rate}, m_impl->audio_stream->time_base);
-    
-    // Write packet
-    int ret = av_interleaved_write_frame(m_impl->format_context, pkt);
-    if (ret < 0) {
-        std::cerr << "Failed to write audio packet: " << av_error_to_string(ret) << "\n";
-        av_packet_free(&pkt);
-        return false;
-    }
-    
-    m_impl->audio_sample_count++;
-    m_impl->last_audio_pts = pts;
-    
-    // Log progress every 100 audio frames
-    if (m_impl->audio_sample_count % 100 == 0) {
-        std::cout << "Wrote audio frame " << m_impl->audio_sample_count 
-                  << " (PTS: " << pts << ", timestamp: " << timestamp_ms << "ms)\n";
+    if (is_video) {
+        m_impl->video_frame_count++;
+        m_impl->last_video_pts = pts;
+        if (keyframe) {
+            m_impl->keyframe_count++;
+        }
+        
+        // Log progress every 100 frames
+        if (m_impl->video_frame_count % 100 == 0) {
+            std::cout << "Wrote video frame " << m_impl->video_frame_count << " (PTS: " << pts << ")\n";
+        }
+    } else {
+        m_impl->audio_sample_count++;
+        m_impl->last_audio_pts = pts;
+        
+        // Log progress every 100 audio frames
+        if (m_impl->audio_sample_count % 100 == 0) {
+            std::cout << "Wrote audio frame " << m_impl->audio_sample_count << " (PTS: " << pts << ")\n";
+        }
     }
     
-    av_packet_free(&pkt);
     return true;
 }
 
@@ -373,6 +732,8 @@ bool MP4Writer::finalize() {
         return false;
     }
     
+    trace::Span span("finalize mp4");
+    
     // Write trailer to finalize the MP4 file
     if (m_impl->header_written) {
         int ret = av_write_trailer(m_impl->format_context);
@@ -383,17 +744,29 @@ bool MP4Writer::finalize() {
     }
     
     // Calculate durations
-    double video_duration = m_impl->video_frame_count / static_cast<double>(m_impl->fps);
+    double video_duration = m_impl->last_video_pts * av_q2d(m_impl->video_time_base);
     double audio_duration = (m_impl->audio_sample_count * 1024) / static_cast<double>(m_impl->audio_sample_rate);
     
     m_impl->finalized = true;
     
+    // Everything the muxer wrote is on its way to disk once this returns
+    bool written = m_impl->close_io();
+    FileWriter::Stats io = get_stats();
+    written = FileWriter::close() && written;
+    if (!written) {
+        std::cerr << "Failed to write " << m_impl->filename << "; the file is incomplete\n";
+        return false;
+    }
+    
     std::cout << "MP4 writer finalized successfully:\n";
     std::cout << "  File: " << m_impl->filename << "\n";
-    std::cout << "  Video frames: " << m_impl->video_frame_count << " (" << video_duration << "s)\n";
+    std::cout << "  Video frames: " << m_impl->video_frame_count << " (" << video_duration << "s, "
+              << m_impl->keyframe_count << " keyframes)\n";
     std::cout << "  Audio frames: " << m_impl->audio_sample_count << " (" << audio_duration << "s)\n";
     std::cout << "  Final video PTS: " << m_impl->last_video_pts << "\n";
     std::cout << "  Final audio PTS: " << m_impl->last_audio_pts << "\n";
+    std::cout << "  I/O: " << get_file_size() << " bytes in " << io.writes << " writes, p99 "
+              << io.io.p99_service_ms << " ms, " << io.io.blocked_ms << " ms blocked on the write-behind cap\n";
     
     return true;
 }
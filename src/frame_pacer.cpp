@@ -0,0 +1,95 @@
+#include "frame_pacer.h"
+#include <algorithm>
+#include <thread>
+
+#ifdef __linux__
+#include <cerrno>
+#include <time.h>
+#endif
+
+namespace playrec {
+
+void FramePacer::set_rate(double rate_hz) {
+    if (rate_hz > 0) {
+        set_period(std::chrono::nanoseconds(static_cast<int64_t>(1e9 / rate_hz)));
+    }
+}
+
+void FramePacer::set_period(std::chrono::nanoseconds period) {
+    m_period = std::max(period, std::chrono::nanoseconds(1));
+}
+
+void FramePacer::start() {
+    m_origin = Clock::now();
+    m_next_tick = 0;
+    m_ticks = 0;
+    m_missed = 0;
+    m_max_late_us = 0;
+    m_drift_us = 0;
+    m_lateness.reset();
+}
+
+uint64_t FramePacer::wait() {
+    uint64_t tick = m_next_tick;
+    auto now = Clock::now();
+    if (now >= deadline(tick + 1)) {
+        // Overran at least one whole tick: resume from the latest one due
+        auto behind = static_cast<uint64_t>((now - m_origin) / m_period);
+        m_missed += behind - tick;
+        tick = behind;
+    }
+    m_next_tick = tick + 1;
+    wait_for(tick);
+    return tick;
+}
+
+void FramePacer::wait_for(uint64_t tick) {
+    auto due = deadline(tick);
+    auto now = Clock::now();
+    if (now < due) {
+        sleep_until(due);
+        now = Clock::now();
+    }
+    record_wakeup(due, now);
+}
+
+void FramePacer::sleep_until(Clock::time_point deadline) {
+#ifdef __linux__
+    // steady_clock is CLOCK_MONOTONIC here; an absolute deadline cannot
+    // be stretched by a signal interrupting the sleep part way
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+    struct timespec when {};
+    when.tv_sec = static_cast<time_t>(ns / 1000000000);
+    when.tv_nsec = static_cast<long>(ns % 1000000000);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &when, nullptr) == EINTR) {
+    }
+#else
+    std::this_thread::sleep_until(deadline);
+#endif
+}
+
+void FramePacer::record_wakeup(Clock::time_point deadline, Clock::time_point woke) {
+    auto late_us = std::chrono::duration_cast<std::chrono::microseconds>(woke - deadline).count();
+    auto late = static_cast<uint64_t>(std::max<int64_t>(0, late_us));
+    m_ticks++;
+    m_drift_us = late_us;
+    m_lateness.record_us(late);
+
+    uint64_t previous_max = m_max_late_us;
+    while (late > previous_max && !m_max_late_us.compare_exchange_weak(previous_max, late)) {
+    }
+}
+
+FramePacer::Stats FramePacer::get_stats() const {
+    Stats stats;
+    stats.ticks = m_ticks;
+    stats.missed = m_missed;
+    stats.late_p50_ms = m_lateness.percentile_ms(0.50);
+    stats.late_p99_ms = m_lateness.percentile_ms(0.99);
+    stats.max_late_ms = m_max_late_us / 1000.0;
+    stats.jitter_ms = stats.late_p99_ms - stats.late_p50_ms;
+    stats.drift_ms = m_drift_us / 1000.0;
+    return stats;
+}
+
+} // namespace playrec
@@ -0,0 +1,159 @@
+#include "frame_pool.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace playrec {
+
+namespace {
+
+constexpr size_t kBufferAlignment = 64;
+
+size_t align_size(size_t size) {
+    return (size + kBufferAlignment - 1) & ~(kBufferAlignment - 1);
+}
+
+FrameBuffer::Storage* allocate_storage(size_t size) {
+    size_t capacity = align_size(std::max<size_t>(size, 1));
+    auto* storage = new FrameBuffer::Storage;
+    storage->data = static_cast<uint8_t*>(
+        ::operator new(capacity, std::align_val_t(kBufferAlignment)));
+    storage->capacity = capacity;
+    return storage;
+}
+
+void free_storage(FrameBuffer::Storage* storage) {
+    ::operator delete(storage->data, std::align_val_t(kBufferAlignment));
+    delete storage;
+}
+
+} // namespace
+
+// FrameBuffer implementation
+FrameBuffer::FrameBuffer(size_t size)
+    : m_storage(allocate_storage(size), free_storage), m_size(size) {}
+
+void FrameBuffer::resize(size_t size) {
+    if (m_storage && size <= m_storage->capacity && m_storage.use_count() == 1) {
+        m_size = size;
+        return;
+    }
+
+    FrameBuffer grown(size);
+    if (m_storage && m_size > 0) {
+        std::memcpy(grown.data(), data(), std::min(m_size, size));
+    }
+    *this = std::move(grown);
+}
+
+// FramePool implementation
+struct FramePool::Impl {
+    mutable std::mutex mutex;
+    std::vector<FrameBuffer::Storage*> free_list;
+    size_t max_buffers = 8;
+    Stats stats;
+
+    ~Impl() {
+        for (auto* storage : free_list) {
+            free_storage(storage);
+        }
+    }
+
+    void release(FrameBuffer::Storage* storage) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.buffers_in_use--;
+        if (free_list.size() < max_buffers) {
+            free_list.push_back(storage);
+            return;
+        }
+        stats.buffers_allocated--;
+        stats.bytes_allocated -= storage->capacity;
+        free_storage(storage);
+    }
+
+    void track_allocation(const FrameBuffer::Storage* storage) {
+        stats.buffers_allocated++;
+        stats.bytes_allocated += storage->capacity;
+        stats.high_water_bytes = std::max(stats.high_water_bytes, stats.bytes_allocated);
+    }
+};
+
+FramePool::FramePool() : m_impl(std::make_shared<Impl>()) {}
+
+FramePool::~FramePool() = default;
+
+void FramePool::reserve(const CaptureSettings& settings, size_t buffer_size) {
+    // Capture, encode and preview each hold one frame outside the queue
+    size_t max_buffers = static_cast<size_t>(std::max(1, settings.frame_queue_depth)) + 3;
+    reserve(buffer_size, max_buffers);
+}
+
+void FramePool::reserve(size_t buffer_size, size_t max_buffers) {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    m_impl->max_buffers = max_buffers;
+
+    // Drop blocks that are too small for the new frame size
+    auto& free_list = m_impl->free_list;
+    for (auto it = free_list.begin(); it != free_list.end();) {
+        if ((*it)->capacity < buffer_size) {
+            m_impl->stats.buffers_allocated--;
+            m_impl->stats.bytes_allocated -= (*it)->capacity;
+            free_storage(*it);
+            it = free_list.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    free_list.reserve(max_buffers);
+    while (free_list.size() + m_impl->stats.buffers_in_use < max_buffers) {
+        auto* storage = allocate_storage(buffer_size);
+        m_impl->track_allocation(storage);
+        free_list.push_back(storage);
+    }
+}
+
+FrameBuffer FramePool::acquire(size_t size) {
+    FrameBuffer::Storage* storage = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        auto& free_list = m_impl->free_list;
+        auto it = std::find_if(free_list.begin(), free_list.end(),
+                               [size](const FrameBuffer::Storage* s) { return s->capacity >= size; });
+        if (it != free_list.end()) {
+            storage = *it;
+            *it = free_list.back();
+            free_list.pop_back();
+            m_impl->stats.hits++;
+        } else {
+            m_impl->stats.misses++;
+        }
+        m_impl->stats.buffers_in_use++;
+    }
+
+    if (!storage) {
+        storage = allocate_storage(size);
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        m_impl->track_allocation(storage);
+    }
+
+    // The deleter keeps only a weak reference, so buffers may outlive the pool
+    std::weak_ptr<Impl> pool = m_impl;
+    std::shared_ptr<FrameBuffer::Storage> handle(storage, [pool](FrameBuffer::Storage* s) {
+        if (auto impl = pool.lock()) {
+            impl->release(s);
+        } else {
+            free_storage(s);
+        }
+    });
+    return FrameBuffer(std::move(handle), size);
+}
+
+FramePool::Stats FramePool::get_stats() const {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    return m_impl->stats;
+}
+
+} // namespace playrec
@@ -1,15 +1,20 @@
 #include "../../include/gui/capture_thread.h"
 #include "../../include/capture_engine.h"
 #include "../../include/common.h"
+#include "../../include/frame_pacer.h"
 #include <QDebug>
 #include <QDateTime>
 #include <QFileInfo>
 #include <QDir>
+#include <algorithm>
 
 CaptureThread::CaptureThread(QObject *parent) 
     : QThread(parent), m_engine(nullptr), m_settings(nullptr), 
       m_capturing(false), m_paused(false), m_shouldStop(false),
-      m_frameCount(0), m_droppedFrames(0), m_startTime(0) {}
+      m_frameCount(0), m_droppedFrames(0), m_startTime(0) {
+    // Stats cross to the GUI thread through queued connections
+    qRegisterMetaType<playrec::CaptureEngine::Stats>();
+}
 
 CaptureThread::~CaptureThread() {
     stopCapture();
@@ -65,6 +70,15 @@ void CaptureThread::resumeCapture() {
     m_condition.wakeAll();
 }
 
+void CaptureThread::saveReplay(const QString &path) {
+    QMutexLocker locker(&m_mutex);
+    if (!m_capturing) {
+        return;
+    }
+    m_replayPath = path;
+    m_condition.wakeAll();
+}
+
 bool CaptureThread::isCapturing() const {
     QMutexLocker locker(&m_mutex);
     return m_capturing;
@@ -107,16 +121,34 @@ void CaptureThread::run() {
             return;
         }
         
-        // Capture loop
+        // Capture loop, woken once per frame
         auto startTime = std::chrono::steady_clock::now();
+        playrec::FramePacer pacer(std::max(1, m_settings->frameRate));
+        pacer.start();
         
         while (!m_shouldStop) {
+            pacer.wait();
+            
+            QString replayPath;
             {
                 QMutexLocker locker(&m_mutex);
-                while (m_paused && !m_shouldStop) {
+                while (m_paused && !m_shouldStop && m_replayPath.isEmpty()) {
                     m_condition.wait(&m_mutex);
                 }
                 if (m_shouldStop) break;
+                replayPath.swap(m_replayPath);
+            }
+            
+            // The engine is only touched from this thread; the save itself
+            // runs on the engine's own background thread
+            if (!replayPath.isEmpty()) {
+                bool started = m_engine->save_replay(replayPath.toStdString(), 0.0,
+                    [this](bool ok, const std::string& path) {
+                        emit replaySaved(QString::fromStdString(path), ok);
+                    });
+                if (!started) {
+                    emit replaySaved(replayPath, false);
+                }
             }
             
             // Process events and update statistics
@@ -129,49 +161,25 @@ void CaptureThread::run() {
                 
                 // Capture a frame for preview (every few frames to avoid overwhelming the UI)
                 if (m_frameCount % 2 == 0) { // Preview every other frame
-                    try {
-                        // Create a dummy frame for now - this should be replaced with actual screen capture
-                        playrec::Frame previewFrame;
-                        previewFrame.width = 1920;
-                        previewFrame.height = 1080;
-                        previewFrame.format = playrec::VideoFormat::RGB24;
-                        
-                        // For now, create a test pattern
-                        int frameSize = previewFrame.width * previewFrame.height * 3;
-                        previewFrame.data.resize(frameSize);
-                        
-                        // Create a simple gradient pattern
-                        for (int y = 0; y < previewFrame.height; ++y) {
-                            for (int x = 0; x < previewFrame.width; ++x) {
-                                int offset = (y * previewFrame.width + x) * 3;
-                                previewFrame.data[offset] = (x * 255) / previewFrame.width; // R
-                                previewFrame.data[offset + 1] = (y * 255) / previewFrame.height; // G
-                                previewFrame.data[offset + 2] = 128; // B
-                            }
-                        }
-                        
+                    // Show the engine's latest captured frame; it shares the
+                    // pooled capture buffer, so no pixels are copied here
+                    playrec::Frame previewFrame;
+                    if (m_engine->get_preview_frame(previewFrame)) {
                         processVideoFrame(previewFrame);
-                    } catch (const std::exception& e) {
-                        // Continue even if preview fails
                     }
                 }
                 
                 // Emit statistics every second
                 if (m_frameCount % m_settings->frameRate == 0) {
-                    auto stats = m_engine->get_stats();
-                    qint64 fileSize = stats.file_size_bytes;
-                    int fps = static_cast<int>(stats.average_fps);
-                    
-                    emit statsUpdated(fps, m_frameCount, static_cast<int>(stats.frames_dropped), fileSize);
+                    emit statsUpdated(m_engine->get_stats());
                 }
             }
-            
-            // Sleep to maintain frame rate
-            msleep(1000 / m_settings->frameRate);
         }
         
         // Stop capture
-        m_engine->stop_capture();
+        if (!m_engine->stop_capture()) {
+            emit captureError("Recording could not be completely written to disk");
+        }
         m_engine.reset();
         
         emit captureStopped();
@@ -201,30 +209,33 @@ QImage CaptureThread::convertFrameToQImage(const playrec::Frame &frame) {
     }
     
     QImage image;
+    auto stride = [&frame](int bytesPerPixel) {
+        return frame.stride > 0 ? frame.stride : frame.width * bytesPerPixel;
+    };
     
     switch (frame.format) {
         case playrec::VideoFormat::RGB24: {
             image = QImage(frame.data.data(), frame.width, frame.height, 
-                          frame.width * 3, QImage::Format_RGB888);
+                          stride(3), QImage::Format_RGB888);
             break;
         }
         case playrec::VideoFormat::RGBA32: {
             image = QImage(frame.data.data(), frame.width, frame.height, 
-                          frame.width * 4, QImage::Format_RGBA8888);
+                          stride(4), QImage::Format_RGBA8888);
             break;
         }
         case playrec::VideoFormat::BGR24: {
             image = QImage(frame.data.data(), frame.width, frame.height, 
-                          frame.width * 3, QImage::Format_RGB888);
+                          stride(3), QImage::Format_RGB888);
             // Convert BGR to RGB
             image = image.rgbSwapped();
             break;
         }
         case playrec::VideoFormat::BGRA32: {
+            // BGRA bytes are Format_RGB32 on little-endian hosts; the alpha
+            // byte is ignored since X11 leaves it undefined
             image = QImage(frame.data.data(), frame.width, frame.height, 
-                          frame.width * 4, QImage::Format_RGBA8888);
-            // Convert BGRA to RGBA
-            image = image.rgbSwapped();
+                          stride(4), QImage::Format_RGB32);
             break;
         }
         default: {
@@ -3,6 +3,7 @@
 #include "gui/settings_dialog.h"
 #include "gui/capture_thread.h"
 #include "common.h"
+#include "encoder.h"
 
 #include <QtWidgets/QMenuBar>
 #include <QtWidgets/QStatusBar>
@@ -13,6 +14,7 @@
 #include <QtCore/QDir>
 #include <QtCore/QDirIterator>
 #include <QtCore/QFileInfo>
+#include <QtCore/QStringList>
 #include <QtGui/QDesktopServices>
 #include <QtCore/QUrl>
 #include <algorithm>
@@ -28,6 +30,7 @@ MainWindow::MainWindow(QWidget *parent)
     , m_startButton(nullptr)
     , m_stopButton(nullptr)
     , m_pauseButton(nullptr)
+    , m_saveReplayButton(nullptr)
     , m_settingsButton(nullptr)
     , m_outputButton(nullptr)
     , m_outputLabel(nullptr)
@@ -37,6 +40,8 @@ MainWindow::MainWindow(QWidget *parent)
     , m_fpsSpinBox(nullptr)
     , m_qualityCombo(nullptr)
     , m_audioCheckBox(nullptr)
+    , m_replayBufferCheckBox(nullptr)
+    , m_replaySecondsSpinBox(nullptr)
     , m_statsGroup(nullptr)
     , m_statusLabel(nullptr)
     , m_fpsLabel(nullptr)
@@ -45,6 +50,7 @@ MainWindow::MainWindow(QWidget *parent)
     , m_sizeLabel(nullptr)
     , m_durationLabel(nullptr)
     , m_cpuProgressBar(nullptr)
+    , m_stagesLabel(nullptr)
     , m_logGroup(nullptr)
     , m_logTextEdit(nullptr)
     , m_statusBarLabel(nullptr)
@@ -172,10 +178,15 @@ void MainWindow::setupControlsPanel()
     m_stopButton->setStyleSheet("QPushButton { background-color: #dc3545; color: white; font-weight: bold; padding: 8px 16px; }");
     m_pauseButton = new QPushButton("Pause");
     m_pauseButton->setStyleSheet("QPushButton { background-color: #ffc107; color: black; font-weight: bold; padding: 8px 16px; }");
+    m_saveReplayButton = new QPushButton("Save Replay");
+    m_saveReplayButton->setStyleSheet("QPushButton { background-color: #17a2b8; color: white; font-weight: bold; padding: 8px 16px; }");
+    m_saveReplayButton->setShortcut(QKeySequence("Ctrl+Shift+S"));
+    m_saveReplayButton->setToolTip("Save the replay buffer to a file (Ctrl+Shift+S)");
     
     buttonLayout->addWidget(m_startButton);
     buttonLayout->addWidget(m_pauseButton);
     buttonLayout->addWidget(m_stopButton);
+    buttonLayout->addWidget(m_saveReplayButton);
     controlsLayout->addLayout(buttonLayout);
     
     // Output file selection
@@ -202,7 +213,9 @@ void MainWindow::setupControlsPanel()
     auto* quickLayout = new QFormLayout(m_quickSettingsGroup);
     
     m_codecCombo = new QComboBox;
-    m_codecCombo->addItems({"H.264 (x264)", "H.265 (x265)"});
+    for (const auto& backend : playrec::encoder_backends()) {
+        m_codecCombo->addItem(QString::fromStdString(backend.display_name), QString::fromStdString(backend.name));
+    }
     quickLayout->addRow("Codec:", m_codecCombo);
     
     m_fpsSpinBox = new QSpinBox;
@@ -220,12 +233,23 @@ void MainWindow::setupControlsPanel()
     m_audioCheckBox->setChecked(true);
     quickLayout->addRow(m_audioCheckBox);
     
+    // Keep recent gameplay in memory and only write it out on request
+    m_replayBufferCheckBox = new QCheckBox("Replay Buffer (don't record to file)");
+    quickLayout->addRow(m_replayBufferCheckBox);
+    
+    m_replaySecondsSpinBox = new QSpinBox;
+    m_replaySecondsSpinBox->setRange(10, 600);
+    m_replaySecondsSpinBox->setValue(60);
+    m_replaySecondsSpinBox->setSuffix(" s");
+    quickLayout->addRow("Replay Length:", m_replaySecondsSpinBox);
+    
     m_rightSplitter->addWidget(m_quickSettingsGroup);
     
     // Connect control signals
     connect(m_startButton, &QPushButton::clicked, this, &MainWindow::onStartRecording);
     connect(m_stopButton, &QPushButton::clicked, this, &MainWindow::onStopRecording);
     connect(m_pauseButton, &QPushButton::clicked, this, &MainWindow::onPauseRecording);
+    connect(m_saveReplayButton, &QPushButton::clicked, this, &MainWindow::onSaveReplay);
     connect(m_settingsButton, &QPushButton::clicked, this, &MainWindow::onSettings);
     connect(m_outputButton, &QPushButton::clicked, this, &MainWindow::onSelectOutputFile);
 }
@@ -247,6 +271,10 @@ void MainWindow::setupStatsPanel()
     m_cpuProgressBar->setValue(0);
     m_cpuProgressBar->setFormat("%p% CPU");
     
+    m_stagesLabel = new QLabel("-");
+    m_stagesLabel->setWordWrap(true);
+    m_stagesLabel->setToolTip("Slowest 1% of items in each pipeline stage, in milliseconds");
+    
     statsLayout->addRow("Status:", m_statusLabel);
     statsLayout->addRow("FPS:", m_fpsLabel);
     statsLayout->addRow("Frames:", m_framesLabel);
@@ -254,6 +282,7 @@ void MainWindow::setupStatsPanel()
     statsLayout->addRow("File Size:", m_sizeLabel);
     statsLayout->addRow("Duration:", m_durationLabel);
     statsLayout->addRow("CPU Usage:", m_cpuProgressBar);
+    statsLayout->addRow("Stage p99:", m_stagesLabel);
     
     m_rightSplitter->addWidget(m_statsGroup);
 }
@@ -347,6 +376,8 @@ void MainWindow::onStartRecording()
         connect(m_captureThread.get(), &CaptureThread::captureStopped, this, &MainWindow::onCaptureStopped);
         connect(m_captureThread.get(), &CaptureThread::captureError, this, &MainWindow::onCaptureError);
         connect(m_captureThread.get(), &CaptureThread::frameReady, this, &MainWindow::onFrameCaptured);
+        connect(m_captureThread.get(), &CaptureThread::replaySaved, this, &MainWindow::onReplaySaved);
+        connect(m_captureThread.get(), &CaptureThread::statsUpdated, this, &MainWindow::onStatsUpdated);
     }
     
     try {
@@ -368,6 +399,31 @@ void MainWindow::onStopRecording()
     }
 }
 
+void MainWindow::onSaveReplay()
+{
+    if (!m_isRecording || !m_captureThread || m_settings->replay_buffer_seconds <= 0) return;
+    
+    // Next to the configured output, named by time so saves never collide
+    QFileInfo output(m_outputFilePath);
+    QString fileName = QString("%1_replay_%2.mp4")
+        .arg(output.completeBaseName(), QDateTime::currentDateTime().toString("yyyyMMdd_hhmmss"));
+    QString path = output.dir().filePath(fileName);
+    
+    m_captureThread->saveReplay(path);
+    logMessage(QString("Saving replay: %1").arg(fileName));
+}
+
+void MainWindow::onReplaySaved(const QString& path, bool ok)
+{
+    if (ok) {
+        logMessage(QString("Replay saved: %1").arg(path));
+        m_statusBarLabel->setText(QString("Replay saved: %1").arg(QFileInfo(path).fileName()));
+        onRefreshRecordings();
+    } else {
+        logMessage(QString("Failed to save replay: %1").arg(path));
+    }
+}
+
 void MainWindow::onPauseRecording()
 {
     if (!m_isRecording) return;
@@ -427,6 +483,28 @@ void MainWindow::onUpdateStats()
     // Implementation depends on capture thread providing stats
 }
 
+void MainWindow::onStatsUpdated(const playrec::CaptureEngine::Stats& stats)
+{
+    qint64 bytes = m_settings->replay_buffer_seconds > 0 ? stats.replay_bytes : stats.file_size_bytes;
+    int seconds = static_cast<int>(stats.elapsed_seconds);
+    
+    m_fpsLabel->setText(QString("%1 FPS (%2 avg)").arg(stats.current_fps, 0, 'f', 1).arg(stats.average_fps, 0, 'f', 1));
+    m_framesLabel->setText(QString::number(stats.frames_captured));
+    m_droppedLabel->setText(QString::number(stats.frames_dropped));
+    m_sizeLabel->setText(QString("%1 MB").arg(bytes / 1024.0 / 1024.0, 0, 'f', 1));
+    m_durationLabel->setText(QString("%1:%2:%3")
+        .arg(seconds / 3600, 2, 10, QChar('0'))
+        .arg(seconds / 60 % 60, 2, 10, QChar('0'))
+        .arg(seconds % 60, 2, 10, QChar('0')));
+    m_cpuProgressBar->setValue(static_cast<int>(stats.cpu_usage + 0.5));
+    
+    QStringList stages;
+    for (const auto& stage : stats.stages) {
+        stages << QString("%1 %2").arg(QString::fromUtf8(stage.name)).arg(stage.p99_service_ms, 0, 'f', 1);
+    }
+    m_stagesLabel->setText(stages.isEmpty() ? "-" : stages.join(", "));
+}
+
 void MainWindow::onCaptureStarted()
 {
     m_isRecording = true;
@@ -472,6 +550,9 @@ void MainWindow::updateControls()
     m_stopButton->setEnabled(m_isRecording);
     m_pauseButton->setEnabled(m_isRecording);
     m_pauseButton->setText(m_isPaused ? "Resume" : "Pause");
+    m_saveReplayButton->setEnabled(m_isRecording && m_settings->replay_buffer_seconds > 0);
+    m_replayBufferCheckBox->setEnabled(!m_isRecording);
+    m_replaySecondsSpinBox->setEnabled(!m_isRecording);
     
     // Replay controls
     m_playButton->setEnabled(canPlayVideo && !m_recordingsComboBox->currentData().toString().isEmpty());
@@ -479,7 +560,8 @@ void MainWindow::updateControls()
     m_stopPlaybackButton->setEnabled(m_isPlayingVideo);
     
     // Update quick settings from current settings
-    m_codecCombo->setCurrentText(QString::fromStdString(m_settings->codec) == "h264" ? "H.264 (x264)" : "H.265 (x265)");
+    int codecIndex = m_codecCombo->findData(QString::fromStdString(m_settings->codec));
+    m_codecCombo->setCurrentIndex(codecIndex >= 0 ? codecIndex : 0);
     m_fpsSpinBox->setValue(m_settings->target_fps);
     
     QString quality;
@@ -496,7 +578,7 @@ void MainWindow::updateControls()
 void MainWindow::updateSettings()
 {
     // Update settings from quick controls
-    m_settings->codec = m_codecCombo->currentText().contains("H.264") ? "h264" : "h265";
+    m_settings->codec = m_codecCombo->currentData().toString().toStdString();
     m_settings->target_fps = m_fpsSpinBox->value();
     
     QString quality = m_qualityCombo->currentText();
@@ -506,6 +588,7 @@ void MainWindow::updateSettings()
     else if (quality == "Ultra") m_settings->quality = playrec::Quality::ULTRA;
     
     m_settings->capture_audio = m_audioCheckBox->isChecked();
+    m_settings->replay_buffer_seconds = m_replayBufferCheckBox->isChecked() ? m_replaySecondsSpinBox->value() : 0;
     m_settings->output_path = m_outputFilePath.toStdString();
 }
 
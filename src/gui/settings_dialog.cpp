@@ -159,12 +159,20 @@ void SettingsDialog::setupAdvancedTab() {
     m_bufferSizeSpinBox->setSuffix(" MB");
     advancedForm->addRow("Buffer Size:", m_bufferSizeSpinBox);
     
-    // Thread count
+    // Thread count (0 = chosen from the core count and resolution)
     m_threadCountSpinBox = new QSpinBox();
-    m_threadCountSpinBox->setRange(1, 16);
-    m_threadCountSpinBox->setValue(4);
+    m_threadCountSpinBox->setRange(0, 64);
+    m_threadCountSpinBox->setSpecialValueText("Auto");
+    m_threadCountSpinBox->setValue(0);
     advancedForm->addRow("Encoder Threads:", m_threadCountSpinBox);
     
+    // Encoder delay allowed before frame threading gives way to slices
+    m_encodeLatencySpinBox = new QSpinBox();
+    m_encodeLatencySpinBox->setRange(0, 1000);
+    m_encodeLatencySpinBox->setValue(250);
+    m_encodeLatencySpinBox->setSuffix(" ms");
+    advancedForm->addRow("Encode Latency Target:", m_encodeLatencySpinBox);
+    
     // Custom arguments
     m_customArgsLineEdit = new QLineEdit();
     m_customArgsLineEdit->setPlaceholderText("Additional FFmpeg arguments");
@@ -236,7 +244,8 @@ void SettingsDialog::loadDefaults() {
     // Advanced defaults
     m_cursorCheckBox->setChecked(true);
     m_bufferSizeSpinBox->setValue(10);
-    m_threadCountSpinBox->setValue(4);
+    m_threadCountSpinBox->setValue(0);
+    m_encodeLatencySpinBox->setValue(250);
     m_customArgsLineEdit->clear();
     
     updateCodecSettings();
@@ -250,6 +259,8 @@ playrec::CaptureSettings SettingsDialog::getSettings() const {
     settings.videoBitrate = m_bitrateSpinBox->value() * 1000; // Convert to bps
     settings.videoCodec = m_codecCombo->currentText().toStdString();
     settings.capture_cursor = m_cursorCheckBox->isChecked();
+    settings.encoder_threads = m_threadCountSpinBox->value();
+    settings.encode_latency_target_ms = m_encodeLatencySpinBox->value();
     
     // Audio settings
     settings.capture_audio = m_audioEnabledCheckBox->isChecked();
@@ -266,6 +277,8 @@ void SettingsDialog::setSettings(const playrec::CaptureSettings &settings) {
     m_bitrateSpinBox->setValue(settings.videoBitrate / 1000); // Convert to kbps
     m_codecCombo->setCurrentText(QString::fromStdString(settings.videoCodec));
     m_cursorCheckBox->setChecked(settings.capture_cursor);
+    m_threadCountSpinBox->setValue(settings.encoder_threads);
+    m_encodeLatencySpinBox->setValue(static_cast<int>(settings.encode_latency_target_ms));
     
     // Audio settings
     m_audioEnabledCheckBox->setChecked(settings.capture_audio);
@@ -1,6 +1,152 @@
 #include "capture_engine.h"
+#include "file_capture.h"
+#include <atomic>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <string>
+#include <thread>
+
+namespace {
+
+// Set by 's' on stdin or SIGUSR1 (e.g. from a desktop hotkey)
+std::atomic<bool> g_replay_requested{false};
+
+// Set by an empty line on stdin or Ctrl+C
+std::atomic<bool> g_stop_requested{false};
+
+// Reads stdin on its own thread, so the monitor loop never waits for a
+// line and still sees a signal or the next stats tick on time
+void read_commands() {
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        if (line.empty()) {
+            g_stop_requested = true;
+            return;
+        }
+        if (line[0] == 's' || line[0] == 'S') {
+            g_replay_requested = true;
+        }
+    }
+}
+
+// The first Ctrl+C stops cleanly so the file is finalized; a second one
+// ends the process at once
+void request_stop(int) {
+    g_stop_requested = true;
+    std::signal(SIGINT, SIG_DFL);
+}
+
+#ifndef _WIN32
+void request_replay(int) {
+    g_replay_requested = true;
+}
+#endif
+
+// capture.mp4 -> capture_replay3.mp4
+std::string replay_path(const std::string& output_path, int index) {
+    std::string base = output_path;
+    auto dot = base.rfind('.');
+    if (dot != std::string::npos && base.find('/', dot) == std::string::npos) {
+        base.erase(dot);
+    }
+    return base + "_replay" + std::to_string(index) + ".mp4";
+}
+
+std::string json_string(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            quoted += escaped;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+void write_stats_json(std::ostream& out, const playrec::CaptureEngine::Stats& stats, bool capturing) {
+    out << std::fixed << std::setprecision(3);
+    out << "{\n";
+    out << "  \"sequence\": " << stats.sequence << ",\n";
+    out << "  \"capturing\": " << (capturing ? "true" : "false") << ",\n";
+    out << "  \"elapsed_seconds\": " << stats.elapsed_seconds << ",\n";
+    out << "  \"frames\": " << stats.frames_captured << ",\n";
+    out << "  \"frames_dropped\": " << stats.frames_dropped << ",\n";
+    out << "  \"frames_skipped\": " << stats.frames_skipped << ",\n";
+    out << "  \"average_fps\": " << stats.average_fps << ",\n";
+    out << "  \"current_fps\": " << stats.current_fps << ",\n";
+    out << "  \"cpu_usage_percent\": " << stats.cpu_usage << ",\n";
+    out << "  \"cpu_seconds\": " << stats.cpu_seconds << ",\n";
+    out << "  \"queue_depth\": " << stats.queue_depth << ",\n";
+    out << "  \"full_frame_copies\": " << stats.full_frame_copies << ",\n";
+    out << "  \"capture_ticks_missed\": " << stats.capture_ticks_missed << ",\n";
+    out << "  \"capture_late_p99_ms\": " << stats.capture_late_p99_ms << ",\n";
+    out << "  \"capture_jitter_ms\": " << stats.capture_jitter_ms << ",\n";
+    out << "  \"audio_xruns\": " << stats.audio_xruns << ",\n";
+    out << "  \"convert_backend\": " << json_string(stats.convert_backend) << ",\n";
+    out << "  \"encoder_threading\": " << json_string(stats.encoder_threading) << ",\n";
+    out << "  \"encoder_speed_level\": " << stats.encoder_speed_level << ",\n";
+    out << "  \"encode_latency_p50_ms\": " << stats.encode_latency_p50_ms << ",\n";
+    out << "  \"encode_latency_p95_ms\": " << stats.encode_latency_p95_ms << ",\n";
+    out << "  \"file_bytes\": " << stats.file_size_bytes << ",\n";
+    out << "  \"segments\": " << stats.segments << ",\n";
+    out << "  \"segment_path\": " << json_string(stats.segment_path) << ",\n";
+    out << "  \"io_queued_bytes\": " << stats.io_queued_bytes << ",\n";
+    out << "  \"io_bytes_per_second\": " << stats.io_bytes_per_second << ",\n";
+    out << "  \"io_writes_per_second\": " << stats.io_writes_per_second << ",\n";
+    out << "  \"replay_bytes\": " << stats.replay_bytes << ",\n";
+    out << "  \"replays_saved\": " << stats.replays_saved << ",\n";
+    out << "  \"stages\": [";
+    for (size_t s = 0; s < stats.stages.size(); ++s) {
+        const playrec::StageStats& stage = stats.stages[s];
+        out << (s ? ",\n" : "\n") << "    {"
+            << "\"name\": " << json_string(stage.name) << ", "
+            << "\"items\": " << stage.items << ", "
+            << "\"avg_ms\": " << stage.average_service_ms << ", "
+            << "\"p50_ms\": " << stage.p50_service_ms << ", "
+            << "\"p95_ms\": " << stage.p95_service_ms << ", "
+            << "\"p99_ms\": " << stage.p99_service_ms << ", "
+            << "\"max_ms\": " << stage.max_service_ms << ", "
+            << "\"blocked_ms\": " << stage.blocked_ms << ", "
+            << "\"cpu_ms\": " << stage.cpu_ms << ", "
+            << "\"queue_depth\": " << stage.queue_depth << ", "
+            << "\"queue_capacity\": " << stage.queue_capacity << ", "
+            << "\"queue_high_water\": " << stage.queue_high_water << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+// Written whole and renamed into place, so a reader never sees half a file
+bool save_stats_json(const std::string& path, const playrec::CaptureEngine::Stats& stats, bool capturing) {
+    if (path == "-") {
+        write_stats_json(std::cout, stats, capturing);
+        return true;
+    }
+
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path);
+        write_stats_json(file, stats, capturing);
+        if (!file) {
+            return false;
+        }
+    }
+#ifdef _WIN32
+    std::remove(path.c_str());  // rename() does not replace on Windows
+#endif
+    return std::rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+} // namespace
 
 int main(int argc, char* argv[]) {
     std::cout << "PlayRec - Game Capture Application\n";
@@ -17,6 +163,14 @@ int main(int argc, char* argv[]) {
     settings.capture_cursor = true;
     settings.output_path = "gameplay_capture.mp4";
 
+    // File input instead of live capture
+    std::string input_path;
+    playrec::RawVideoFormat raw_format;
+    bool input_realtime = false;
+
+    // Machine-readable stats, refreshed every second ("-" = stdout, at the end only)
+    std::string stats_json_path;
+
     // Parse command line arguments (basic implementation)
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
@@ -26,8 +180,96 @@ int main(int argc, char* argv[]) {
             settings.output_path = argv[++i];
         } else if (arg == "--codec" && i + 1 < argc) {
             settings.codec = argv[++i];
+        } else if (arg == "--list-codecs") {
+            for (const auto& backend : playrec::encoder_backends()) {
+                playrec::EncoderCapabilities caps = playrec::probe_encoder_backend(backend);
+                std::cout << "  " << std::left << std::setw(10) << backend.name << std::setw(18) << backend.display_name
+                          << (caps.available ? backend.library : "(" + backend.library + " not built in)");
+                if (caps.available) {
+                    std::cout << ", " << playrec::encoder_threading_name(caps.threading) << " threads, formats:";
+                    for (const auto& format : caps.pixel_formats) {
+                        std::cout << " " << format;
+                    }
+                }
+                if (caps.hardware_variant) {
+                    std::cout << ", hardware encoder present";
+                }
+                std::cout << "\n";
+            }
+            return 0;
+        } else if (arg == "--queue-depth" && i + 1 < argc) {
+            settings.frame_queue_depth = std::stoi(argv[++i]);
+        } else if (arg == "--drop-policy" && i + 1 < argc) {
+            std::string policy_str = argv[++i];
+            if (policy_str == "oldest") settings.drop_policy = playrec::DropPolicy::DROP_OLDEST;
+            else if (policy_str == "newest") settings.drop_policy = playrec::DropPolicy::DROP_NEWEST;
+            else if (policy_str == "block") settings.drop_policy = playrec::DropPolicy::BLOCK;
+        } else if (arg == "--window" && i + 1 < argc) {
+            settings.capture_window = std::stoul(argv[++i], nullptr, 0);
+        } else if (arg == "--convert" && i + 1 < argc) {
+            std::string convert_str = argv[++i];
+            if (convert_str == "simd") settings.simd_color_convert = true;
+            else if (convert_str == "swscale") settings.simd_color_convert = false;
+        } else if (arg == "--encoder-threads" && i + 1 < argc) {
+            settings.encoder_threads = std::stoi(argv[++i]);
+        } else if (arg == "--encode-latency" && i + 1 < argc) {
+            settings.encode_latency_target_ms = std::stod(argv[++i]);
+        } else if (arg == "--replay-buffer" && i + 1 < argc) {
+            settings.replay_buffer_seconds = std::stod(argv[++i]);
+        } else if (arg == "--replay-mb" && i + 1 < argc) {
+            settings.replay_buffer_mb = std::stoi(argv[++i]);
+        } else if (arg == "--segment-minutes" && i + 1 < argc) {
+            settings.segment_minutes = std::stod(argv[++i]);
+        } else if (arg == "--segment-mb" && i + 1 < argc) {
+            settings.segment_mb = std::stoi(argv[++i]);
+        } else if (arg == "--segment-name" && i + 1 < argc) {
+            settings.filenameFormat = argv[++i];
+        } else if (arg == "--fragment" && i + 1 < argc) {
+            settings.fragment_seconds = std::stod(argv[++i]);
+        } else if (arg == "--io-buffer-kb" && i + 1 < argc) {
+            settings.io_buffer_kb = std::stoi(argv[++i]);
+        } else if (arg == "--write-behind-mb" && i + 1 < argc) {
+            settings.write_behind_mb = std::stoi(argv[++i]);
+        } else if (arg == "--direct-io") {
+            settings.direct_io = true;
+        } else if (arg == "--preallocate-mb" && i + 1 < argc) {
+            settings.preallocate_mb = std::stoi(argv[++i]);
+        } else if (arg == "--stats-json" && i + 1 < argc) {
+            stats_json_path = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            settings.trace_path = argv[++i];
+        } else if (arg == "--fixed-speed") {
+            settings.adaptive_encoder_speed = false;
+        } else if (arg == "--cfr") {
+            settings.variable_frame_rate = false;
+        } else if (arg == "--input" && i + 1 < argc) {
+            input_path = argv[++i];
+        } else if (arg == "--input-format" && i + 1 < argc) {
+            std::string format_str = argv[++i];
+            if (format_str == "bgra") raw_format.format = playrec::VideoFormat::BGRA32;
+            else if (format_str == "rgba") raw_format.format = playrec::VideoFormat::RGBA32;
+            else if (format_str == "nv12") raw_format.format = playrec::VideoFormat::NV12;
+            else if (format_str == "yuv420p") raw_format.format = playrec::VideoFormat::YUV420P;
+        } else if (arg == "--input-size" && i + 1 < argc) {
+            std::string size_str = argv[++i];
+            auto x = size_str.find('x');
+            if (x != std::string::npos) {
+                raw_format.width = std::stoi(size_str.substr(0, x));
+                raw_format.height = std::stoi(size_str.substr(x + 1));
+            }
+        } else if (arg == "--input-fps" && i + 1 < argc) {
+            std::string fps_str = argv[++i];
+            auto slash = fps_str.find('/');
+            raw_format.fps_num = std::stoi(fps_str.substr(0, slash));
+            raw_format.fps_den = slash != std::string::npos ? std::stoi(fps_str.substr(slash + 1)) : 1;
+        } else if (arg == "--realtime") {
+            input_realtime = true;
         } else if (arg == "--no-audio") {
             settings.capture_audio = false;
+        } else if (arg == "--audio-device" && i + 1 < argc) {
+            settings.audio_device = argv[++i];
+        } else if (arg == "--audio-period" && i + 1 < argc) {
+            settings.audio_period_frames = std::stoi(argv[++i]);
         } else if (arg == "--no-cursor") {
             settings.capture_cursor = false;
         } else if (arg == "--quality" && i + 1 < argc) {
@@ -41,9 +283,42 @@ int main(int argc, char* argv[]) {
             std::cout << "Options:\n";
             std::cout << "  --fps <number>      Target FPS (default: 60)\n";
             std::cout << "  --output <file>     Output file path (default: gameplay_capture.mp4)\n";
-            std::cout << "  --codec <codec>     Video codec: h264|h265 (default: h264)\n";
+            std::cout << "  --codec <codec>     Video encoder: h264|h265|av1|vp9|openh264 (default: h264)\n";
+            std::cout << "  --list-codecs       Show the video encoders and what this build supports\n";
             std::cout << "  --quality <level>   Quality: low|medium|high|ultra (default: high)\n";
+            std::cout << "  --queue-depth <n>   Frames buffered ahead of the encoder (default: 8)\n";
+            std::cout << "  --drop-policy <p>   Frame to drop when the queue is full: oldest|newest|block (default: oldest)\n";
+            std::cout << "  --window <id>       X11 window id to capture (default: whole screen)\n";
+            std::cout << "  --convert <path>    Color conversion: simd|swscale (default: simd)\n";
+            std::cout << "  --encoder-threads <n> Encoder threads, 0 = from core count (default: 0)\n";
+            std::cout << "  --encode-latency <ms> Encoder delay allowed before frame threading gives way to slices (default: 250)\n";
+            std::cout << "  --replay-buffer <s> Keep the last s seconds in memory instead of recording;\n";
+            std::cout << "                      type s + Enter (or send SIGUSR1) to save them\n";
+            std::cout << "  --replay-mb <n>     Memory the replay buffer may use (default: 512)\n";
+            std::cout << "  --segment-minutes <n> Start a new output file every n minutes, at a keyframe\n";
+            std::cout << "  --segment-mb <n>    Start a new output file every n MB of encoded data\n";
+            std::cout << "  --segment-name <f>  strftime pattern for later segments, next to the output\n";
+            std::cout << "                      (default: PlayRec_%Y%m%d_%H%M%S)\n";
+            std::cout << "  --fragment <s>      Fragmented MP4 with s-second fragments; a crash keeps\n";
+            std::cout << "                      every finished fragment (default: off)\n";
+            std::cout << "  --io-buffer-kb <n>  Muxer write buffer (default: 256)\n";
+            std::cout << "  --write-behind-mb <n> Output held for a slow disk before muxing waits (default: 64)\n";
+            std::cout << "  --direct-io         Write output with O_DIRECT, bypassing the page cache\n";
+            std::cout << "  --preallocate-mb <n> Reserve disk space for each output file\n";
+            std::cout << "  --stats-json <file> Keep a JSON snapshot of the stats in file, rewritten every\n";
+            std::cout << "                      second; - prints it to stdout once capture ends\n";
+            std::cout << "  --trace <file>      Record per-frame pipeline spans and write them as Chrome\n";
+            std::cout << "                      trace JSON on stop (open in Perfetto)\n";
+            std::cout << "  --fixed-speed       Keep the encoder preset even when it falls behind\n";
+            std::cout << "  --cfr               Encode unchanged frames too (constant frame rate)\n";
+            std::cout << "  --input <file>      Encode a .y4m or raw video file instead of capturing\n";
+            std::cout << "  --input-format <f>  Raw input pixels: bgra|rgba|nv12|yuv420p (default: bgra)\n";
+            std::cout << "  --input-size <WxH>  Raw input frame size\n";
+            std::cout << "  --input-fps <n[/d]> Raw input frame rate (default: 30)\n";
+            std::cout << "  --realtime          Pace file input at its frame rate (default: as fast as possible)\n";
             std::cout << "  --no-audio          Disable audio capture\n";
+            std::cout << "  --audio-device <d>  ALSA capture device (default: default)\n";
+            std::cout << "  --audio-period <n>  Audio read size in frames (default: 480)\n";
             std::cout << "  --no-cursor         Disable cursor capture\n";
             std::cout << "  --help, -h          Show this help message\n";
             return 0;
@@ -58,14 +333,41 @@ int main(int argc, char* argv[]) {
     std::cout << "  Output: " << settings.output_path << "\n\n";
 
     // Initialize capture engine
-    if (!engine.initialize(settings)) {
+    playrec::FileVideoCapture* input = nullptr;
+    bool initialized = false;
+    if (!input_path.empty()) {
+        auto file_capture = std::make_unique<playrec::FileVideoCapture>(input_path, raw_format, input_realtime);
+        if (!file_capture->open()) {
+            return 1;
+        }
+
+        // Encode at the file's size and rate; without pacing, the file waits
+        // for the encoder instead of dropping frames
+        auto [width, height] = file_capture->get_resolution();
+        settings.width = width;
+        settings.height = height;
+        settings.target_fps = std::max(1, static_cast<int>(std::lround(file_capture->frame_rate())));
+        settings.frameRate = settings.target_fps;
+        settings.capture_audio = false;
+        if (!input_realtime) {
+            settings.drop_policy = playrec::DropPolicy::BLOCK;
+        }
+
+        input = file_capture.get();
+        initialized = engine.initialize(settings, std::move(file_capture), nullptr);
+    } else {
+        initialized = engine.initialize(settings);
+    }
+    if (!initialized) {
         std::cerr << "Error: Failed to initialize capture engine\n";
         return 1;
     }
 
     std::cout << "Capture engine initialized successfully!\n";
-    std::cout << "Press Enter to start capturing, then Enter again to stop...\n";
-    std::cin.get();
+    if (!input) {
+        std::cout << "Press Enter to start capturing, then Enter again to stop...\n";
+        std::cin.get();
+    }
 
     // Start capture
     if (!engine.start_capture()) {
@@ -73,28 +375,66 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    std::cout << "Capture started! Recording to: " << settings.output_path << "\n";
-    std::cout << "Press Enter to stop...\n";
+    bool replay_mode = settings.replay_buffer_seconds > 0;
+    int replays_requested = 0;
+    if (replay_mode) {
+        std::cout << "Capture started! Keeping the last " << settings.replay_buffer_seconds << " seconds in memory\n";
+        std::cout << "Type s and Enter to save them\n";
+#ifndef _WIN32
+        std::signal(SIGUSR1, request_replay);
+#endif
+    } else {
+        std::cout << "Capture started! Recording to: " << settings.output_path << "\n";
+    }
+    std::cout << (input ? "Press Enter to stop early...\n" : "Press Enter to stop...\n");
+
+    // Left blocked in getline() at exit, so not joined
+    std::signal(SIGINT, request_stop);
+    std::thread(read_commands).detach();
 
     // Monitor capture while running
-    auto start_time = std::chrono::high_resolution_clock::now();
+    // Stats go out on a fixed one-second timer, whatever stdin is doing
+    auto next_report = std::chrono::steady_clock::now() + std::chrono::seconds(1);
     while (engine.is_capturing()) {
-        // Check for user input (non-blocking would be better)
-        if (std::cin.peek() != EOF && std::cin.peek() == '\n') {
-            std::cin.get();
+        // File input stops by itself at end of file
+        if (input && !input->is_active()) {
             break;
         }
 
+        if (g_stop_requested) {
+            break;
+        }
+
+        if (replay_mode && g_replay_requested.exchange(false)) {
+            std::string path = replay_path(settings.output_path, ++replays_requested);
+            if (engine.save_replay(path)) {
+                std::cout << "\nSaving replay to " << path << "\n";
+            }
+        }
+
         // Display stats every second
-        auto current_time = std::chrono::high_resolution_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(current_time - start_time);
-        
-        if (elapsed.count() > 0 && elapsed.count() % 1 == 0) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= next_report) {
+            next_report += std::chrono::seconds(1);
+            if (next_report <= now) {
+                next_report = now + std::chrono::seconds(1);
+            }
+
             auto stats = engine.get_stats();
             std::cout << "\rFrames: " << stats.frames_captured 
-                      << " | FPS: " << std::fixed << std::setprecision(1) << stats.average_fps
+                      << " | FPS: " << std::fixed << std::setprecision(1) << stats.current_fps
+                      << " | CPU: " << stats.cpu_usage << "%"
                       << " | Dropped: " << stats.frames_dropped 
-                      << " | Size: " << (stats.file_size_bytes / 1024 / 1024) << " MB" << std::flush;
+                      << " | Queue: " << stats.queue_depth
+                      << " | Size: " << ((replay_mode ? stats.replay_bytes : stats.file_size_bytes) / 1024 / 1024) << " MB"
+                      << std::flush;
+
+            if (!stats_json_path.empty() && stats_json_path != "-") {
+                if (!save_stats_json(stats_json_path, stats, true)) {
+                    std::cerr << "\nFailed to write " << stats_json_path << "\n";
+                    stats_json_path.clear();
+                }
+            }
         }
 
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
@@ -102,7 +442,7 @@ int main(int argc, char* argv[]) {
 
     // Stop capture
     std::cout << "\nStopping capture...\n";
-    engine.stop_capture();
+    bool output_written = engine.stop_capture();
 
     // Final stats
     auto final_stats = engine.get_stats();
@@ -110,9 +450,71 @@ int main(int argc, char* argv[]) {
     std::cout << "Final Statistics:\n";
     std::cout << "  Total frames captured: " << final_stats.frames_captured << "\n";
     std::cout << "  Frames dropped: " << final_stats.frames_dropped << "\n";
+    std::cout << "  Queue overflows: " << final_stats.queue_overflows << "\n";
+    std::cout << "  Frame pool: " << final_stats.pool_hits << " hits, " << final_stats.pool_misses
+              << " misses, peak " << (final_stats.pool_high_water_bytes / 1024.0 / 1024.0) << " MB\n";
+    std::cout << "  Grab latency: " << final_stats.grab_latency_ms << " ms avg, "
+              << final_stats.max_grab_latency_ms << " ms max\n";
+    if (final_stats.capture_ticks > 0) {
+        std::cout << "  Capture pacing: " << final_stats.capture_ticks << " ticks, "
+                  << final_stats.capture_ticks_missed << " missed, wakeup late " << final_stats.capture_late_p99_ms
+                  << " ms p99, jitter " << final_stats.capture_jitter_ms << " ms\n";
+    }
+    std::cout << "  Unchanged frames: " << final_stats.frames_unchanged << " ("
+              << final_stats.frames_skipped << " not encoded, " << final_stats.full_frame_copies
+              << " full-frame copies)\n";
+    if (settings.capture_audio) {
+        std::cout << "  Audio capture: " << final_stats.audio_xruns << " xruns, " << final_stats.audio_chunks_dropped
+                  << " chunks dropped, latency " << final_stats.audio_latency_ms << " ms avg, "
+                  << final_stats.max_audio_latency_ms << " ms max\n";
+    }
+    std::cout << "  Color conversion: " << final_stats.convert_ms << " ms avg per frame ("
+              << final_stats.convert_backend << ")\n";
+    std::cout << "  Encoder threading: " << final_stats.encoder_threading << ", latency p50 "
+              << final_stats.encode_latency_p50_ms << " ms, p95 " << final_stats.encode_latency_p95_ms << " ms\n";
+    if (replay_mode) {
+        std::cout << "  Replays saved: " << final_stats.replays_saved << " (buffer held "
+                  << final_stats.replay_seconds << " s, " << (final_stats.replay_bytes / 1024.0 / 1024.0) << " MB)\n";
+    }
+    std::cout << "  Encoder speed changes: " << final_stats.speed_adjustments.size() << "\n";
+    for (const auto& adjustment : final_stats.speed_adjustments) {
+        std::cout << "    frame " << adjustment.frame << ": level " << adjustment.from_level << " -> "
+                  << adjustment.to_level << " (" << adjustment.setting << ", "
+                  << (adjustment.swapped ? "new encoder" : "reconfigured") << ") " << adjustment.reason << "\n";
+    }
+    for (const auto& stage : final_stats.stages) {
+        std::cout << "  Stage " << stage.name << ": " << stage.items << " items, "
+                  << stage.average_service_ms << " ms avg, " << stage.p99_service_ms << " ms p99, "
+                  << stage.max_service_ms << " ms max";
+        if (stage.cpu_ms > 0) {
+            std::cout << ", " << stage.cpu_ms << " ms CPU";
+        }
+        if (stage.queue_capacity > 0) {
+            std::cout << ", queue peak " << stage.queue_high_water << "/" << stage.queue_capacity
+                      << ", blocked " << stage.blocked_ms << " ms";
+        }
+        std::cout << "\n";
+    }
     std::cout << "  Average FPS: " << std::fixed << std::setprecision(2) << final_stats.average_fps << "\n";
+    std::cout << "  CPU time: " << final_stats.cpu_seconds << " s ("
+              << (final_stats.elapsed_seconds > 0 ? 100.0 * final_stats.cpu_seconds / final_stats.elapsed_seconds : 0.0)
+              << "% of one core)\n";
     std::cout << "  File size: " << (final_stats.file_size_bytes / 1024.0 / 1024.0) << " MB\n";
-    std::cout << "  Output saved to: " << settings.output_path << "\n";
+    std::cout << "  Output I/O: " << (final_stats.io_bytes_per_second / 1024.0 / 1024.0) << " MB/s in "
+              << final_stats.io_writes_per_second << " writes/s\n";
+    if (!output_written) {
+        std::cerr << "  Output incomplete: " << settings.output_path << " could not be fully written\n";
+    } else if (final_stats.segments > 1) {
+        std::cout << "  Output saved to: " << final_stats.segments << " segments, from " << settings.output_path
+                  << " to " << final_stats.segment_path << "\n";
+    } else {
+        std::cout << "  Output saved to: " << settings.output_path << "\n";
+    }
+
+    if (!stats_json_path.empty() && !save_stats_json(stats_json_path, final_stats, false)) {
+        std::cerr << "Failed to write " << stats_json_path << "\n";
+        return 1;
+    }
 
-    return 0;
+    return output_written ? 0 : 1;
 }
\ No newline at end of file
@@ -0,0 +1,82 @@
+#include "rate_controller.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace playrec {
+
+namespace {
+
+constexpr double kSmoothing = 0.1;         // Weight of the newest frame in the average
+constexpr double kOverBudget = 0.85;       // Step cheaper above this share of the interval
+constexpr double kUnderBudget = 0.5;       // Headroom needed to step back up
+constexpr int kQuietWindowsToStepUp = 3;
+
+} // namespace
+
+void RateController::configure(double frame_budget_ms, int window_frames, int levels, size_t queue_capacity) {
+    m_budget_ms = frame_budget_ms;
+    m_window_frames = std::max(1, window_frames);
+    m_levels = std::max(1, levels);
+    m_queue_capacity = queue_capacity;
+    m_level = 0;
+    m_average_ms = 0.0;
+    m_primed = false;
+    m_frames_in_window = 0;
+    m_queue_high = 0;
+    m_quiet_windows = 0;
+    m_settling = false;
+    m_reason[0] = '\0';
+}
+
+int RateController::on_frame(double encode_ms, size_t queue_depth) {
+    m_average_ms = m_primed ? m_average_ms + kSmoothing * (encode_ms - m_average_ms) : encode_ms;
+    m_primed = true;
+    m_queue_high = std::max(m_queue_high, queue_depth);
+
+    if (++m_frames_in_window < m_window_frames) {
+        return -1;
+    }
+    size_t queue_high = m_queue_high;
+    m_frames_in_window = 0;
+    m_queue_high = 0;
+
+    // The window after a change mixes old and new settings (and a swap's flush)
+    if (m_settling) {
+        m_settling = false;
+        return -1;
+    }
+
+    bool over_budget = m_average_ms > m_budget_ms * kOverBudget;
+    bool backed_up = m_queue_capacity > 0 && queue_high * 2 > m_queue_capacity;
+    if ((over_budget || backed_up) && m_level + 1 < m_levels) {
+        std::snprintf(m_reason, sizeof(m_reason), "%s: encode %.1f ms / %.1f ms budget, queue %zu",
+                      backed_up ? "queue backing up" : "over budget", m_average_ms, m_budget_ms, queue_high);
+        m_quiet_windows = 0;
+        m_settling = true;
+        return ++m_level;
+    }
+
+    bool headroom = m_average_ms < m_budget_ms * kUnderBudget && queue_high <= 1;
+    m_quiet_windows = headroom ? m_quiet_windows + 1 : 0;
+    if (m_quiet_windows >= kQuietWindowsToStepUp && m_level > 0) {
+        std::snprintf(m_reason, sizeof(m_reason), "headroom: encode %.1f ms / %.1f ms budget",
+                      m_average_ms, m_budget_ms);
+        m_quiet_windows = 0;
+        m_settling = true;
+        return --m_level;
+    }
+    return -1;
+}
+
+void RateController::sync_level(int level) {
+    if (level == m_level) {
+        return;
+    }
+    if (level < m_level) {
+        m_levels = std::max(1, m_level);
+    }
+    m_level = std::clamp(level, 0, m_levels - 1);
+    m_quiet_windows = 0;
+}
+
+} // namespace playrec
@@ -0,0 +1,127 @@
+#include "replay_buffer.h"
+#include <algorithm>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/mathematics.h>
+}
+
+namespace playrec {
+
+namespace {
+
+double packet_time(const AVPacket* packet) {
+    return packet->time_base.den > 0 ? packet->pts * av_q2d(packet->time_base) : 0.0;
+}
+
+} // namespace
+
+ReplayBuffer::ReplayBuffer(double window_seconds, size_t memory_budget_bytes)
+    : m_window_seconds(window_seconds), m_budget_bytes(memory_budget_bytes) {}
+
+void ReplayBuffer::add(EncodedPacket& packet) {
+    if (!packet) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t sequence = m_front_sequence + m_packets.size();
+    if (packet.stream == StreamType::VIDEO) {
+        double time = packet_time(packet.get());
+        m_newest_time = std::max(m_newest_time, time);
+        if (packet.is_keyframe()) {
+            m_keyframes.push_back({sequence, time});
+        }
+    }
+    m_bytes += packet.size();
+    m_packets.push_back(std::move(packet));
+
+    // Drop the oldest GOP while the next one still reaches back far enough
+    while (m_keyframes.size() > 1 && m_keyframes[1].time <= m_newest_time - m_window_seconds) {
+        evict_before(m_keyframes[1].sequence);
+    }
+
+    // Over budget: give up whole GOPs first, and if a single GOP is too
+    // big, packets from its front (leaving nothing savable until the next
+    // keyframe)
+    while (m_bytes > m_budget_bytes && !m_packets.empty()) {
+        if (m_keyframes.size() > 1) {
+            evict_before(m_keyframes[1].sequence);
+        } else {
+            evict_before(m_front_sequence + 1);
+        }
+    }
+}
+
+void ReplayBuffer::evict_before(uint64_t sequence) {
+    while (!m_packets.empty() && m_front_sequence < sequence) {
+        m_bytes -= m_packets.front().size();
+        m_packets.pop_front();
+        m_front_sequence++;
+        m_packets_evicted++;
+    }
+    while (!m_keyframes.empty() && m_keyframes.front().sequence < m_front_sequence) {
+        m_keyframes.pop_front();
+    }
+}
+
+std::vector<EncodedPacket> ReplayBuffer::snapshot(double seconds) const {
+    std::vector<EncodedPacket> packets;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_keyframes.empty()) {
+        return packets;
+    }
+
+    // Latest keyframe at or before the requested start, else the oldest
+    const Keyframe* start = &m_keyframes.front();
+    if (seconds > 0.0) {
+        double target = m_newest_time - seconds;
+        for (const auto& keyframe : m_keyframes) {
+            if (keyframe.time > target) {
+                break;
+            }
+            start = &keyframe;
+        }
+    }
+
+    const EncodedPacket& first = m_packets[start->sequence - m_front_sequence];
+    int64_t start_pts = first.pts();
+    AVRational start_base = first.get()->time_base;
+
+    packets.reserve(m_front_sequence + m_packets.size() - start->sequence);
+    for (size_t i = 0; i < m_packets.size(); ++i) {
+        const EncodedPacket& packet = m_packets[i];
+        int64_t offset = av_rescale_q(start_pts, start_base, packet.get()->time_base);
+        bool keep = packet.stream == StreamType::VIDEO ? m_front_sequence + i >= start->sequence
+                                                       : packet.pts() >= offset;
+        if (!keep) {
+            continue;
+        }
+
+        // The reference owns its own timestamps; the payload stays shared
+        EncodedPacket copy = packet.ref();
+        if (!copy) {
+            break;
+        }
+        AVPacket* pkt = copy.get();
+        pkt->pts -= offset;
+        if (pkt->dts != AV_NOPTS_VALUE) {
+            pkt->dts -= offset;
+        }
+        packets.push_back(std::move(copy));
+    }
+    return packets;
+}
+
+ReplayBuffer::Stats ReplayBuffer::get_stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats;
+    stats.packets = m_packets.size();
+    stats.bytes = m_bytes;
+    stats.keyframes = m_keyframes.size();
+    stats.seconds = m_keyframes.empty() ? 0.0 : m_newest_time - m_keyframes.front().time;
+    stats.packets_evicted = m_packets_evicted;
+    return stats;
+}
+
+} // namespace playrec
@@ -0,0 +1,302 @@
+#include "segment_writer.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/mathematics.h>
+}
+
+namespace playrec {
+
+namespace {
+
+constexpr AVRational kMicroseconds = {1, 1000000};
+constexpr size_t kMaxHeldAudio = 512;  // About 10 s of AAC frames
+
+int64_t packet_us(const AVPacket* packet) {
+    return packet->time_base.den > 0 ? av_rescale_q(packet->pts, packet->time_base, kMicroseconds) : 0;
+}
+
+std::string parent_directory(const std::string& path) {
+    auto slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+} // namespace
+
+SegmentWriter::SegmentWriter(SegmentPolicy policy, std::string filename_format)
+    : m_policy(policy), m_filename_format(std::move(filename_format)) {}
+
+SegmentWriter::~SegmentWriter() {
+    finalize();
+}
+
+bool SegmentWriter::initialize(const std::string& path, const VideoStreamInfo& video, int fps,
+                               int audio_sample_rate, int audio_channels, bool has_audio,
+                               const MP4Options& options) {
+    m_video = video;
+    m_fps = fps;
+    m_audio_sample_rate = audio_sample_rate;
+    m_audio_channels = audio_channels;
+    m_has_audio = has_audio;
+    m_options = options;
+    m_directory = parent_directory(path);
+    return open_segment(m_current, path, 0);
+}
+
+void SegmentWriter::set_keyframe_request(KeyframeRequest request) {
+    m_keyframe_request = std::move(request);
+}
+
+bool SegmentWriter::open_segment(Segment& segment, const std::string& path, int64_t start_us) {
+    auto writer = std::make_unique<MP4Writer>();
+    if (!writer->initialize(path, m_video, m_fps, m_audio_sample_rate, m_audio_channels, m_options)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    segment.writer = std::move(writer);
+    segment.path = path;
+    segment.start_us = start_us;
+    segment.bytes = 0;
+    m_stats.segments++;
+    m_stats.current_path = path;
+    return true;
+}
+
+bool SegmentWriter::write_packet(EncodedPacket& packet) {
+    if (!m_current.writer || !packet) {
+        return false;
+    }
+
+    if (packet.stream == StreamType::VIDEO) {
+        int64_t time_us = packet_us(packet.get());
+        if (m_cut_pending && packet.is_keyframe() && time_us > m_current.start_us) {
+            cut(time_us);
+        }
+        m_newest_us = std::max(m_newest_us, time_us);
+        bool ok = write_to(m_current, packet);
+        check_limits();
+        return ok;
+    }
+
+    // Audio ahead of a pending cut waits to see which side it falls on
+    if (m_cut_pending) {
+        m_held_audio.push_back(std::move(packet));
+        if (m_held_audio.size() <= kMaxHeldAudio) {
+            return true;
+        }
+        // The keyframe is overdue; stop holding and keep the oldest in this segment
+        EncodedPacket oldest = std::move(m_held_audio.front());
+        m_held_audio.pop_front();
+        return write_to(m_current, oldest);
+    }
+
+    if (m_closing.writer) {
+        if (packet_us(packet.get()) < m_cut_us) {
+            return write_to(m_closing, packet);
+        }
+        finish_closing();
+    }
+    return write_to(m_current, packet);
+}
+
+bool SegmentWriter::write_to(Segment& segment, EncodedPacket& packet) {
+    AVPacket* pkt = packet.get();
+    if (segment.start_us > 0 && pkt->time_base.den > 0) {
+        int64_t offset = av_rescale_q(segment.start_us, kMicroseconds, pkt->time_base);
+        pkt->pts -= offset;
+        if (pkt->dts != AV_NOPTS_VALUE) {
+            pkt->dts -= offset;
+        }
+    }
+
+    size_t size = packet.size();
+    if (!segment.writer->write_packet(packet)) {
+        return false;
+    }
+    segment.bytes += size;
+
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    m_stats.bytes += size;
+    return true;
+}
+
+void SegmentWriter::check_limits() {
+    if (m_cut_pending || !m_policy.enabled()) {
+        return;
+    }
+
+    bool too_long = m_policy.max_seconds > 0.0 &&
+                    m_newest_us - m_current.start_us >= static_cast<int64_t>(m_policy.max_seconds * 1e6);
+    bool too_big = m_policy.max_bytes > 0 && m_current.bytes >= m_policy.max_bytes;
+    if (!too_long && !too_big) {
+        return;
+    }
+
+    // The encoder's next frame becomes an IDR; any keyframe that gets here
+    // first serves just as well
+    m_cut_pending = true;
+    m_cut_reason = too_long ? "time limit" : "size limit";
+    if (m_keyframe_request) {
+        m_keyframe_request();
+    }
+}
+
+bool SegmentWriter::cut(int64_t cut_us) {
+    m_cut_pending = false;
+
+    // A previous segment still waiting on audio gets none after this
+    finish_closing();
+
+    Segment next;
+    std::string path = next_path();
+    if (!open_segment(next, path, cut_us)) {
+        // Keep recording into the current file rather than losing anything
+        std::cerr << "Failed to start segment " << path << ", continuing in " << m_current.path << "\n";
+        m_policy = SegmentPolicy{};
+        while (!m_held_audio.empty()) {
+            write_to(m_current, m_held_audio.front());
+            m_held_audio.pop_front();
+        }
+        return false;
+    }
+
+    std::cout << "Segment " << m_current.path << " ended at " << cut_us / 1e6 << " s (" << m_cut_reason
+              << ", " << m_current.bytes << " bytes), continuing in " << path << "\n";
+    {
+        std::lock_guard<std::mutex> lock(m_stats_mutex);
+        m_closing = std::move(m_current);
+        m_current = std::move(next);
+    }
+    m_cut_us = cut_us;
+
+    // Held audio splits at the cut. Once any of it is past the cut nothing
+    // more can arrive for the previous segment.
+    bool audio_past_cut = !m_has_audio;
+    for (auto& held : m_held_audio) {
+        if (packet_us(held.get()) < cut_us) {
+            write_to(m_closing, held);
+        } else {
+            write_to(m_current, held);
+            audio_past_cut = true;
+        }
+    }
+    m_held_audio.clear();
+
+    if (audio_past_cut) {
+        finish_closing();
+    }
+    return true;
+}
+
+void SegmentWriter::finish_closing() {
+    if (!m_closing.writer) {
+        return;
+    }
+
+    // Writing the index of a long segment takes a while; the mux stage
+    // carries on with the next one meanwhile
+    if (m_finalize_thread.joinable()) {
+        m_finalize_thread.join();
+    }
+
+    std::unique_ptr<MP4Writer> writer;
+    uint64_t handed_over = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_stats_mutex);
+        writer = std::move(m_closing.writer);
+        m_closing = Segment{};
+        handed_over = writer->get_file_size();
+        m_finished_file_bytes += handed_over;
+    }
+    m_finalize_thread = std::thread([this, writer = std::move(writer), handed_over]() {
+        trace::set_thread_name("segment finalize");
+        bool ok = writer->finalize();
+        std::lock_guard<std::mutex> lock(m_stats_mutex);
+        m_finished_file_bytes += writer->get_file_size() - handed_over;  // The index
+        if (!ok) {
+            m_stats.segments_failed++;
+        }
+    });
+}
+
+std::string SegmentWriter::next_path() {
+    std::time_t now = std::time(nullptr);
+    std::tm local{};
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+
+    char name[256];
+    if (std::strftime(name, sizeof(name), m_filename_format.c_str(), &local) == 0) {
+        std::snprintf(name, sizeof(name), "segment");
+    }
+
+    // Cuts within the pattern's resolution (or a fixed pattern) get a suffix
+    std::string base = m_directory + name;
+    if (base == m_last_name) {
+        return base + "_" + std::to_string(++m_name_repeats + 1) + ".mp4";
+    }
+    m_last_name = base;
+    m_name_repeats = 0;
+    return base + ".mp4";
+}
+
+bool SegmentWriter::finalize() {
+    uint64_t failed = 0;
+    if (m_current.writer) {
+        // Audio held for a cut that never came belongs to this segment
+        while (!m_held_audio.empty()) {
+            write_to(m_current, m_held_audio.front());
+            m_held_audio.pop_front();
+        }
+        m_cut_pending = false;
+
+        if (m_closing.writer && !m_closing.writer->finalize()) {
+            failed++;
+        }
+        if (!m_current.writer->finalize()) {
+            failed++;
+        }
+
+        std::lock_guard<std::mutex> lock(m_stats_mutex);
+        if (m_closing.writer) {
+            m_finished_file_bytes += m_closing.writer->get_file_size();
+        }
+        m_finished_file_bytes += m_current.writer->get_file_size();
+        m_stats.io = m_current.writer->get_stats();
+        m_closing = Segment{};
+        m_current = Segment{};
+    }
+
+    if (m_finalize_thread.joinable()) {
+        m_finalize_thread.join();
+    }
+
+    // Including segments finished on the background thread
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    m_stats.segments_failed += failed;
+    return m_stats.segments_failed == 0;
+}
+
+SegmentWriter::Stats SegmentWriter::get_stats() const {
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    Stats stats = m_stats;
+    stats.file_bytes = m_finished_file_bytes;
+    if (m_closing.writer) {
+        stats.file_bytes += m_closing.writer->get_file_size();
+    }
+    if (m_current.writer) {
+        stats.file_bytes += m_current.writer->get_file_size();
+        stats.io = m_current.writer->get_stats();
+    }
+    return stats;
+}
+
+} // namespace playrec
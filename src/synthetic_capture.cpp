@@ -0,0 +1,244 @@
+#include "synthetic_capture.h"
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace playrec {
+
+namespace {
+
+constexpr int kScrollRowsPerFrame = 4;
+constexpr int kAudioChunkMs = 10;
+
+} // namespace
+
+SyntheticVideoCapture::SyntheticVideoCapture(uint64_t frame_limit, bool realtime)
+    : m_frame_limit(frame_limit), m_realtime(realtime) {}
+
+SyntheticVideoCapture::~SyntheticVideoCapture() {
+    stop();
+}
+
+bool SyntheticVideoCapture::initialize(const CaptureSettings& settings) {
+    if (settings.width <= 0 || settings.height <= 0 || settings.target_fps <= 0) {
+        std::cerr << "Invalid synthetic capture size or rate\n";
+        return false;
+    }
+
+    m_width = settings.width;
+    m_height = settings.height;
+    m_fps = settings.target_fps;
+
+    // Gradients plus a blocky pseudo-random texture, so that the scrolling
+    // picture is neither trivially compressible nor pure noise
+    size_t stride = static_cast<size_t>(m_width) * 4;
+    m_pattern.resize(stride * m_height * 2);
+    for (int y = 0; y < m_height * 2; ++y) {
+        uint8_t* row = m_pattern.data() + y * stride;
+        for (int x = 0; x < m_width; ++x) {
+            // Hash of the 16x16 block this pixel falls in
+            uint32_t hash = static_cast<uint32_t>(x >> 4) * 73856093u ^ static_cast<uint32_t>(y >> 4) * 19349663u;
+            hash ^= hash >> 13;
+            hash *= 0x5bd1e995u;
+            hash ^= hash >> 15;
+            uint8_t texture = static_cast<uint8_t>(hash & 0x3F);
+            row[x * 4 + 0] = static_cast<uint8_t>(x * 255 / m_width) ^ texture;
+            row[x * 4 + 1] = static_cast<uint8_t>(y * 127 / m_height) + texture;
+            row[x * 4 + 2] = static_cast<uint8_t>((x + y) >> 3);
+            row[x * 4 + 3] = 255;
+        }
+    }
+
+    m_frame_pool.reserve(settings, stride * m_height);
+
+    std::cout << "Synthetic video capture initialized: " << m_width << "x" << m_height
+              << " @ " << m_fps << " FPS" << (m_realtime ? " (realtime)" : "") << "\n";
+    return true;
+}
+
+bool SyntheticVideoCapture::start() {
+    if (m_is_active) {
+        return false;
+    }
+
+    m_should_stop = false;
+    m_finished = false;
+    m_frames_emitted = 0;
+    m_start_time = std::chrono::high_resolution_clock::now();
+    m_is_active = true;
+    m_thread = std::thread(&SyntheticVideoCapture::generate_loop, this);
+    return true;
+}
+
+void SyntheticVideoCapture::stop() {
+    m_should_stop = true;
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    m_is_active = false;
+    wake();
+}
+
+std::pair<int, int> SyntheticVideoCapture::get_resolution() const {
+    return {m_width, m_height};
+}
+
+bool SyntheticVideoCapture::is_active() const {
+    return m_is_active;
+}
+
+TimeDuration SyntheticVideoCapture::media_time() const {
+    return TimeDuration(static_cast<double>(m_frames_emitted) / m_fps);
+}
+
+bool SyntheticVideoCapture::wait_for_media_time(TimeDuration media, const std::atomic<bool>& cancel) const {
+    std::unique_lock<std::mutex> lock(m_progress_mutex);
+    m_progress.wait(lock, [&]() {
+        return media_time() >= media || m_finished || m_should_stop || cancel;
+    });
+    return media_time() >= media;
+}
+
+void SyntheticVideoCapture::wake() const {
+    // Taking the lock orders the caller's flag before a waiter's check
+    {
+        std::lock_guard<std::mutex> lock(m_progress_mutex);
+    }
+    m_progress.notify_all();
+}
+
+void SyntheticVideoCapture::generate_loop() {
+    size_t stride = static_cast<size_t>(m_width) * 4;
+    size_t size = stride * m_height;
+
+    m_pacer.set_rate(m_fps);
+    m_pacer.start();
+
+    for (uint64_t index = 0; !m_should_stop; ++index) {
+        if (m_frame_limit > 0 && index >= m_frame_limit) {
+            m_finished = true;
+            wake();
+            break;
+        }
+
+        auto offset = std::chrono::duration_cast<TimeStamp::duration>(
+            std::chrono::duration<double>(static_cast<double>(index) / m_fps));
+        TimeStamp timestamp = m_start_time + offset;
+        if (m_realtime) {
+            m_pacer.wait_for(index);
+        }
+
+        auto grab_start = std::chrono::high_resolution_clock::now();
+        Frame frame;
+        frame.width = m_width;
+        frame.height = m_height;
+        frame.stride = static_cast<int>(stride);
+        frame.format = VideoFormat::BGRA32;
+        frame.timestamp = timestamp;
+        frame.data = m_frame_pool.acquire(size);
+
+        size_t row = (index * kScrollRowsPerFrame) % static_cast<size_t>(m_height);
+        std::memcpy(frame.data.data(), m_pattern.data() + row * stride, size);
+        record_grab_latency(std::chrono::high_resolution_clock::now() - grab_start);
+
+        emit_frame(frame);
+        {
+            std::lock_guard<std::mutex> lock(m_progress_mutex);
+            m_frames_emitted++;
+        }
+        m_progress.notify_all();
+    }
+}
+
+SyntheticAudioCapture::SyntheticAudioCapture(const SyntheticVideoCapture* pace) : m_pace(pace) {}
+
+SyntheticAudioCapture::~SyntheticAudioCapture() {
+    stop();
+}
+
+bool SyntheticAudioCapture::initialize(const CaptureSettings& settings) {
+    m_sample_rate = settings.sampleRate > 0 ? settings.sampleRate : 48000;
+    m_channels = settings.channels > 0 ? settings.channels : 2;
+    std::cout << "Synthetic audio capture initialized: " << m_sample_rate << "Hz, "
+              << m_channels << " channels\n";
+    return true;
+}
+
+bool SyntheticAudioCapture::start() {
+    if (m_is_active) {
+        return false;
+    }
+
+    m_should_stop = false;
+    m_is_active = true;
+    m_thread = std::thread(&SyntheticAudioCapture::generate_loop, this);
+    return true;
+}
+
+void SyntheticAudioCapture::stop() {
+    m_should_stop = true;
+    if (m_pace) {
+        m_pace->wake();
+    }
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    m_is_active = false;
+}
+
+bool SyntheticAudioCapture::is_active() const {
+    return m_is_active;
+}
+
+void SyntheticAudioCapture::generate_loop() {
+    int samples_per_chunk = m_sample_rate * kAudioChunkMs / 1000;
+    double phase = 0.0;
+    double phase_increment = 2.0 * M_PI * 440.0 / m_sample_rate;
+    TimeStamp start_time = m_pace ? m_pace->start_time() : std::chrono::high_resolution_clock::now();
+    FramePacer pacer;
+    pacer.set_period(std::chrono::milliseconds(kAudioChunkMs));
+    pacer.start();
+
+    for (uint64_t chunk = 0; !m_should_stop; ++chunk) {
+        // Stamped at the end of the chunk, like a real capture callback
+        TimeDuration chunk_end(static_cast<double>((chunk + 1) * kAudioChunkMs) / 1000.0);
+
+        if (m_pace) {
+            // Stay within one chunk of the video, waking once per frame; stop
+            // where it stopped
+            TimeDuration chunk(kAudioChunkMs / 1000.0);
+            if (!m_pace->wait_for_media_time(chunk_end - chunk, m_should_stop)) {
+                return;
+            }
+        } else {
+            pacer.wait_for(chunk + 1);
+        }
+        if (m_should_stop) {
+            break;
+        }
+
+        AudioSample sample;
+        sample.sample_rate = m_sample_rate;
+        sample.channels = m_channels;
+        sample.format = AudioFormat::PCM_S16LE;
+        sample.timestamp = start_time + std::chrono::duration_cast<TimeStamp::duration>(chunk_end);
+        sample.data.resize(static_cast<size_t>(samples_per_chunk) * m_channels * 2);
+
+        auto* out = reinterpret_cast<int16_t*>(sample.data.data());
+        for (int i = 0; i < samples_per_chunk; ++i) {
+            auto value = static_cast<int16_t>(std::sin(phase) * 0.1 * 32767);
+            for (int ch = 0; ch < m_channels; ++ch) {
+                *out++ = value;
+            }
+            phase += phase_increment;
+            if (phase >= 2.0 * M_PI) {
+                phase -= 2.0 * M_PI;
+            }
+        }
+
+        emit_sample(sample);
+    }
+}
+
+} // namespace playrec
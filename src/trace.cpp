@@ -0,0 +1,176 @@
+#include "trace.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace playrec {
+namespace trace {
+
+namespace detail {
+std::atomic<bool> g_enabled{false};
+TimeStamp g_origin{};
+}
+
+namespace {
+
+struct Event {
+    const char* name;
+    uint64_t frame;
+    int64_t begin_ns;     // Since the session origin
+    int64_t duration_ns;
+};
+
+// Written only by its own thread; read once the session is over
+struct ThreadBuffer {
+    ThreadBuffer(size_t capacity, int tid) : events(capacity), tid(tid) {}
+
+    std::vector<Event> events;            // Ring, indexed by recorded % size
+    std::atomic<uint64_t> recorded{0};
+    std::atomic<const char*> name{nullptr};
+    int tid;
+};
+
+std::mutex g_mutex;  // Guards the buffer list and the session settings
+std::vector<std::unique_ptr<ThreadBuffer>> g_buffers;
+size_t g_events_per_thread = kDefaultEventsPerThread;
+std::atomic<uint64_t> g_session{0};
+
+thread_local ThreadBuffer* t_buffer = nullptr;
+thread_local uint64_t t_session = 0;
+
+// The calling thread's buffer, added on its first span of the session
+ThreadBuffer* thread_buffer() {
+    uint64_t session = g_session.load(std::memory_order_acquire);
+    if (t_session != session) {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        int tid = static_cast<int>(g_buffers.size()) + 1;
+        g_buffers.push_back(std::make_unique<ThreadBuffer>(g_events_per_thread, tid));
+        t_buffer = g_buffers.back().get();
+        t_session = session;
+    }
+    return t_buffer;
+}
+
+int64_t since_origin_ns(TimeStamp time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time - detail::g_origin).count();
+}
+
+} // namespace
+
+void start(TimeStamp origin, size_t events_per_thread) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    detail::g_enabled.store(false, std::memory_order_release);
+    g_buffers.clear();
+    g_events_per_thread = std::max<size_t>(1, events_per_thread);
+    detail::g_origin = origin;
+    g_session.fetch_add(1, std::memory_order_acq_rel);
+    detail::g_enabled.store(true, std::memory_order_release);
+}
+
+void stop() {
+    detail::g_enabled.store(false, std::memory_order_release);
+}
+
+void set_thread_name(const char* name) {
+    if (enabled()) {
+        thread_buffer()->name.store(name, std::memory_order_relaxed);
+    }
+}
+
+void complete(const char* name, uint64_t frame, TimeStamp begin, TimeStamp end) {
+    if (!enabled()) {
+        return;
+    }
+    ThreadBuffer* buffer = thread_buffer();
+    uint64_t index = buffer->recorded.load(std::memory_order_relaxed);
+    int64_t begin_ns = since_origin_ns(begin);
+    buffer->events[index % buffer->events.size()] = {name, frame, begin_ns, since_origin_ns(end) - begin_ns};
+    buffer->recorded.store(index + 1, std::memory_order_release);
+}
+
+bool write_json(const std::string& path) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+
+    struct Placed {
+        const Event* event;
+        int tid;
+    };
+    std::vector<Placed> frame_spans;
+    uint64_t spans = 0;
+    uint64_t overwritten = 0;
+
+    // Trace-event timestamps are in microseconds
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    out << "{\"ph\": \"M\", \"pid\": 1, \"name\": \"process_name\", \"args\": {\"name\": \"PlayRec\"}}";
+
+    for (const auto& buffer : g_buffers) {
+        const char* name = buffer->name.load(std::memory_order_relaxed);
+        out << ",\n{\"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->tid
+            << ", \"name\": \"thread_name\", \"args\": {\"name\": \"" << (name ? name : "thread") << "\"}}";
+
+        uint64_t recorded = buffer->recorded.load(std::memory_order_acquire);
+        uint64_t capacity = buffer->events.size();
+        uint64_t first = recorded > capacity ? recorded - capacity : 0;
+        overwritten += first;
+        for (uint64_t i = first; i < recorded; ++i) {
+            const Event& event = buffer->events[i % capacity];
+            out << ",\n{\"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->tid << ", \"name\": \"" << event.name
+                << "\", \"ts\": " << event.begin_ns / 1e3 << ", \"dur\": " << event.duration_ns / 1e3;
+            if (event.frame != kNoFrame) {
+                out << ", \"args\": {\"frame\": " << event.frame << "}";
+                frame_spans.push_back({&event, buffer->tid});
+            }
+            out << "}";
+            spans++;
+        }
+    }
+
+    // Flow arrows join each frame's spans in time order, across threads
+    std::sort(frame_spans.begin(), frame_spans.end(), [](const Placed& a, const Placed& b) {
+        if (a.event->frame != b.event->frame) {
+            return a.event->frame < b.event->frame;
+        }
+        return a.event->begin_ns < b.event->begin_ns;
+    });
+    for (size_t i = 0; i < frame_spans.size();) {
+        size_t end = i;
+        while (end < frame_spans.size() && frame_spans[end].event->frame == frame_spans[i].event->frame) {
+            end++;
+        }
+        for (size_t j = i; end - i > 1 && j < end; ++j) {
+            const Event& event = *frame_spans[j].event;
+            const char* phase = j == i ? "s" : j + 1 == end ? "f" : "t";
+            out << ",\n{\"ph\": \"" << phase << "\", \"pid\": 1, \"tid\": " << frame_spans[j].tid
+                << ", \"name\": \"frame\", \"cat\": \"frame\", \"id\": " << event.frame
+                << ", \"ts\": " << (event.begin_ns + event.duration_ns / 2) / 1e3;
+            if (j + 1 == end) {
+                out << ", \"bp\": \"e\"";
+            }
+            out << "}";
+        }
+        i = end;
+    }
+    out << "\n]}\n";
+
+    if (!out) {
+        return false;
+    }
+    std::cout << "Trace written to " << path << ": " << spans << " spans from " << g_buffers.size() << " threads";
+    if (overwritten > 0) {
+        std::cout << " (" << overwritten << " oldest overwritten)";
+    }
+    std::cout << "\n";
+    return true;
+}
+
+} // namespace trace
+} // namespace playrec
@@ -0,0 +1,307 @@
+#include "video_converter.h"
+#include "color_convert.h"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <utility>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+namespace playrec {
+
+namespace {
+
+AVPixelFormat to_av_pixel_format(VideoFormat format) {
+    switch (format) {
+        case VideoFormat::RGB24:   return AV_PIX_FMT_RGB24;
+        case VideoFormat::RGBA32:  return AV_PIX_FMT_RGBA;
+        case VideoFormat::BGR24:   return AV_PIX_FMT_BGR24;
+        case VideoFormat::BGRA32:  return AV_PIX_FMT_BGRA;
+        case VideoFormat::YUV420P: return AV_PIX_FMT_YUV420P;
+        case VideoFormat::NV12:    return AV_PIX_FMT_NV12;
+    }
+    return AV_PIX_FMT_NONE;
+}
+
+// Destinations the built-in kernels can write
+bool to_kernel_format(int av_format, VideoFormat& format) {
+    if (av_format == AV_PIX_FMT_YUV420P) {
+        format = VideoFormat::YUV420P;
+        return true;
+    }
+    if (av_format == AV_PIX_FMT_NV12) {
+        format = VideoFormat::NV12;
+        return true;
+    }
+    return false;
+}
+
+bool is_yuv(VideoFormat format) {
+    return format == VideoFormat::YUV420P || format == VideoFormat::NV12;
+}
+
+} // namespace
+
+struct VideoConverter::Impl {
+    // Everything the cached swscale context depends on
+    struct Key {
+        VideoFormat format = VideoFormat::RGB24;
+        int width = 0;
+        int height = 0;
+        int stride = 0;
+        int dst_format = AV_PIX_FMT_NONE;
+        int dst_width = 0;
+        int dst_height = 0;
+
+        bool operator==(const Key& other) const {
+            return format == other.format && width == other.width && height == other.height &&
+                   stride == other.stride && dst_format == other.dst_format &&
+                   dst_width == other.dst_width && dst_height == other.dst_height;
+        }
+        bool operator!=(const Key& other) const { return !(*this == other); }
+    };
+
+    SwsContext* sws_context = nullptr;
+    ColorKernel kernel = nullptr;  // Used instead of swscale when set
+    bool copy_planes = false;      // Source is already in the output format and size
+    Key key;
+    bool configured = false;
+    bool use_kernels = true;
+
+    // Written by the converting thread, read by get_stats()
+    std::atomic<uint64_t> frames_converted{0};
+    std::atomic<uint64_t> context_rebuilds{0};
+    std::atomic<uint64_t> last_convert_us{0};
+    std::atomic<uint64_t> total_convert_us{0};
+    std::atomic<const char*> backend{"none"};
+
+    ~Impl() {
+        if (sws_context) {
+            sws_freeContext(sws_context);
+        }
+    }
+
+    bool rebuild(const Key& new_key) {
+        if (sws_context) {
+            sws_freeContext(sws_context);
+            sws_context = nullptr;
+        }
+        kernel = nullptr;
+        copy_planes = false;
+        configured = false;
+
+        AVPixelFormat src_format = to_av_pixel_format(new_key.format);
+        AVPixelFormat dst_format = static_cast<AVPixelFormat>(new_key.dst_format);
+        bool same_size = new_key.width == new_key.dst_width && new_key.height == new_key.dst_height;
+
+        // YUV input (Y4M or raw replay) that already matches is copied as is
+        if (same_size && src_format == dst_format) {
+            copy_planes = true;
+            key = new_key;
+            configured = true;
+            context_rebuilds++;
+            backend = "copy";
+            std::cout << "Color conversion: " << av_get_pix_fmt_name(src_format) << " "
+                      << new_key.width << "x" << new_key.height << " (stride " << new_key.stride
+                      << ") copied unchanged\n";
+            return true;
+        }
+
+        // The kernels only convert, so anything that needs scaling stays on swscale
+        VideoFormat kernel_format;
+        if (use_kernels && same_size && to_kernel_format(new_key.dst_format, kernel_format)) {
+            kernel = get_color_kernel(new_key.format, kernel_format);
+        }
+        if (kernel) {
+            key = new_key;
+            configured = true;
+            context_rebuilds++;
+            backend = color_kernel_isa_name(detect_color_kernel_isa());
+            std::cout << "Color conversion: " << av_get_pix_fmt_name(src_format) << " "
+                      << new_key.width << "x" << new_key.height << " (stride " << new_key.stride << ") -> "
+                      << av_get_pix_fmt_name(dst_format) << " using " << backend.load() << " kernel\n";
+            return true;
+        }
+
+        // Without scaling the filter only matters for chroma subsampling,
+        // so take the fast path; use proper bilinear when resizing
+        int flags = same_size ? SWS_FAST_BILINEAR : SWS_BILINEAR;
+        sws_context = sws_getContext(new_key.width, new_key.height, src_format,
+                                     new_key.dst_width, new_key.dst_height, dst_format,
+                                     flags, nullptr, nullptr, nullptr);
+        if (!sws_context) {
+            std::cerr << "Could not create conversion context "
+                      << av_get_pix_fmt_name(src_format) << " -> " << av_get_pix_fmt_name(dst_format) << "\n";
+            return false;
+        }
+
+        // Match the kernels: BT.709 matrix, limited-range YUV out. RGB
+        // input is full range; YUV input is already limited range and
+        // must not be compressed a second time.
+        const int* bt709 = sws_getCoefficients(SWS_CS_ITU709);
+        int src_range = is_yuv(new_key.format) ? 0 : 1;
+        sws_setColorspaceDetails(sws_context, bt709, src_range, bt709, 0, 0, 1 << 16, 1 << 16);
+
+        key = new_key;
+        configured = true;
+        context_rebuilds++;
+        backend = "swscale";
+        std::cout << "Color conversion: " << av_get_pix_fmt_name(src_format) << " "
+                  << new_key.width << "x" << new_key.height << " (stride " << new_key.stride << ") -> "
+                  << av_get_pix_fmt_name(dst_format) << " " << new_key.dst_width << "x" << new_key.dst_height
+                  << (same_size ? "" : " (scaled)") << "\n";
+        return true;
+    }
+};
+
+ConvertedFrame::~ConvertedFrame() {
+    if (m_frame) {
+        av_frame_free(&m_frame);
+    }
+}
+
+ConvertedFrame::ConvertedFrame(ConvertedFrame&& other) noexcept
+    : timestamp(other.timestamp), m_frame(std::exchange(other.m_frame, nullptr)) {}
+
+ConvertedFrame& ConvertedFrame::operator=(ConvertedFrame&& other) noexcept {
+    if (this != &other) {
+        if (m_frame) {
+            av_frame_free(&m_frame);
+        }
+        m_frame = std::exchange(other.m_frame, nullptr);
+        timestamp = other.timestamp;
+    }
+    return *this;
+}
+
+ConvertedFrame ConvertedFrame::allocate(int av_format, int width, int height) {
+    ConvertedFrame converted;
+    converted.m_frame = av_frame_alloc();
+    if (!converted.m_frame) {
+        return converted;
+    }
+
+    converted.m_frame->format = av_format;
+    converted.m_frame->width = width;
+    converted.m_frame->height = height;
+    if (av_frame_get_buffer(converted.m_frame, 0) < 0) {
+        av_frame_free(&converted.m_frame);
+    }
+    return converted;
+}
+
+bool ConvertedFrame::make_writable() {
+    return m_frame && av_frame_make_writable(m_frame) >= 0;
+}
+
+VideoConverter::VideoConverter() : m_impl(std::make_unique<Impl>()) {}
+VideoConverter::~VideoConverter() = default;
+
+void VideoConverter::set_kernels_enabled(bool enabled) {
+    if (m_impl->use_kernels != enabled) {
+        m_impl->use_kernels = enabled;
+        m_impl->configured = false;
+    }
+}
+
+int VideoConverter::default_stride(VideoFormat format, int width) {
+    switch (format) {
+        case VideoFormat::RGB24:
+        case VideoFormat::BGR24:
+            return width * 3;
+        case VideoFormat::RGBA32:
+        case VideoFormat::BGRA32:
+            return width * 4;
+        case VideoFormat::YUV420P:
+        case VideoFormat::NV12:
+            return width;
+    }
+    return 0;
+}
+
+size_t VideoConverter::required_size(VideoFormat format, int stride, int height) {
+    size_t luma = static_cast<size_t>(stride) * height;
+    if (format == VideoFormat::YUV420P) {
+        // Two chroma planes at half stride and half height
+        return luma + 2 * static_cast<size_t>(stride / 2) * ((height + 1) / 2);
+    }
+    if (format == VideoFormat::NV12) {
+        // One interleaved chroma plane at full stride and half height
+        return luma + static_cast<size_t>(stride) * ((height + 1) / 2);
+    }
+    return luma;
+}
+
+bool VideoConverter::convert(const Frame& frame, AVFrame* dst) {
+    if (!dst || frame.data.empty() || frame.width <= 0 || frame.height <= 0) {
+        return false;
+    }
+
+    Impl::Key key;
+    key.format = frame.format;
+    key.width = frame.width;
+    key.height = frame.height;
+    key.stride = frame.stride > 0 ? frame.stride : default_stride(frame.format, frame.width);
+    key.dst_format = dst->format;
+    key.dst_width = dst->width;
+    key.dst_height = dst->height;
+
+    if (frame.data.size() < required_size(key.format, key.stride, key.height)) {
+        std::cerr << "Frame buffer too small for " << key.width << "x" << key.height << "\n";
+        return false;
+    }
+
+    if (!m_impl->configured || key != m_impl->key) {
+        if (!m_impl->rebuild(key)) {
+            return false;
+        }
+    }
+
+    const uint8_t* src_data[4] = {frame.data.data(), nullptr, nullptr, nullptr};
+    int src_linesize[4] = {key.stride, 0, 0, 0};
+    if (key.format == VideoFormat::YUV420P) {
+        src_data[1] = src_data[0] + static_cast<size_t>(key.stride) * key.height;
+        src_data[2] = src_data[1] + static_cast<size_t>(key.stride / 2) * ((key.height + 1) / 2);
+        src_linesize[1] = key.stride / 2;
+        src_linesize[2] = key.stride / 2;
+    } else if (key.format == VideoFormat::NV12) {
+        src_data[1] = src_data[0] + static_cast<size_t>(key.stride) * key.height;
+        src_linesize[1] = key.stride;
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+    if (m_impl->copy_planes) {
+        av_image_copy(dst->data, dst->linesize, src_data, src_linesize,
+                      static_cast<AVPixelFormat>(key.dst_format), key.width, key.height);
+    } else if (m_impl->kernel) {
+        m_impl->kernel(src_data[0], key.stride, key.width, key.height, dst->data, dst->linesize);
+    } else {
+        sws_scale(m_impl->sws_context, src_data, src_linesize, 0, key.height, dst->data, dst->linesize);
+    }
+    auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start_time).count();
+
+    m_impl->last_convert_us = static_cast<uint64_t>(elapsed_us);
+    m_impl->total_convert_us += static_cast<uint64_t>(elapsed_us);
+    m_impl->frames_converted++;
+    return true;
+}
+
+VideoConverter::Stats VideoConverter::get_stats() const {
+    Stats stats;
+    stats.frames_converted = m_impl->frames_converted;
+    stats.context_rebuilds = m_impl->context_rebuilds;
+    stats.last_convert_ms = m_impl->last_convert_us / 1000.0;
+    stats.backend = m_impl->backend;
+    if (stats.frames_converted > 0) {
+        stats.average_convert_ms = m_impl->total_convert_us / 1000.0 / stats.frames_converted;
+    }
+    return stats;
+}
+
+} // namespace playrec